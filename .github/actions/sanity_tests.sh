@@ -1,5 +1,11 @@
 set -e
 
+./build/bin/tester/sameboy_tester --jobs 5 --self-test --length 10 \
+      .github/actions/cgb_sound.gb \
+      .github/actions/cgb-acid2.gbc \
+--dmg .github/actions/dmg_sound-2.gb \
+      .github/actions/oam_bug-2.gb
+
 ./build/bin/tester/sameboy_tester --jobs 5 \
       --length 40 .github/actions/cgb_sound.gb \
       --length 10  .github/actions/cgb-acid2.gbc \
@@ -322,7 +322,7 @@ static void infraredStateChanged(GB_gameboy_t *gb, bool on)
         });
         borderModeChanged = false;
     }
-    GB_set_pixels_output(&gb, self.view.pixels);
+    [self.view updatePixelsOutput];
     if (self.vramWindow.isVisible) {
         dispatch_async(dispatch_get_main_queue(), ^{
             self.view.mouseHidingEnabled = (self.mainWindow.styleMask & NSFullScreenWindowMask) != 0;
@@ -369,7 +369,7 @@ static void infraredStateChanged(GB_gameboy_t *gb, bool on)
 
 - (void) preRun
 {
-    GB_set_pixels_output(&gb, self.view.pixels);
+    [self.view updatePixelsOutput];
     GB_set_sample_rate(&gb, 96000);
     self.audioClient = [[GBAudioClient alloc] initWithRendererBlock:^(UInt32 sampleRate, UInt32 nFrames, GB_sample_t *buffer) {
         [audioLock lock];
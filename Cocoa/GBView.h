@@ -14,6 +14,7 @@ typedef enum {
 @interface GBView : NSView<JOYListener>
 - (void) flip;
 - (uint32_t *) pixels;
+- (void) updatePixelsOutput;
 @property (weak) IBOutlet Document *document;
 @property GB_gameboy_t *gb;
 @property (nonatomic) GB_frame_blending_mode_t frameBlendingMode;
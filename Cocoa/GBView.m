@@ -106,6 +106,7 @@ static const uint8_t workboy_vk_to_key[] = {
 {
     uint32_t *image_buffers[3];
     unsigned char current_buffer;
+    bool pixels_output_changed;
     BOOL mouse_hidden;
     NSTrackingArea *tracking_area;
     BOOL _mouseHidingEnabled;
@@ -166,6 +167,7 @@ static const uint8_t workboy_vk_to_key[] = {
     image_buffers[0] = calloc(1, buffer_size);
     image_buffers[1] = calloc(1, buffer_size);
     image_buffers[2] = calloc(1, buffer_size);
+    pixels_output_changed = true;
     
     dispatch_async(dispatch_get_main_queue(), ^{
         [self setFrame:self.superview.frame];
@@ -180,6 +182,7 @@ static const uint8_t workboy_vk_to_key[] = {
 - (void) setFrameBlendingMode:(GB_frame_blending_mode_t)frameBlendingMode
 {
     _frameBlendingMode = frameBlendingMode;
+    pixels_output_changed = true;
     [self setNeedsDisplay:YES];
 }
 
@@ -289,6 +292,21 @@ static const uint8_t workboy_vk_to_key[] = {
     return image_buffers[(current_buffer + 1) % self.numberOfBuffers];
 }
 
+/* The core moves on to the next output buffer after every vblank, in the same order as flip, so the buffers only
+   need to be passed again after they were reallocated or their count changed. Passing them every frame would make
+   the core redraw the border every frame. */
+- (void) updatePixelsOutput
+{
+    if (!pixels_output_changed) return;
+    pixels_output_changed = false;
+    unsigned char count = self.numberOfBuffers;
+    void *buffers[3];
+    for (unsigned i = 0; i < count; i++) {
+        buffers[i] = image_buffers[(current_buffer + 1 + i) % count];
+    }
+    GB_set_pixels_output_buffers(_gb, buffers, count);
+}
+
 -(void)keyDown:(NSEvent *)theEvent
 {
     if ([theEvent type] != NSEventTypeFlagsChanged && theEvent.isARepeat) return;
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "gb.h"
 
@@ -14,12 +15,104 @@ static const uint8_t duties[] = {
     0, 1, 1, 1, 1, 1, 1, 0,
 };
 
-static void refresh_channel(GB_gameboy_t *gb, unsigned index, unsigned cycles_offset)
+/* Band-limited steps: a Blackman-windowed sinc, integrated over each output sample. Every row is for a step
+   1/BLEP_PHASES of a sample later than the previous one, and sums to 0x8000. */
+#define BLEP_PHASES 32
+#define BLEP_WIDTH 16
+
+static const int16_t blep_kernel[BLEP_PHASES][BLEP_WIDTH] = {
+    {6, -34, 69, -35, -249, 1115, -3388, 18901, 18899, -3388, 1115, -249, -35, 69, -34, 6},
+    {5, -30, 55, 2, -321, 1230, -3537, 18058, 19712, -3199, 985, -171, -74, 84, -38, 7},
+    {5, -27, 41, 36, -387, 1331, -3647, 17192, 20491, -2969, 840, -88, -114, 99, -42, 7},
+    {4, -23, 28, 69, -447, 1415, -3720, 16305, 21232, -2698, 681, 0, -155, 115, -46, 8},
+    {4, -19, 15, 99, -500, 1485, -3758, 15400, 21934, -2384, 508, 93, -197, 130, -50, 8},
+    {3, -16, 3, 126, -547, 1539, -3762, 14482, 22596, -2028, 323, 189, -240, 145, -54, 9},
+    {3, -13, -8, 151, -587, 1578, -3735, 13554, 23211, -1628, 126, 288, -283, 160, -58, 9},
+    {3, -9, -18, 174, -621, 1602, -3677, 12621, 23775, -1186, -81, 389, -326, 174, -61, 9},
+    {2, -7, -28, 193, -647, 1613, -3592, 11687, 24288, -700, -298, 492, -369, 188, -64, 10},
+    {2, -4, -36, 210, -667, 1609, -3481, 10755, 24746, -173, -523, 596, -410, 201, -67, 10},
+    {1, -2, -44, 225, -681, 1593, -3346, 9829, 25149, 396, -755, 700, -451, 213, -69, 10},
+    {1, 1, -51, 236, -689, 1565, -3191, 8913, 25492, 1005, -991, 803, -489, 224, -71, 10},
+    {1, 2, -56, 245, -690, 1525, -3017, 8011, 25773, 1654, -1230, 904, -526, 234, -72, 10},
+    {1, 4, -61, 252, -686, 1475, -2827, 7125, 25995, 2339, -1471, 1002, -560, 242, -72, 10},
+    {1, 6, -65, 255, -676, 1414, -2622, 6260, 26154, 3061, -1711, 1096, -591, 249, -72, 9},
+    {0, 7, -68, 257, -662, 1346, -2406, 5419, 26251, 3816, -1948, 1185, -619, 253, -72, 9},
+    {0, 8, -70, 256, -642, 1269, -2181, 4603, 26282, 4603, -2181, 1269, -642, 256, -70, 8},
+    {0, 9, -72, 253, -619, 1185, -1948, 3816, 26251, 5419, -2406, 1346, -662, 257, -68, 7},
+    {0, 9, -72, 249, -591, 1096, -1711, 3061, 26155, 6260, -2622, 1414, -676, 255, -65, 6},
+    {0, 10, -72, 242, -560, 1002, -1471, 2339, 25996, 7125, -2827, 1475, -686, 252, -61, 4},
+    {0, 10, -72, 234, -526, 904, -1230, 1654, 25774, 8011, -3017, 1525, -690, 245, -56, 2},
+    {0, 10, -71, 224, -489, 803, -991, 1005, 25493, 8913, -3191, 1565, -689, 236, -51, 1},
+    {0, 10, -69, 213, -451, 700, -755, 396, 25150, 9829, -3346, 1593, -681, 225, -44, -2},
+    {0, 10, -67, 201, -410, 596, -523, -173, 24748, 10755, -3481, 1609, -667, 210, -36, -4},
+    {0, 10, -64, 188, -369, 492, -298, -700, 24290, 11687, -3592, 1613, -647, 193, -28, -7},
+    {0, 9, -61, 174, -326, 389, -81, -1186, 23778, 12621, -3677, 1602, -621, 174, -18, -9},
+    {0, 9, -58, 160, -283, 288, 126, -1628, 23214, 13554, -3735, 1578, -587, 151, -8, -13},
+    {0, 9, -54, 145, -240, 189, 323, -2028, 22599, 14482, -3762, 1539, -547, 126, 3, -16},
+    {0, 8, -50, 130, -197, 93, 508, -2384, 21938, 15400, -3758, 1485, -500, 99, 15, -19},
+    {0, 8, -46, 115, -155, 0, 681, -2698, 21236, 16305, -3720, 1415, -447, 69, 28, -23},
+    {0, 7, -42, 99, -114, -88, 840, -2969, 20496, 17192, -3647, 1331, -387, 36, 41, -27},
+    {0, 7, -38, 84, -74, -171, 985, -3199, 19717, 18058, -3537, 1230, -321, 2, 55, -30},
+};
+
+/* Adds a step to the output, cycles (in 2MHz units) after the last rendered sample */
+static void add_blep_step(GB_gameboy_t *gb, GB_fixed_sample_t *buffer, unsigned cycles, int32_t left, int32_t right)
 {
-    unsigned multiplier = gb->apu_output.cycles_since_render + cycles_offset - gb->apu_output.last_update[index];
-    gb->apu_output.summed_samples[index].left += gb->apu_output.current_sample[index].left * multiplier;
-    gb->apu_output.summed_samples[index].right += gb->apu_output.current_sample[index].right * multiplier;
-    gb->apu_output.last_update[index] = gb->apu_output.cycles_since_render + cycles_offset;
+    if (!left && !right) return;
+    
+    uint32_t time = gb->apu_output.blep_offset + (((uint64_t)cycles * gb->apu_output.blep_rate) >> 16);
+    unsigned whole = time >> 16;
+    if (unlikely(whole > GB_BLEP_BUFFER_SIZE - BLEP_WIDTH)) {
+        whole = GB_BLEP_BUFFER_SIZE - BLEP_WIDTH;
+    }
+    const int16_t *kernel = blep_kernel[(time >> 11) & (BLEP_PHASES - 1)];
+    unsigned position = gb->apu_output.blep_position + whole;
+    
+    UNROLL
+    for (unsigned i = 0; i < BLEP_WIDTH; i++) {
+        GB_fixed_sample_t *slot = &buffer[(position + i) & (GB_BLEP_BUFFER_SIZE - 1)];
+        slot->left += (int64_t)left * kernel[i];
+        slot->right += (int64_t)right * kernel[i];
+    }
+}
+
+static void update_channel_level(GB_gameboy_t *gb, unsigned index, unsigned cycles)
+{
+    int32_t multiplier = gb->apu_output.channel_multiplier[index];
+    int32_t left = (gb->apu_output.current_sample[index].left * multiplier) >> 8;
+    int32_t right = (gb->apu_output.current_sample[index].right * multiplier) >> 8;
+    int32_t left_delta = left - gb->apu_output.channel_level[index].left;
+    int32_t right_delta = right - gb->apu_output.channel_level[index].right;
+    add_blep_step(gb, gb->apu_output.blep_buffer, cycles, left_delta, right_delta);
+    if (unlikely(gb->apu_output.channel_blep_buffers != NULL)) {
+        add_blep_step(gb, gb->apu_output.channel_blep_buffers + index * GB_BLEP_BUFFER_SIZE, cycles, left_delta, right_delta);
+    }
+    gb->apu_output.channel_level[index] = (GB_fixed_sample_t){left, right};
+}
+
+/* BLEP ringing overshoots steps, so full-scale output has to clip rather than wrap around */
+static inline int16_t saturate_sample(int64_t value)
+{
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return value;
+}
+
+static GB_sample_t integrate_blep_slot(GB_fixed_sample_t *buffer, GB_fixed_sample_t *sum, unsigned position)
+{
+    GB_fixed_sample_t *slot = &buffer[position & (GB_BLEP_BUFFER_SIZE - 1)];
+    sum->left += slot->left;
+    sum->right += slot->right;
+    *slot = (GB_fixed_sample_t){0, 0};
+    /* Channel levels are 24.8, and the kernel adds another 15 bits */
+    return (GB_sample_t){saturate_sample(sum->left >> 23), saturate_sample(sum->right >> 23)};
+}
+
+static void set_channel_output(GB_gameboy_t *gb, unsigned index, GB_sample_t output, unsigned cycles_offset)
+{
+    if (*(uint32_t *)&(gb->apu_output.current_sample[index]) == *(uint32_t *)&output) return;
+    gb->apu_output.current_sample[index] = output;
+    update_channel_level(gb, index, gb->apu_output.cycles_since_render + cycles_offset);
 }
 
 bool GB_apu_is_DAC_enabled(GB_gameboy_t *gb, unsigned index)
@@ -73,7 +166,7 @@ static void update_sample(GB_gameboy_t *gb, unsigned index, int8_t value, unsign
            playing PCM sample 0. */
         gb->apu.samples[index] = value;
         
-        if (gb->apu_output.sample_rate) {
+        if (gb->apu_output.sample_rate && !gb->apu_output.disable_rendering) {
             unsigned right_volume = (gb->io_registers[GB_IO_NR50] & 7) + 1;
             unsigned left_volume = ((gb->io_registers[GB_IO_NR50] >> 4) & 7) + 1;
             
@@ -99,10 +192,7 @@ static void update_sample(GB_gameboy_t *gb, unsigned index, int8_t value, unsign
                 output.left = 0xf * left_volume;
             }
             
-            if (*(uint32_t *)&(gb->apu_output.current_sample[index]) != *(uint32_t *)&output) {
-                refresh_channel(gb, index, cycles_offset);
-                gb->apu_output.current_sample[index] = output;
-            }
+            set_channel_output(gb, index, output, cycles_offset);
         }
         
         return;
@@ -115,7 +205,7 @@ static void update_sample(GB_gameboy_t *gb, unsigned index, int8_t value, unsign
         gb->apu.samples[index] = value;
     }
 
-    if (gb->apu_output.sample_rate) {
+    if (gb->apu_output.sample_rate && !gb->apu_output.disable_rendering) {
         unsigned right_volume = 0;
         if (gb->io_registers[GB_IO_NR51] & (1 << index)) {
             right_volume = (gb->io_registers[GB_IO_NR50] & 7) + 1;
@@ -125,82 +215,89 @@ static void update_sample(GB_gameboy_t *gb, unsigned index, int8_t value, unsign
             left_volume = ((gb->io_registers[GB_IO_NR50] >> 4) & 7) + 1;
         }
         GB_sample_t output = {(0xf - value * 2) * left_volume, (0xf - value * 2) * right_volume};
-        if (*(uint32_t *)&(gb->apu_output.current_sample[index]) != *(uint32_t *)&output) {
-            refresh_channel(gb, index, cycles_offset);
-            gb->apu_output.current_sample[index] = output;
-        }
+        set_channel_output(gb, index, output, cycles_offset);
     }
 }
 
-static double smooth(double x)
+/* 3x² - 2x³, in 16.16 fixed point */
+static uint32_t smooth(uint32_t x)
 {
-    return 3*x*x - 2*x*x*x;
+    uint32_t x2 = ((uint64_t)x * x) >> 16;
+    return ((uint64_t)x2 * (0x30000 - 2 * x)) >> 16;
 }
 
 static void render(GB_gameboy_t *gb)
 {
-    GB_sample_t output = {0, 0};
+    GB_sample_t mixed = integrate_blep_slot(gb->apu_output.blep_buffer, &gb->apu_output.blep_sum,
+                                            gb->apu_output.blep_position);
+    int32_t left = mixed.left;
+    int32_t right = mixed.right;
+    GB_sample_t channels[GB_N_CHANNELS];
+    if (unlikely(gb->apu_output.channel_blep_buffers != NULL)) {
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            channels[i] = integrate_blep_slot(gb->apu_output.channel_blep_buffers + i * GB_BLEP_BUFFER_SIZE,
+                                              &gb->apu_output.channel_blep_sum[i],
+                                              gb->apu_output.blep_position);
+        }
+    }
+    gb->apu_output.blep_position++;
+    
+    gb->apu_output.cycles_since_render = 0;
+    gb->apu_output.blep_offset = (uint64_t)(gb->apu_output.sample_cycles * gb->apu_output.blep_rate) >> 18;
 
     UNROLL
     for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
-        double multiplier = CH_STEP;
+        int32_t multiplier = CH_STEP << 16;
         
         if (gb->model < GB_MODEL_AGB) {
             if (!GB_apu_is_DAC_enabled(gb, i)) {
-                gb->apu_output.dac_discharge[i] -= ((double) DAC_DECAY_SPEED) / gb->apu_output.sample_rate;
-                if (gb->apu_output.dac_discharge[i] < 0) {
+                if (gb->apu_output.dac_discharge[i] < gb->apu_output.dac_decay_step) {
                     multiplier = 0;
                     gb->apu_output.dac_discharge[i] = 0;
                 }
                 else {
-                    multiplier *= smooth(gb->apu_output.dac_discharge[i]);
+                    gb->apu_output.dac_discharge[i] -= gb->apu_output.dac_decay_step;
+                    multiplier = CH_STEP * smooth(gb->apu_output.dac_discharge[i]);
                 }
             }
             else {
-                gb->apu_output.dac_discharge[i] += ((double) DAC_ATTACK_SPEED) / gb->apu_output.sample_rate;
-                if (gb->apu_output.dac_discharge[i] > 1) {
-                    gb->apu_output.dac_discharge[i] = 1;
+                gb->apu_output.dac_discharge[i] += gb->apu_output.dac_attack_step;
+                if (gb->apu_output.dac_discharge[i] > 0x10000) {
+                    gb->apu_output.dac_discharge[i] = 0x10000;
                 }
                 else {
-                    multiplier *= smooth(gb->apu_output.dac_discharge[i]);
+                    multiplier = CH_STEP * smooth(gb->apu_output.dac_discharge[i]);
                 }
             }
         }
 
-        if (likely(gb->apu_output.last_update[i] == 0)) {
-            output.left += gb->apu_output.current_sample[i].left * multiplier;
-            output.right += gb->apu_output.current_sample[i].right * multiplier;
-        }
-        else {
-            refresh_channel(gb, i, 0);
-            output.left += (signed long) gb->apu_output.summed_samples[i].left * multiplier
-                            / gb->apu_output.cycles_since_render;
-            output.right += (signed long) gb->apu_output.summed_samples[i].right * multiplier
-                            / gb->apu_output.cycles_since_render;
-            gb->apu_output.summed_samples[i] = (GB_sample_t){0, 0};
+        if (multiplier != gb->apu_output.channel_multiplier[i]) {
+            gb->apu_output.channel_multiplier[i] = multiplier;
+            update_channel_level(gb, i, 0);
         }
-        gb->apu_output.last_update[i] = 0;
     }
-    gb->apu_output.cycles_since_render = 0;
 
-    GB_sample_t filtered_output = gb->apu_output.highpass_mode?
-        (GB_sample_t) {output.left - gb->apu_output.highpass_diff.left,
-                       output.right - gb->apu_output.highpass_diff.right} :
-        output;
+    int64_t filtered_left = left;
+    int64_t filtered_right = right;
+    if (gb->apu_output.highpass_mode) {
+        filtered_left = (((int64_t)left << 16) - gb->apu_output.highpass_diff.left) / 0x10000;
+        filtered_right = (((int64_t)right << 16) - gb->apu_output.highpass_diff.right) / 0x10000;
+    }
+    GB_sample_t filtered_output = {saturate_sample(filtered_left), saturate_sample(filtered_right)};
 
     switch (gb->apu_output.highpass_mode) {
         case GB_HIGHPASS_OFF:
-            gb->apu_output.highpass_diff = (GB_double_sample_t) {0, 0};
+            gb->apu_output.highpass_diff = (GB_fixed_sample_t) {0, 0};
             break;
         case GB_HIGHPASS_ACCURATE:
-            gb->apu_output.highpass_diff = (GB_double_sample_t)
-                {output.left - filtered_output.left * gb->apu_output.highpass_rate,
-                    output.right - filtered_output.right * gb->apu_output.highpass_rate};
+            gb->apu_output.highpass_diff = (GB_fixed_sample_t)
+                {((int64_t)left << 16) - ((filtered_left * gb->apu_output.highpass_rate) >> 16),
+                    ((int64_t)right << 16) - ((filtered_right * gb->apu_output.highpass_rate) >> 16)};
             break;
         case GB_HIGHPASS_REMOVE_DC_OFFSET: {
             unsigned mask = gb->io_registers[GB_IO_NR51];
-            unsigned left_volume = 0;
-            unsigned right_volume = 0;
+            int32_t left_volume = 0;
+            int32_t right_volume = 0;
             UNROLL
             for (unsigned i = GB_N_CHANNELS; i--;) {
                 if (gb->apu.is_active[i]) {
@@ -217,17 +314,23 @@ static void render(GB_gameboy_t *gb)
                 }
                 mask >>= 1;
             }
-            gb->apu_output.highpass_diff = (GB_double_sample_t)
-            {left_volume * (1 - gb->apu_output.highpass_rate) + gb->apu_output.highpass_diff.left * gb->apu_output.highpass_rate,
-                right_volume * (1 - gb->apu_output.highpass_rate) + gb->apu_output.highpass_diff.right * gb->apu_output.highpass_rate};
+            /* The volumes describe the channels' current state, which the output only reflects GB_BLEP_DELAY samples later */
+            GB_fixed_sample_t *history = &gb->apu_output.dc_offset_history[gb->apu_output.blep_position & (GB_BLEP_DELAY - 1)];
+            GB_fixed_sample_t delayed = *history;
+            *history = (GB_fixed_sample_t){left_volume, right_volume};
+            left_volume = delayed.left;
+            right_volume = delayed.right;
+            int64_t inverse_rate = ((int64_t)1 << 32) - gb->apu_output.highpass_rate;
+            gb->apu_output.highpass_diff = (GB_fixed_sample_t)
+            {(((int64_t)left_volume << 16) * inverse_rate + gb->apu_output.highpass_diff.left * gb->apu_output.highpass_rate) >> 32,
+                (((int64_t)right_volume << 16) * inverse_rate + gb->apu_output.highpass_diff.right * gb->apu_output.highpass_rate) >> 32};
 
         case GB_HIGHPASS_MAX:;
         }
 
     }
     
-    assert(gb->apu_output.sample_callback);
-    gb->apu_output.sample_callback(gb, &filtered_output);
+    GB_apu_output_sample(gb, &filtered_output, gb->apu_output.channel_blep_buffers? channels : NULL);
 }
 
 static void update_square_sample(GB_gameboy_t *gb, unsigned index)
@@ -543,7 +646,7 @@ void GB_apu_run(GB_gameboy_t *gb)
         }
     }
 
-    if (gb->apu_output.sample_rate) {
+    if (gb->apu_output.sample_rate && !gb->apu_output.disable_rendering) {
         gb->apu_output.cycles_since_render += cycles;
 
         if (gb->apu_output.sample_cycles >= gb->apu_output.cycles_per_sample) {
@@ -1022,12 +1125,50 @@ void GB_apu_write(GB_gameboy_t *gb, uint8_t reg, uint8_t value)
     gb->io_registers[reg] = value;
 }
 
+/* 0.999958 ^ cycles_per_sample in 0.32 fixed point. Computed with integer math so the result does not depend on the
+   platform's pow, and saturated since the rate for 0 cycles (1.0) does not fit in 32 bits. */
+static uint32_t highpass_rate(double cycles_per_sample)
+{
+    if (cycles_per_sample >= 0x100000) return 0;
+    
+    const uint64_t base = 4294786907; // 0.999958
+    uint64_t cycles = cycles_per_sample * 0x10000; // 16.16
+    uint64_t rate = 1ULL << 32, power = base;
+    for (unsigned n = cycles >> 16; n; n >>= 1) {
+        if (n & 1) {
+            rate = (rate * power) >> 32;
+        }
+        power = (power * power) >> 32;
+    }
+    /* Linear interpolation is accurate enough for the fractional cycle */
+    rate -= (rate * ((((1ULL << 32) - base) * (cycles & 0xFFFF)) >> 16)) >> 32;
+    
+    return rate > UINT32_MAX? UINT32_MAX : rate;
+}
+
+/* Samples per 2MHz tick in 0.32 fixed point, saturated since more than one sample per tick (under 4 cycles per
+   sample) does not fit */
+static uint32_t blep_rate(double cycles_per_sample)
+{
+    double rate = 4 * 0x100000000 / cycles_per_sample;
+    return rate >= UINT32_MAX? UINT32_MAX : rate;
+}
+
+static void update_mixer_rates(GB_gameboy_t *gb, double cycles_per_sample)
+{
+    /* Rates set in clocks can be under 1Hz, which truncates sample_rate to 0 */
+    unsigned sample_rate = gb->apu_output.sample_rate ?: 1;
+    gb->apu_output.dac_decay_step = ((uint64_t)DAC_DECAY_SPEED << 16) / sample_rate;
+    gb->apu_output.dac_attack_step = ((uint64_t)DAC_ATTACK_SPEED << 16) / sample_rate;
+    gb->apu_output.highpass_rate = highpass_rate(cycles_per_sample);
+}
+
 void GB_set_sample_rate(GB_gameboy_t *gb, unsigned sample_rate)
 {
 
     gb->apu_output.sample_rate = sample_rate;
     if (sample_rate) {
-        gb->apu_output.highpass_rate = pow(0.999958,  GB_get_clock_rate(gb) / (double)sample_rate);
+        update_mixer_rates(gb, GB_get_clock_rate(gb) / (double)sample_rate);
     }
     gb->apu_output.rate_set_in_clocks = false;
     GB_apu_update_cycles_per_sample(gb);
@@ -1041,16 +1182,108 @@ void GB_set_sample_rate_by_clocks(GB_gameboy_t *gb, double cycles_per_sample)
         return;
     }
     gb->apu_output.cycles_per_sample = cycles_per_sample;
+    gb->apu_output.blep_rate = blep_rate(cycles_per_sample);
     gb->apu_output.sample_rate = GB_get_clock_rate(gb) / cycles_per_sample * 2;
-    gb->apu_output.highpass_rate = pow(0.999958, cycles_per_sample);
+    update_mixer_rates(gb, cycles_per_sample);
     gb->apu_output.rate_set_in_clocks = true;
 }
 
+void GB_set_audio_rendering_disabled(GB_gameboy_t *gb, bool disabled)
+{
+    if (gb->apu_output.disable_rendering == disabled) return;
+    gb->apu_output.disable_rendering = disabled;
+    if (disabled) return;
+    
+    /* Channel outputs went stale while disabled, catch up without emitting the backlog as samples */
+    gb->apu_output.sample_cycles = 0;
+    gb->apu_output.cycles_since_render = 0;
+    gb->apu_output.blep_offset = 0;
+    if (gb->apu_output.sample_rate) {
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            update_sample(gb, i, gb->apu.samples[i], 0);
+        }
+    }
+}
+
 void GB_apu_set_sample_callback(GB_gameboy_t *gb, GB_sample_callback_t callback)
 {
     gb->apu_output.sample_callback = callback;
 }
 
+void GB_apu_output_sample(GB_gameboy_t *gb, GB_sample_t *sample, const GB_sample_t *channels)
+{
+    assert(gb->apu_output.sample_callback || gb->apu_output.sample_buffer);
+    if (gb->apu_output.sample_buffer) {
+        if (gb->apu_output.channel_buffers_callback) {
+            for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+                gb->apu_output.channel_buffers[i][gb->apu_output.sample_buffer_position] =
+                    channels? channels[i] : (GB_sample_t){0, 0};
+            }
+        }
+        gb->apu_output.sample_buffer[gb->apu_output.sample_buffer_position++] = *sample;
+        if (gb->apu_output.sample_buffer_position == gb->apu_output.sample_buffer_size) {
+            GB_apu_flush_samples(gb);
+        }
+    }
+    if (gb->apu_output.sample_callback) {
+        gb->apu_output.sample_callback(gb, sample);
+    }
+}
+
+void GB_apu_flush_samples(GB_gameboy_t *gb)
+{
+    if (!gb->apu_output.sample_buffer_position) return;
+    size_t count = gb->apu_output.sample_buffer_position;
+    gb->apu_output.sample_buffer_position = 0;
+    gb->apu_output.sample_buffer_callback(gb, gb->apu_output.sample_buffer, count);
+    if (gb->apu_output.channel_buffers_callback) {
+        gb->apu_output.channel_buffers_callback(gb, gb->apu_output.channel_buffers, count);
+    }
+}
+
+void GB_apu_set_channel_buffers(GB_gameboy_t *gb, GB_sample_t *const *buffers, GB_channel_buffers_callback_t callback)
+{
+    GB_apu_flush_samples(gb);
+    if (!buffers || !callback) {
+        memset(gb->apu_output.channel_buffers, 0, sizeof(gb->apu_output.channel_buffers));
+        gb->apu_output.channel_buffers_callback = NULL;
+        if (gb->apu_output.channel_blep_buffers) {
+            free(gb->apu_output.channel_blep_buffers);
+            gb->apu_output.channel_blep_buffers = NULL;
+        }
+        return;
+    }
+    
+    if (!gb->apu_output.channel_blep_buffers) {
+        gb->apu_output.channel_blep_buffers = malloc(sizeof(GB_fixed_sample_t) * GB_BLEP_BUFFER_SIZE * GB_N_CHANNELS);
+        if (!gb->apu_output.channel_blep_buffers) return;
+        memset(gb->apu_output.channel_blep_buffers, 0, sizeof(GB_fixed_sample_t) * GB_BLEP_BUFFER_SIZE * GB_N_CHANNELS);
+        /* Start each stream at its channel's current level. Steps from before the capture that the mixed output still
+           has in flight aren't known per channel, so the first BLEP_WIDTH samples may not add up to it exactly. */
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            gb->apu_output.channel_blep_sum[i] = (GB_fixed_sample_t){gb->apu_output.channel_level[i].left << 15,
+                                                                     gb->apu_output.channel_level[i].right << 15};
+        }
+    }
+    for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+        gb->apu_output.channel_buffers[i] = buffers[i];
+    }
+    gb->apu_output.channel_buffers_callback = callback;
+}
+
+void GB_apu_set_sample_buffer(GB_gameboy_t *gb, GB_sample_t *buffer, size_t size, GB_sample_buffer_callback_t callback)
+{
+    GB_apu_flush_samples(gb);
+    if (!buffer || !size || !callback) {
+        buffer = NULL;
+        size = 0;
+        callback = NULL;
+    }
+    gb->apu_output.sample_buffer = buffer;
+    gb->apu_output.sample_buffer_size = size;
+    gb->apu_output.sample_buffer_callback = callback;
+}
+
 void GB_set_highpass_filter_mode(GB_gameboy_t *gb, GB_highpass_mode_t mode)
 {
     gb->apu_output.highpass_mode = mode;
@@ -1061,5 +1294,6 @@ void GB_apu_update_cycles_per_sample(GB_gameboy_t *gb)
     if (gb->apu_output.rate_set_in_clocks) return;
     if (gb->apu_output.sample_rate) {
         gb->apu_output.cycles_per_sample = 2 * GB_get_clock_rate(gb) / (double)gb->apu_output.sample_rate; /* 2 * because we use 8MHz units */
+        gb->apu_output.blep_rate = blep_rate(gb->apu_output.cycles_per_sample); /* Samples per 2MHz tick, 0.32 */
     }
 }
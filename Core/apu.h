@@ -24,6 +24,12 @@
 
 
 
+/* Must be a power of 2 */
+#define GB_BLEP_BUFFER_SIZE 32
+/* Band-limited steps reach their midpoint this many samples after they are added, so the output lags the channels'
+   state by as much. Must be a power of 2. */
+#define GB_BLEP_DELAY 8
+
 /* APU ticks are 2MHz, triggered by an internal APU clock. */
 
 typedef struct
@@ -38,6 +44,12 @@ typedef struct
     double right;
 } GB_double_sample_t;
 
+typedef struct
+{
+    int64_t left;
+    int64_t right;
+} GB_fixed_sample_t;
+
 enum GB_CHANNELS {
     GB_SQUARE_1,
     GB_SQUARE_2,
@@ -47,6 +59,8 @@ enum GB_CHANNELS {
 };
 
 typedef void (*GB_sample_callback_t)(GB_gameboy_t *gb, GB_sample_t *sample);
+typedef void (*GB_sample_buffer_callback_t)(GB_gameboy_t *gb, GB_sample_t *samples, size_t count);
+typedef void (*GB_channel_buffers_callback_t)(GB_gameboy_t *gb, GB_sample_t *const *channels, size_t count);
 
 typedef struct
 {
@@ -138,25 +152,61 @@ typedef struct {
 
     // Samples are NOT normalized to MAX_CH_AMP * 4 at this stage!
     unsigned cycles_since_render;
-    unsigned last_update[GB_N_CHANNELS];
     GB_sample_t current_sample[GB_N_CHANNELS];
-    GB_sample_t summed_samples[GB_N_CHANNELS];
-    double dac_discharge[GB_N_CHANNELS];
+    
+    /* Output is synthesized from band-limited steps whenever a channel's level changes */
+    int32_t channel_multiplier[GB_N_CHANNELS]; // 16.16
+    GB_fixed_sample_t channel_level[GB_N_CHANNELS]; // 24.8
+    GB_fixed_sample_t blep_buffer[GB_BLEP_BUFFER_SIZE];
+    GB_fixed_sample_t blep_sum;
+    unsigned blep_position;
+    uint32_t blep_offset; // How far past its ideal time the last sample was rendered, 16.16 samples
+    uint32_t blep_rate; // Samples per 2MHz tick, 0.32
+    // Mixing is done in fixed point so output is identical on every platform
+    uint32_t dac_discharge[GB_N_CHANNELS]; // 16.16, 0 to 1
+    uint32_t dac_decay_step; // 16.16, per sample
+    uint32_t dac_attack_step; // 16.16, per sample
 
     GB_highpass_mode_t highpass_mode;
-    double highpass_rate;
-    GB_double_sample_t highpass_diff;
+    uint32_t highpass_rate; // 0.32
+    GB_fixed_sample_t highpass_diff; // 48.16
+    GB_fixed_sample_t dc_offset_history[GB_BLEP_DELAY]; // For GB_HIGHPASS_REMOVE_DC_OFFSET, to match the output's lag
     
     GB_sample_callback_t sample_callback;
     
+    GB_sample_t *sample_buffer;
+    size_t sample_buffer_size;
+    size_t sample_buffer_position;
+    GB_sample_buffer_callback_t sample_buffer_callback;
+    
+    GB_sample_t *channel_buffers[GB_N_CHANNELS];
+    GB_channel_buffers_callback_t channel_buffers_callback;
+    GB_fixed_sample_t *channel_blep_buffers; // GB_BLEP_BUFFER_SIZE per channel, only allocated while capturing
+    GB_fixed_sample_t channel_blep_sum[GB_N_CHANNELS];
+    
     bool rate_set_in_clocks;
+    bool disable_rendering;
 } GB_apu_output_t;
 
 void GB_set_sample_rate(GB_gameboy_t *gb, unsigned sample_rate);
 void GB_set_sample_rate_by_clocks(GB_gameboy_t *gb, double cycles_per_sample); /* Cycles are in 8MHz units */
 void GB_set_highpass_filter_mode(GB_gameboy_t *gb, GB_highpass_mode_t mode);
+/* The APU keeps running with exact register, length, sweep and envelope behavior, but no samples are mixed or
+   delivered. Useful for headless runs that never consume audio. */
+void GB_set_audio_rendering_disabled(GB_gameboy_t *gb, bool disabled);
 void GB_apu_set_sample_callback(GB_gameboy_t *gb, GB_sample_callback_t callback);
+/* Samples are collected in buffer and passed to callback in blocks, whenever it's full and at every vblank. Can be
+   used instead of, or together with, the per-sample callback. */
+void GB_apu_set_sample_buffer(GB_gameboy_t *gb, GB_sample_t *buffer, size_t size, GB_sample_buffer_callback_t callback);
+/* Captures each channel separately, before mixing and filtering, alongside the buffered mixed output. buffers is indexed
+   by GB_CHANNELS, and every buffer must be as large as the one passed to GB_apu_set_sample_buffer. callback is called
+   right after the sample buffer callback, with the same count. Pass NULL to stop capturing. Channels are only captured
+   while a sample buffer is set, since they share its position and flushes; the per-sample callback alone is not
+   enough. */
+void GB_apu_set_channel_buffers(GB_gameboy_t *gb, GB_sample_t *const *buffers, GB_channel_buffers_callback_t callback);
 #ifdef GB_INTERNAL
+void GB_apu_output_sample(GB_gameboy_t *gb, GB_sample_t *sample, const GB_sample_t *channels);
+void GB_apu_flush_samples(GB_gameboy_t *gb);
 bool GB_apu_is_DAC_enabled(GB_gameboy_t *gb, unsigned index);
 void GB_apu_write(GB_gameboy_t *gb, uint8_t reg, uint8_t value);
 uint8_t GB_apu_read(GB_gameboy_t *gb, uint8_t reg);
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <math.h>
 #include "gb.h"
 
 typedef struct {
@@ -25,6 +27,42 @@ typedef struct {
 
 #define VALUE_16(x) ((value_t){false, 0, (x)})
 
+/* Expressions are compiled into a postfix program that runs on a small value stack. This is
+   used for both one-shot evaluation and for breakpoint and watchpoint conditions, which are
+   compiled once when set and can then be tested without re-parsing them on every hit. */
+typedef struct {
+    enum {
+        EXPRESSION_LITERAL,
+        EXPRESSION_REG16,
+        EXPRESSION_REG_H,
+        EXPRESSION_REG_L,
+        EXPRESSION_PC,
+        EXPRESSION_OLD,
+        EXPRESSION_NEW,
+        EXPRESSION_READ,
+        EXPRESSION_READ16,
+        EXPRESSION_OPERATOR,
+        EXPRESSION_ASSIGN_REG16,
+        EXPRESSION_ASSIGN_REG_H,
+        EXPRESSION_ASSIGN_REG_L,
+        EXPRESSION_ASSIGN_MEMORY,
+        EXPRESSION_ASSIGN_MEMORY16,
+    } opcode:8;
+    uint8_t operand; /* Register or operator index */
+    value_t value; /* For literals */
+} expression_op_t;
+
+typedef struct {
+    expression_op_t *ops;
+    unsigned n_ops;
+    unsigned stack_size;
+} expression_t;
+
+typedef struct {
+    expression_t expression;
+    char string[];
+} condition_t;
+
 struct GB_breakpoint_s {
     union {
         struct {
@@ -33,7 +71,7 @@ struct GB_breakpoint_s {
         };
         uint32_t key; /* For sorting and comparing */
     };
-    char *condition;
+    condition_t *condition;
     bool is_jump_to;
 };
 
@@ -50,12 +88,52 @@ struct GB_watchpoint_s {
         };
         uint32_t key; /* For sorting and comparing */
     };
-    char *condition;
+    condition_t *condition;
     uint8_t flags;
+    uint16_t end; /* Last watched address, equals addr for single address watchpoints */
+    uint16_t max_end; /* Highest end of this and all preceding watchpoints in the same bank */
 };
 
 #define WP_KEY(x) (((struct GB_watchpoint_s){.addr = ((x).value), .bank = (x).has_bank? (x).bank : -1 }).key)
 
+/* The address maps are checked before the sorted breakpoint and watchpoint arrays, so that
+   addresses without any breakpoint or watchpoint (in any bank) skip the binary searches. */
+#define MAP_TEST(map, addr) ((map)[(uint16_t)(addr) >> 3] & (1 << ((addr) & 7)))
+#define MAP_SET(map, addr) ((map)[(uint16_t)(addr) >> 3] |= (1 << ((addr) & 7)))
+
+static void update_breakpoint_map(GB_gameboy_t *gb)
+{
+    memset(gb->breakpoint_map, 0, sizeof(gb->breakpoint_map));
+    for (unsigned i = 0; i < gb->n_breakpoints; i++) {
+        MAP_SET(gb->breakpoint_map, gb->breakpoints[i].addr);
+    }
+}
+
+/* Watchpoints are sorted by bank and start address, and each one also tracks the highest end
+   address seen so far in its bank. Together they form an augmented interval list: the
+   watchpoints covering an address are found by scanning back from the last one starting at or
+   before it, stopping as soon as max_end falls below the address. */
+static void update_watchpoint_maps(GB_gameboy_t *gb)
+{
+    memset(gb->read_watchpoint_map, 0, sizeof(gb->read_watchpoint_map));
+    memset(gb->write_watchpoint_map, 0, sizeof(gb->write_watchpoint_map));
+    for (unsigned i = 0; i < gb->n_watchpoints; i++) {
+        struct GB_watchpoint_s *watchpoint = &gb->watchpoints[i];
+        watchpoint->max_end = watchpoint->end;
+        if (i && watchpoint[-1].bank == watchpoint->bank && watchpoint[-1].max_end > watchpoint->end) {
+            watchpoint->max_end = watchpoint[-1].max_end;
+        }
+        for (unsigned addr = watchpoint->addr; addr <= watchpoint->end; addr++) {
+            if (watchpoint->flags & GB_WATCHPOINT_R) {
+                MAP_SET(gb->read_watchpoint_map, addr);
+            }
+            if (watchpoint->flags & GB_WATCHPOINT_W) {
+                MAP_SET(gb->write_watchpoint_map, addr);
+            }
+        }
+    }
+}
+
 static uint16_t bank_for_addr(GB_gameboy_t *gb, uint16_t addr)
 {
     if (addr < 0x4000) {
@@ -365,15 +443,27 @@ static struct {
     {":", 4, bank},
 };
 
-value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
-                           size_t length, bool *error,
-                           uint16_t *watchpoint_address, uint8_t *watchpoint_new_value);
+#define EXPRESSION_REGISTER_PC 0xFF
+
+static void emit_op(expression_t *expression, unsigned *stack_depth, expression_op_t op, signed stack_change)
+{
+    /* Capacity grows in powers of two, starting at 8 */
+    if (expression->n_ops == 0 || (expression->n_ops >= 8 && (expression->n_ops & (expression->n_ops - 1)) == 0)) {
+        expression->ops = realloc(expression->ops, (expression->n_ops? expression->n_ops * 2 : 8) * sizeof(expression->ops[0]));
+    }
+    expression->ops[expression->n_ops++] = op;
+    *stack_depth += stack_change;
+    if (*stack_depth > expression->stack_size) {
+        expression->stack_size = *stack_depth;
+    }
+}
 
-static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
-                                         size_t length, bool *error,
-                                         uint16_t *watchpoint_address, uint8_t *watchpoint_new_value)
+static bool compile_expression(GB_gameboy_t *gb, expression_t *expression, unsigned *stack_depth,
+                               const char *string, size_t length, bool watchpoint);
+
+static bool compile_lvalue(GB_gameboy_t *gb, expression_t *expression, unsigned *stack_depth,
+                           const char *string, size_t length, bool watchpoint, expression_op_t *store)
 {
-    *error = false;
     // Strip whitespace
     while (length && (string[0] == ' ' || string[0] == '\n' || string[0] == '\r' || string[0] == '\t')) {
         string++;
@@ -382,10 +472,9 @@ static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
     while (length && (string[length-1] == ' ' || string[length-1] == '\n' || string[length-1] == '\r' || string[length-1] == '\t')) {
         length--;
     }
-    if (length == 0) { 
+    if (length == 0) {
         GB_log(gb, "Expected expression.\n");
-        *error = true;
-        return (lvalue_t){0,};
+        return false;
     }
     if (string[0] == '(' && string[length - 1] == ')') {
         // Attempt to strip parentheses
@@ -399,7 +488,7 @@ static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
             }
             if (string[i] == ')') depth--;
         }
-        if (depth == 0) return debugger_evaluate_lvalue(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value);
+        if (depth == 0) return compile_lvalue(gb, expression, stack_depth, string + 1, length - 2, watchpoint, store);
     }
     else if (string[0] == '[' && string[length - 1] == ']') {
         // Attempt to strip square parentheses (memory dereference)
@@ -414,7 +503,8 @@ static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
             if (string[i] == ']') depth--;
         }
         if (depth == 0) {
-            return (lvalue_t){LVALUE_MEMORY, .memory_address = debugger_evaluate(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value)};
+            *store = (expression_op_t){EXPRESSION_ASSIGN_MEMORY};
+            return compile_expression(gb, expression, stack_depth, string + 1, length - 2, watchpoint);
         }
     }
     else if (string[0] == '{' && string[length - 1] == '}') {
@@ -430,7 +520,8 @@ static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
             if (string[i] == '}') depth--;
         }
         if (depth == 0) {
-            return (lvalue_t){LVALUE_MEMORY16, .memory_address = debugger_evaluate(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value)};
+            *store = (expression_op_t){EXPRESSION_ASSIGN_MEMORY16};
+            return compile_expression(gb, expression, stack_depth, string + 1, length - 2, watchpoint);
         }
     }
 
@@ -438,48 +529,37 @@ static lvalue_t debugger_evaluate_lvalue(GB_gameboy_t *gb, const char *string,
     if (string[0] != '$' && (string[0] < '0' || string[0] > '9')) {
         if (length == 1) {
             switch (string[0]) {
-                case 'a': return (lvalue_t){LVALUE_REG_H, .register_address = &gb->registers[GB_REGISTER_AF]};
-                case 'f': return (lvalue_t){LVALUE_REG_L, .register_address = &gb->registers[GB_REGISTER_AF]};
-                case 'b': return (lvalue_t){LVALUE_REG_H, .register_address = &gb->registers[GB_REGISTER_BC]};
-                case 'c': return (lvalue_t){LVALUE_REG_L, .register_address = &gb->registers[GB_REGISTER_BC]};
-                case 'd': return (lvalue_t){LVALUE_REG_H, .register_address = &gb->registers[GB_REGISTER_DE]};
-                case 'e': return (lvalue_t){LVALUE_REG_L, .register_address = &gb->registers[GB_REGISTER_DE]};
-                case 'h': return (lvalue_t){LVALUE_REG_H, .register_address = &gb->registers[GB_REGISTER_HL]};
-                case 'l': return (lvalue_t){LVALUE_REG_L, .register_address = &gb->registers[GB_REGISTER_HL]};
+                case 'a': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_H, GB_REGISTER_AF}; return true;
+                case 'f': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_L, GB_REGISTER_AF}; return true;
+                case 'b': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_H, GB_REGISTER_BC}; return true;
+                case 'c': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_L, GB_REGISTER_BC}; return true;
+                case 'd': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_H, GB_REGISTER_DE}; return true;
+                case 'e': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_L, GB_REGISTER_DE}; return true;
+                case 'h': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_H, GB_REGISTER_HL}; return true;
+                case 'l': *store = (expression_op_t){EXPRESSION_ASSIGN_REG_L, GB_REGISTER_HL}; return true;
             }
         }
         else if (length == 2) {
             switch (string[0]) {
-                case 'a': if (string[1] == 'f') return (lvalue_t){LVALUE_REG16, .register_address = &gb->registers[GB_REGISTER_AF]};
-                case 'b': if (string[1] == 'c') return (lvalue_t){LVALUE_REG16, .register_address = &gb->registers[GB_REGISTER_BC]};
-                case 'd': if (string[1] == 'e') return (lvalue_t){LVALUE_REG16, .register_address = &gb->registers[GB_REGISTER_DE]};
-                case 'h': if (string[1] == 'l') return (lvalue_t){LVALUE_REG16, .register_address = &gb->registers[GB_REGISTER_HL]};
-                case 's': if (string[1] == 'p') return (lvalue_t){LVALUE_REG16, .register_address = &gb->registers[GB_REGISTER_SP]};
-                case 'p': if (string[1] == 'c') return (lvalue_t){LVALUE_REG16, .register_address = &gb->pc};
+                case 'a': if (string[1] == 'f') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, GB_REGISTER_AF}; return true;}
+                case 'b': if (string[1] == 'c') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, GB_REGISTER_BC}; return true;}
+                case 'd': if (string[1] == 'e') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, GB_REGISTER_DE}; return true;}
+                case 'h': if (string[1] == 'l') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, GB_REGISTER_HL}; return true;}
+                case 's': if (string[1] == 'p') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, GB_REGISTER_SP}; return true;}
+                case 'p': if (string[1] == 'c') {*store = (expression_op_t){EXPRESSION_ASSIGN_REG16, EXPRESSION_REGISTER_PC}; return true;}
             }
         }
         GB_log(gb, "Unknown register: %.*s\n", (unsigned) length, string);
-        *error = true;
-        return (lvalue_t){0,};
+        return false;
     }
 
     GB_log(gb, "Expression is not an lvalue: %.*s\n", (unsigned) length, string);
-    *error = true;
-    return (lvalue_t){0,};
+    return false;
 }
 
-#define ERROR ((value_t){0,})
-value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
-                          size_t length, bool *error,
-                          uint16_t *watchpoint_address, uint8_t *watchpoint_new_value)
+static bool compile_expression(GB_gameboy_t *gb, expression_t *expression, unsigned *stack_depth,
+                               const char *string, size_t length, bool watchpoint)
 {
-    /* Disable watchpoints while evaluating expressions */
-    uint16_t n_watchpoints = gb->n_watchpoints;
-    gb->n_watchpoints = 0;
-
-    value_t ret = ERROR;
-
-    *error = false;
     // Strip whitespace
     while (length && (string[0] == ' ' || string[0] == '\n' || string[0] == '\r' || string[0] == '\t')) {
         string++;
@@ -488,10 +568,9 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
     while (length && (string[length-1] == ' ' || string[length-1] == '\n' || string[length-1] == '\r' || string[length-1] == '\t')) {
         length--;
     }
-    if (length == 0) { 
+    if (length == 0) {
         GB_log(gb, "Expected expression.\n");
-        *error = true;
-        goto exit;
+        return false;
     }
     if (string[0] == '(' && string[length - 1] == ')') {
         // Attempt to strip parentheses
@@ -506,8 +585,7 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
             if (string[i] == ')') depth--;
         }
         if (depth == 0) {
-            ret = debugger_evaluate(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value);
-            goto exit;
+            return compile_expression(gb, expression, stack_depth, string + 1, length - 2, watchpoint);
         }
     }
     else if (string[0] == '[' && string[length - 1] == ']') {
@@ -524,17 +602,9 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
         }
 
         if (depth == 0) {
-            value_t addr = debugger_evaluate(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value);
-            banking_state_t state;
-            if (addr.bank) {
-                save_banking_state(gb, &state);
-                switch_banking_state(gb, addr.bank);
-            }
-            ret = VALUE_16(GB_read_memory(gb, addr.value));
-            if (addr.bank) {
-                restore_banking_state(gb, &state);
-            }
-            goto exit;
+            if (!compile_expression(gb, expression, stack_depth, string + 1, length - 2, watchpoint)) return false;
+            emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_READ}, 0);
+            return true;
         }
     }
     else if (string[0] == '{' && string[length - 1] == '}') {
@@ -551,33 +621,25 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
         }
 
         if (depth == 0) {
-            value_t addr = debugger_evaluate(gb, string + 1, length - 2, error, watchpoint_address, watchpoint_new_value);
-            banking_state_t state;
-            if (addr.bank) {
-                save_banking_state(gb, &state);
-                switch_banking_state(gb, addr.bank);
-            }
-            ret = VALUE_16(GB_read_memory(gb, addr.value) | (GB_read_memory(gb, addr.value + 1) * 0x100));
-            if (addr.bank) {
-                restore_banking_state(gb, &state);
-            }
-            goto exit;
+            if (!compile_expression(gb, expression, stack_depth, string + 1, length - 2, watchpoint)) return false;
+            emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_READ16}, 0);
+            return true;
         }
     }
     // Search for lowest priority operator
-    signed depth = 0;
+    signed nesting = 0;
     unsigned operator_index = -1;
     unsigned operator_pos = 0;
     for (unsigned i = 0; i < length; i++) {
-        if (string[i] == '(') depth++;
-        else if (string[i] == ')') depth--;
-        else if (string[i] == '[') depth++;
-        else if (string[i] == ']') depth--;
-        else if (depth == 0) {
+        if (string[i] == '(') nesting++;
+        else if (string[i] == ')') nesting--;
+        else if (string[i] == '[') nesting++;
+        else if (string[i] == ']') nesting--;
+        else if (nesting == 0) {
             for (unsigned j = 0; j < sizeof(operators) / sizeof(operators[0]); j++) {
                 unsigned operator_length = strlen(operators[j].string);
                 if (operator_length > length - i) continue; // Operator too long
-                
+
                 if (memcmp(string + i, operators[j].string, operator_length) == 0) {
                     if (operator_index != -1 && operators[operator_index].priority < operators[j].priority) {
                         /* for supporting = vs ==, etc*/
@@ -595,19 +657,20 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
         }
     }
     if (operator_index != -1) {
+        /* The right operand is evaluated first, matching the order side effects always had */
         unsigned right_start = (unsigned)(operator_pos + strlen(operators[operator_index].string));
-        value_t right = debugger_evaluate(gb, string + right_start, length - right_start, error, watchpoint_address, watchpoint_new_value);
-        if (*error) goto exit;
+        if (!compile_expression(gb, expression, stack_depth, string + right_start, length - right_start, watchpoint)) return false;
         if (operators[operator_index].lvalue_operator) {
-            lvalue_t left = debugger_evaluate_lvalue(gb, string, operator_pos, error, watchpoint_address, watchpoint_new_value);
-            if (*error) goto exit;
-            ret = operators[operator_index].lvalue_operator(gb, left, right.value);
-            goto exit;
+            expression_op_t store;
+            unsigned n_ops = expression->n_ops;
+            if (!compile_lvalue(gb, expression, stack_depth, string, operator_pos, watchpoint, &store)) return false;
+            /* Memory stores also pop the address the lvalue pushed */
+            emit_op(expression, stack_depth, store, expression->n_ops == n_ops? 0 : -1);
+            return true;
         }
-        value_t left = debugger_evaluate(gb, string, operator_pos, error, watchpoint_address, watchpoint_new_value);
-        if (*error) goto exit;
-        ret = operators[operator_index].operator(left, right);
-        goto exit;
+        if (!compile_expression(gb, expression, stack_depth, string, operator_pos, watchpoint)) return false;
+        emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_OPERATOR, operator_index}, -1);
+        return true;
     }
 
     // Not an expression - must be a register or a literal
@@ -616,41 +679,36 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
     if (string[0] != '$' && (string[0] < '0' || string[0] > '9')) {
         if (length == 1) {
             switch (string[0]) {
-                case 'a': ret = VALUE_16(gb->registers[GB_REGISTER_AF] >> 8); goto exit;
-                case 'f': ret = VALUE_16(gb->registers[GB_REGISTER_AF] & 0xFF); goto exit;
-                case 'b': ret = VALUE_16(gb->registers[GB_REGISTER_BC] >> 8); goto exit;
-                case 'c': ret = VALUE_16(gb->registers[GB_REGISTER_BC] & 0xFF); goto exit;
-                case 'd': ret = VALUE_16(gb->registers[GB_REGISTER_DE] >> 8); goto exit;
-                case 'e': ret = VALUE_16(gb->registers[GB_REGISTER_DE] & 0xFF); goto exit;
-                case 'h': ret = VALUE_16(gb->registers[GB_REGISTER_HL] >> 8); goto exit;
-                case 'l': ret = VALUE_16(gb->registers[GB_REGISTER_HL] & 0xFF); goto exit;
+                case 'a': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_H, GB_REGISTER_AF}, 1); return true;
+                case 'f': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_L, GB_REGISTER_AF}, 1); return true;
+                case 'b': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_H, GB_REGISTER_BC}, 1); return true;
+                case 'c': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_L, GB_REGISTER_BC}, 1); return true;
+                case 'd': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_H, GB_REGISTER_DE}, 1); return true;
+                case 'e': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_L, GB_REGISTER_DE}, 1); return true;
+                case 'h': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_H, GB_REGISTER_HL}, 1); return true;
+                case 'l': emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG_L, GB_REGISTER_HL}, 1); return true;
             }
         }
         else if (length == 2) {
             switch (string[0]) {
-                case 'a': if (string[1] == 'f') {ret = VALUE_16(gb->registers[GB_REGISTER_AF]); goto exit;}
-                case 'b': if (string[1] == 'c') {ret = VALUE_16(gb->registers[GB_REGISTER_BC]); goto exit;}
-                case 'd': if (string[1] == 'e') {ret = VALUE_16(gb->registers[GB_REGISTER_DE]); goto exit;}
-                case 'h': if (string[1] == 'l') {ret = VALUE_16(gb->registers[GB_REGISTER_HL]); goto exit;}
-                case 's': if (string[1] == 'p') {ret = VALUE_16(gb->registers[GB_REGISTER_SP]); goto exit;}
-                case 'p': if (string[1] == 'c') {ret = (value_t){true, bank_for_addr(gb, gb->pc), gb->pc};  goto exit;}
+                case 'a': if (string[1] == 'f') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG16, GB_REGISTER_AF}, 1); return true;}
+                case 'b': if (string[1] == 'c') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG16, GB_REGISTER_BC}, 1); return true;}
+                case 'd': if (string[1] == 'e') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG16, GB_REGISTER_DE}, 1); return true;}
+                case 'h': if (string[1] == 'l') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG16, GB_REGISTER_HL}, 1); return true;}
+                case 's': if (string[1] == 'p') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_REG16, GB_REGISTER_SP}, 1); return true;}
+                case 'p': if (string[1] == 'c') {emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_PC}, 1); return true;}
             }
         }
-        else if (length == 3) {
-            if (watchpoint_address && memcmp(string, "old", 3) == 0) {
-                ret = VALUE_16(GB_read_memory(gb, *watchpoint_address));
-                goto exit;
-            }
-
-            if (watchpoint_new_value && memcmp(string, "new", 3) == 0) {
-                ret = VALUE_16(*watchpoint_new_value);
-                goto exit;
+        else if (length == 3 && watchpoint) {
+            if (memcmp(string, "old", 3) == 0) {
+                emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_OLD}, 1);
+                return true;
             }
 
             /* $new is identical to $old in read conditions */
-            if (watchpoint_address && memcmp(string, "new", 3) == 0) {
-                ret = VALUE_16(GB_read_memory(gb, *watchpoint_address));
-                goto exit;
+            if (memcmp(string, "new", 3) == 0) {
+                emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_NEW}, 1);
+                return true;
             }
         }
 
@@ -659,13 +717,12 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
         symbol_name[length] = 0;
         const GB_symbol_t *symbol = GB_reversed_map_find_symbol(&gb->reversed_symbol_map, symbol_name);
         if (symbol) {
-            ret = (value_t){true, symbol->bank, symbol->addr};
-            goto exit;
+            emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_LITERAL, .value = {true, symbol->bank, symbol->addr}}, 1);
+            return true;
         }
 
         GB_log(gb, "Unknown register or symbol: %.*s\n", (unsigned) length, string);
-        *error = true;
-        goto exit;
+        return false;
     }
 
     char *end;
@@ -678,15 +735,144 @@ value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
     uint16_t literal = (uint16_t) (strtol(string, &end, base));
     if (end != string + length) {
         GB_log(gb, "Failed to parse: %.*s\n", (unsigned) length, string);
-        *error = true;
-        goto exit;
+        return false;
+    }
+    emit_op(expression, stack_depth, (expression_op_t){EXPRESSION_LITERAL, .value = VALUE_16(literal)}, 1);
+    return true;
+}
+
+/* watchpoint makes $old and $new legal */
+static bool compile(GB_gameboy_t *gb, expression_t *expression, const char *string, size_t length, bool watchpoint)
+{
+    unsigned depth = 0;
+    *expression = (expression_t){0,};
+    if (!compile_expression(gb, expression, &depth, string, length, watchpoint)) {
+        free(expression->ops);
+        *expression = (expression_t){0,};
+        return false;
+    }
+    return true;
+}
+
+static uint16_t *expression_register(GB_gameboy_t *gb, uint8_t index)
+{
+    if (index == EXPRESSION_REGISTER_PC) return &gb->pc;
+    return &gb->registers[index];
+}
+
+static value_t run_expression(GB_gameboy_t *gb, const expression_t *expression,
+                              uint16_t *watchpoint_address, uint8_t *watchpoint_new_value)
+{
+    /* Disable watchpoints and the heatmap while evaluating expressions */
+    uint16_t n_watchpoints = gb->n_watchpoints;
+    gb->n_watchpoints = 0;
+    GB_heatmap_t *heatmap = GB_debugger_heatmap_suspend(gb);
+
+    value_t stack[expression->stack_size];
+    value_t *top = stack - 1;
+
+    for (const expression_op_t *op = expression->ops, *end = op + expression->n_ops; op < end; op++) {
+        switch (op->opcode) {
+            case EXPRESSION_LITERAL:
+                *++top = op->value;
+                break;
+            case EXPRESSION_REG16:
+                *++top = VALUE_16(gb->registers[op->operand]);
+                break;
+            case EXPRESSION_REG_H:
+                *++top = VALUE_16(gb->registers[op->operand] >> 8);
+                break;
+            case EXPRESSION_REG_L:
+                *++top = VALUE_16(gb->registers[op->operand] & 0xFF);
+                break;
+            case EXPRESSION_PC:
+                *++top = (value_t){true, bank_for_addr(gb, gb->pc), gb->pc};
+                break;
+            case EXPRESSION_OLD:
+                *++top = VALUE_16(GB_read_memory(gb, *watchpoint_address));
+                break;
+            case EXPRESSION_NEW:
+                *++top = VALUE_16(watchpoint_new_value? *watchpoint_new_value : GB_read_memory(gb, *watchpoint_address));
+                break;
+            case EXPRESSION_READ:
+            case EXPRESSION_READ16: {
+                value_t addr = *top;
+                banking_state_t state = {0,}; // Only used if addr.bank is set, but GCC can't tell
+                if (addr.bank) {
+                    save_banking_state(gb, &state);
+                    switch_banking_state(gb, addr.bank);
+                }
+                *top = VALUE_16(GB_read_memory(gb, addr.value));
+                if (op->opcode == EXPRESSION_READ16) {
+                    top->value |= GB_read_memory(gb, addr.value + 1) * 0x100;
+                }
+                if (addr.bank) {
+                    restore_banking_state(gb, &state);
+                }
+                break;
+            }
+            case EXPRESSION_OPERATOR:
+                top[-1] = operators[op->operand].operator(top[0], top[-1]);
+                top--;
+                break;
+            case EXPRESSION_ASSIGN_REG16:
+                *top = assign(gb, (lvalue_t){LVALUE_REG16, .register_address = expression_register(gb, op->operand)}, top->value);
+                break;
+            case EXPRESSION_ASSIGN_REG_H:
+                *top = assign(gb, (lvalue_t){LVALUE_REG_H, .register_address = expression_register(gb, op->operand)}, top->value);
+                break;
+            case EXPRESSION_ASSIGN_REG_L:
+                *top = assign(gb, (lvalue_t){LVALUE_REG_L, .register_address = expression_register(gb, op->operand)}, top->value);
+                break;
+            case EXPRESSION_ASSIGN_MEMORY:
+                top[-1] = assign(gb, (lvalue_t){LVALUE_MEMORY, .memory_address = top[0]}, top[-1].value);
+                top--;
+                break;
+            case EXPRESSION_ASSIGN_MEMORY16:
+                top[-1] = assign(gb, (lvalue_t){LVALUE_MEMORY16, .memory_address = top[0]}, top[-1].value);
+                top--;
+                break;
+        }
     }
-    ret = VALUE_16(literal);
-exit:
+
     gb->n_watchpoints = n_watchpoints;
+    GB_debugger_heatmap_resume(gb, heatmap);
+    return *top;
+}
+
+#define ERROR ((value_t){0,})
+value_t debugger_evaluate(GB_gameboy_t *gb, const char *string,
+                          size_t length, bool *error,
+                          uint16_t *watchpoint_address, uint8_t *watchpoint_new_value)
+{
+    expression_t expression;
+    *error = !compile(gb, &expression, string, length, watchpoint_address != NULL);
+    if (*error) return ERROR;
+
+    value_t ret = run_expression(gb, &expression, watchpoint_address, watchpoint_new_value);
+    free(expression.ops);
     return ret;
 }
 
+static condition_t *compile_condition(GB_gameboy_t *gb, const char *string, bool watchpoint)
+{
+    size_t length = strlen(string);
+    expression_t expression;
+    if (!compile(gb, &expression, string, length, watchpoint)) return NULL;
+
+    condition_t *condition = malloc(sizeof(*condition) + length + 1);
+    condition->expression = expression;
+    memcpy(condition->string, string, length + 1);
+    return condition;
+}
+
+static void free_condition(condition_t *condition)
+{
+    if (!condition) return;
+    free(condition->expression.ops);
+    free(condition);
+}
+
 struct debugger_command_s;
 typedef bool debugger_command_imp_t(GB_gameboy_t *gb, char *arguments, char *modifiers, const struct debugger_command_s *command);
 typedef char *debugger_completer_imp_t(GB_gameboy_t *gb, const char *string, uintptr_t *context);
@@ -969,54 +1155,48 @@ static bool breakpoint(GB_gameboy_t *gb, char *arguments, char *modifiers, const
         return true;
     }
 
-    char *condition = NULL;
-    if ((condition = strstr(arguments, " if "))) {
-        *condition = 0;
-        condition += strlen(" if ");
-        /* Verify condition is sane (Todo: This might have side effects!) */
-        bool error;
-        debugger_evaluate(gb, condition, (unsigned)strlen(condition), &error, NULL, NULL);
-        if (error) return true;
-
+    char *condition_string = NULL;
+    condition_t *condition = NULL;
+    if ((condition_string = strstr(arguments, " if "))) {
+        *condition_string = 0;
+        condition_string += strlen(" if ");
+        /* Compiling the condition also verifies it is sane, without evaluating it */
+        condition = compile_condition(gb, condition_string, false);
+        if (!condition) return true;
     }
 
     bool error;
     value_t result = debugger_evaluate(gb, arguments, (unsigned)strlen(arguments), &error, NULL, NULL);
     uint32_t key = BP_KEY(result);
 
-    if (error) return true;
+    if (error) {
+        free_condition(condition);
+        return true;
+    }
 
     uint16_t index = find_breakpoint(gb, result);
     if (index < gb->n_breakpoints && gb->breakpoints[index].key == key) {
         GB_log(gb, "Breakpoint already set at %s\n", debugger_value_to_string(gb, result, true));
         if (!gb->breakpoints[index].condition && condition) {
             GB_log(gb, "Added condition to breakpoint\n");
-            gb->breakpoints[index].condition = strdup(condition);
         }
         else if (gb->breakpoints[index].condition && condition) {
             GB_log(gb, "Replaced breakpoint condition\n");
-            free(gb->breakpoints[index].condition);
-            gb->breakpoints[index].condition = strdup(condition);
         }
         else if (gb->breakpoints[index].condition && !condition) {
             GB_log(gb, "Removed breakpoint condition\n");
-            free(gb->breakpoints[index].condition);
-            gb->breakpoints[index].condition = NULL;
         }
+        free_condition(gb->breakpoints[index].condition);
+        gb->breakpoints[index].condition = condition;
         return true;
     }
 
     gb->breakpoints = realloc(gb->breakpoints, (gb->n_breakpoints + 1) * sizeof(gb->breakpoints[0]));
     memmove(&gb->breakpoints[index + 1], &gb->breakpoints[index], (gb->n_breakpoints - index) * sizeof(gb->breakpoints[0]));
     gb->breakpoints[index].key = key;
-
-    if (condition) {
-        gb->breakpoints[index].condition = strdup(condition);
-    }
-    else {
-        gb->breakpoints[index].condition = NULL;
-    }
+    gb->breakpoints[index].condition = condition;
     gb->n_breakpoints++;
+    MAP_SET(gb->breakpoint_map, result.value);
 
     gb->breakpoints[index].is_jump_to = is_jump_to;
 
@@ -1033,13 +1213,12 @@ static bool delete(GB_gameboy_t *gb, char *arguments, char *modifiers, const deb
     NO_MODIFIERS
     if (strlen(lstrip(arguments)) == 0) {
         for (unsigned i = gb->n_breakpoints; i--;) {
-            if (gb->breakpoints[i].condition) {
-                free(gb->breakpoints[i].condition);
-            }
+            free_condition(gb->breakpoints[i].condition);
         }
         free(gb->breakpoints);
         gb->breakpoints = NULL;
         gb->n_breakpoints = 0;
+        update_breakpoint_map(gb);
         return true;
     }
 
@@ -1070,9 +1249,7 @@ static bool delete(GB_gameboy_t *gb, char *arguments, char *modifiers, const deb
     result.bank = gb->breakpoints[index].bank;
     result.has_bank = gb->breakpoints[index].bank != (uint16_t) -1;
 
-    if (gb->breakpoints[index].condition) {
-        free(gb->breakpoints[index].condition);
-    }
+    free_condition(gb->breakpoints[index].condition);
 
     if (gb->breakpoints[index].is_jump_to) {
         gb->has_jump_to_breakpoints = false;
@@ -1088,6 +1265,7 @@ static bool delete(GB_gameboy_t *gb, char *arguments, char *modifiers, const deb
     memmove(&gb->breakpoints[index], &gb->breakpoints[index + 1], (gb->n_breakpoints - index - 1) * sizeof(gb->breakpoints[0]));
     gb->n_breakpoints--;
     gb->breakpoints = realloc(gb->breakpoints, gb->n_breakpoints * sizeof(gb->breakpoints[0]));
+    update_breakpoint_map(gb);
 
     GB_log(gb, "Breakpoint removed from %s\n", debugger_value_to_string(gb, result, true));
     return true;
@@ -1164,25 +1342,44 @@ print_usage:
         goto print_usage;
     }
 
-    char *condition = NULL;
-    if ((condition = strstr(arguments, " if "))) {
-        *condition = 0;
-        condition += strlen(" if ");
-        /* Verify condition is sane (Todo: This might have side effects!) */
-        bool error;
-        /* To make $new and $old legal */
-        uint16_t dummy = 0;
-        uint8_t dummy2 = 0;
-        debugger_evaluate(gb, condition, (unsigned)strlen(condition), &error, &dummy, &dummy2);
-        if (error) return true;
+    char *condition_string = NULL;
+    condition_t *condition = NULL;
+    if ((condition_string = strstr(arguments, " if "))) {
+        *condition_string = 0;
+        condition_string += strlen(" if ");
+        /* Compiling the condition also verifies it is sane, without evaluating it */
+        condition = compile_condition(gb, condition_string, true);
+        if (!condition) return true;
+    }
 
+    char *end_string = NULL;
+    if ((end_string = strstr(arguments, " to "))) {
+        *end_string = 0;
+        end_string += strlen(" to ");
     }
 
     bool error;
     value_t result = debugger_evaluate(gb, arguments, (unsigned)strlen(arguments), &error, NULL, NULL);
     uint32_t key = WP_KEY(result);
 
-    if (error) return true;
+    if (error) {
+        free_condition(condition);
+        return true;
+    }
+
+    uint16_t end = result.value;
+    if (end_string) {
+        end = debugger_evaluate(gb, end_string, (unsigned)strlen(end_string), &error, NULL, NULL).value;
+        if (error) {
+            free_condition(condition);
+            return true;
+        }
+        if (end < result.value) {
+            GB_log(gb, "Watchpoint range ends before it starts\n");
+            free_condition(condition);
+            return true;
+        }
+    }
 
     uint16_t index = find_watchpoint(gb, result);
     if (index < gb->n_watchpoints && gb->watchpoints[index].key == key) {
@@ -1190,21 +1387,25 @@ print_usage:
         if (gb->watchpoints[index].flags != flags) {
             GB_log(gb, "Modified watchpoint type\n");
             gb->watchpoints[index].flags = flags;
+            update_watchpoint_maps(gb);
+        }
+        /* Without an explicit end, the existing range is kept */
+        if (end_string && gb->watchpoints[index].end != end) {
+            GB_log(gb, "Modified watchpoint range\n");
+            gb->watchpoints[index].end = end;
+            update_watchpoint_maps(gb);
         }
         if (!gb->watchpoints[index].condition && condition) {
             GB_log(gb, "Added condition to watchpoint\n");
-            gb->watchpoints[index].condition = strdup(condition);
         }
         else if (gb->watchpoints[index].condition && condition) {
             GB_log(gb, "Replaced watchpoint condition\n");
-            free(gb->watchpoints[index].condition);
-            gb->watchpoints[index].condition = strdup(condition);
         }
         else if (gb->watchpoints[index].condition && !condition) {
             GB_log(gb, "Removed watchpoint condition\n");
-            free(gb->watchpoints[index].condition);
-            gb->watchpoints[index].condition = NULL;
         }
+        free_condition(gb->watchpoints[index].condition);
+        gb->watchpoints[index].condition = condition;
         return true;
     }
 
@@ -1212,15 +1413,17 @@ print_usage:
     memmove(&gb->watchpoints[index + 1], &gb->watchpoints[index], (gb->n_watchpoints - index) * sizeof(gb->watchpoints[0]));
     gb->watchpoints[index].key = key;
     gb->watchpoints[index].flags = flags;
-    if (condition) {
-        gb->watchpoints[index].condition = strdup(condition);
+    gb->watchpoints[index].end = end;
+    gb->watchpoints[index].condition = condition;
+    gb->n_watchpoints++;
+    update_watchpoint_maps(gb);
+
+    if (end != result.value) {
+        GB_log(gb, "Watchpoint set at %s to $%04x\n", debugger_value_to_string(gb, result, true), end);
     }
     else {
-        gb->watchpoints[index].condition = NULL;
+        GB_log(gb, "Watchpoint set at %s\n", debugger_value_to_string(gb, result, true));
     }
-    gb->n_watchpoints++;
-
-    GB_log(gb, "Watchpoint set at %s\n", debugger_value_to_string(gb, result, true));
     return true;
 }
 
@@ -1229,13 +1432,12 @@ static bool unwatch(GB_gameboy_t *gb, char *arguments, char *modifiers, const de
     NO_MODIFIERS
     if (strlen(lstrip(arguments)) == 0) {
         for (unsigned i = gb->n_watchpoints; i--;) {
-            if (gb->watchpoints[i].condition) {
-                free(gb->watchpoints[i].condition);
-            }
+            free_condition(gb->watchpoints[i].condition);
         }
         free(gb->watchpoints);
         gb->watchpoints = NULL;
         gb->n_watchpoints = 0;
+        update_watchpoint_maps(gb);
         return true;
     }
 
@@ -1266,13 +1468,12 @@ static bool unwatch(GB_gameboy_t *gb, char *arguments, char *modifiers, const de
     result.bank = gb->watchpoints[index].bank;
     result.has_bank = gb->watchpoints[index].bank != (uint16_t) -1;
 
-    if (gb->watchpoints[index].condition) {
-        free(gb->watchpoints[index].condition);
-    }
+    free_condition(gb->watchpoints[index].condition);
 
     memmove(&gb->watchpoints[index], &gb->watchpoints[index + 1], (gb->n_watchpoints - index - 1) * sizeof(gb->watchpoints[0]));
     gb->n_watchpoints--;
     gb->watchpoints = realloc(gb->watchpoints, gb->n_watchpoints *sizeof(gb->watchpoints[0]));
+    update_watchpoint_maps(gb);
 
     GB_log(gb, "Watchpoint removed from %s\n", debugger_value_to_string(gb, result, true));
     return true;
@@ -1297,7 +1498,7 @@ static bool list(GB_gameboy_t *gb, char *arguments, char *modifiers, const debug
                 GB_log(gb, " %d. %s (%sCondition: %s)\n", i + 1,
                                                         debugger_value_to_string(gb, addr, addr.has_bank),
                                                         gb->breakpoints[i].is_jump_to? "Jump to, ": "",
-                                                        gb->breakpoints[i].condition);
+                                                        gb->breakpoints[i].condition->string);
             }
             else {
                 GB_log(gb, " %d. %s%s\n", i + 1,
@@ -1314,14 +1515,18 @@ static bool list(GB_gameboy_t *gb, char *arguments, char *modifiers, const debug
         GB_log(gb, "%d watchpoint(s) set:\n", gb->n_watchpoints);
         for (uint16_t i = 0; i < gb->n_watchpoints; i++) {
             value_t addr = (value_t){gb->watchpoints[i].bank != (uint16_t)-1, gb->watchpoints[i].bank, gb->watchpoints[i].addr};
+            char range[sizeof(" to $ffff")] = "";
+            if (gb->watchpoints[i].end != gb->watchpoints[i].addr) {
+                sprintf(range, " to $%04x", gb->watchpoints[i].end);
+            }
             if (gb->watchpoints[i].condition) {
-                GB_log(gb, " %d. %s (%c%c, Condition: %s)\n", i + 1, debugger_value_to_string(gb, addr, addr.has_bank),
+                GB_log(gb, " %d. %s%s (%c%c, Condition: %s)\n", i + 1, debugger_value_to_string(gb, addr, addr.has_bank), range,
                                                               (gb->watchpoints[i].flags & GB_WATCHPOINT_R)? 'r' : '-',
                                                               (gb->watchpoints[i].flags & GB_WATCHPOINT_W)? 'w' : '-',
-                                                              gb->watchpoints[i].condition);
+                                                              gb->watchpoints[i].condition->string);
             }
             else {
-                GB_log(gb, " %d. %s (%c%c)\n", i + 1, debugger_value_to_string(gb, addr, addr.has_bank),
+                GB_log(gb, " %d. %s%s (%c%c)\n", i + 1, debugger_value_to_string(gb, addr, addr.has_bank), range,
                                                (gb->watchpoints[i].flags & GB_WATCHPOINT_R)? 'r' : '-',
                                                (gb->watchpoints[i].flags & GB_WATCHPOINT_W)? 'w' : '-');
             }
@@ -1340,21 +1545,15 @@ static bool _should_break(GB_gameboy_t *gb, value_t addr, bool jump_to)
         if (!gb->breakpoints[index].condition) {
             return true;
         }
-        bool error;
-        bool condition = debugger_evaluate(gb, gb->breakpoints[index].condition,
-                                           (unsigned)strlen(gb->breakpoints[index].condition), &error, NULL, NULL).value;
-        if (error) {
-            /* Should never happen */
-            GB_log(gb, "An internal error has occured\n");
-            return true;
-        }
-        return condition;
+        return run_expression(gb, &gb->breakpoints[index].condition->expression, NULL, NULL).value;
     }
     return false;
 }
 
 static bool should_break(GB_gameboy_t *gb, uint16_t addr, bool jump_to)
 {
+    if (!MAP_TEST(gb->breakpoint_map, addr)) return false;
+
     /* Try any-bank breakpoint */
     value_t full_addr = (VALUE_16(addr));
     if (_should_break(gb, full_addr, jump_to)) return true;
@@ -1453,6 +1652,8 @@ static bool examine(GB_gameboy_t *gb, char *arguments, char *modifiers, const de
     }
 
     if (!error) {
+        /* Reads made to print memory are not counted in the heatmap */
+        GB_heatmap_t *heatmap = GB_debugger_heatmap_suspend(gb);
         if (addr.has_bank) {
             banking_state_t old_state;
             save_banking_state(gb, &old_state);
@@ -1481,6 +1682,7 @@ static bool examine(GB_gameboy_t *gb, char *arguments, char *modifiers, const de
                 GB_log(gb, "\n");
             }
         }
+        GB_debugger_heatmap_resume(gb, heatmap);
     }
     return true;
 }
@@ -1613,8 +1815,57 @@ static bool ticks(GB_gameboy_t *gb, char *arguments, char *modifiers, const debu
         return true;
     }
 
-    GB_log(gb, "Ticks: %llu. (Resetting)\n", (unsigned long long)gb->debugger_ticks);
-    gb->debugger_ticks = 0;
+    GB_log(gb, "Ticks: %llu. (Resetting)\n", (unsigned long long)(gb->debugger_ticks - gb->debugger_ticks_mark));
+    gb->debugger_ticks_mark = gb->debugger_ticks;
+
+    return true;
+}
+
+static bool timing(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *argument = lstrip(arguments);
+
+    if (strcmp(argument, "reset") == 0) {
+        GB_reset_timing_stats(gb);
+        return true;
+    }
+
+    if (argument[0]) {
+        print_usage(gb, command);
+        return true;
+    }
+
+    GB_timing_stats_t stats;
+    GB_get_timing_stats(gb, &stats);
+    if (!stats.syncs) {
+        GB_log(gb, "No frames were paced yet.\n");
+        return true;
+    }
+
+    uint64_t waited = 0;
+    for (unsigned i = 0; i < GB_TIMING_HISTOGRAM_BUCKETS; i++) {
+        waited += stats.overshoot_histogram[i];
+    }
+    GB_log(gb, "Syncs: %llu, missed deadlines: %llu\n",
+           (unsigned long long)stats.syncs, (unsigned long long)stats.missed_deadlines);
+    if (!waited) return true;
+
+    GB_log(gb, "Overshoot: %llu.%03llu ms average, %llu.%03llu ms max\n",
+           (unsigned long long)(stats.total_overshoot / waited / 1000000),
+           (unsigned long long)(stats.total_overshoot / waited / 1000 % 1000),
+           (unsigned long long)(stats.max_overshoot / 1000000),
+           (unsigned long long)(stats.max_overshoot / 1000 % 1000));
+    for (unsigned i = 0; i < GB_TIMING_HISTOGRAM_BUCKETS; i++) {
+        if (!stats.overshoot_histogram[i]) continue;
+        if (i == GB_TIMING_HISTOGRAM_BUCKETS - 1) {
+            GB_log(gb, "  %2u.%u ms and above: %u\n", i / 10, i % 10, stats.overshoot_histogram[i]);
+        }
+        else {
+            GB_log(gb, "  %2u.%u - %2u.%u ms: %u\n", i / 10, i % 10, (i + 1) / 10, (i + 1) % 10,
+                   stats.overshoot_histogram[i]);
+        }
+    }
 
     return true;
 }
@@ -1681,6 +1932,7 @@ static bool lcd(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugg
 
 
 
+    GB_display_sync(gb);
     GB_log(gb, "\nCurrent line: %d\n", gb->current_line);
     GB_log(gb, "Current state: ");
     if (!(gb->io_registers[GB_IO_LCDC] & 0x80)) {
@@ -1896,6 +2148,8 @@ static bool wave(GB_gameboy_t *gb, char *arguments, char *modifiers, const debug
     return true;
 }
 
+static void load_state_keeping_history(GB_gameboy_t *gb, const uint8_t *buffer, size_t length);
+
 static bool undo(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
 {
     NO_MODIFIERS
@@ -1909,7 +2163,7 @@ static bool undo(GB_gameboy_t *gb, char *arguments, char *modifiers, const debug
         return true;
     }
     uint16_t pc = gb->pc;
-    GB_load_state_from_buffer(gb, gb->undo_state, GB_get_save_state_size(gb));
+    load_state_keeping_history(gb, gb->undo_state, GB_get_save_state_size(gb));
     GB_log(gb, "Reverted a \"%s\" command.\n", gb->undo_label);
     if (pc != gb->pc) {
         GB_cpu_disassemble(gb, gb->pc, 5);
@@ -1919,85 +2173,1295 @@ static bool undo(GB_gameboy_t *gb, char *arguments, char *modifiers, const debug
     return true;
 }
 
-static bool help(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command);
+/* Doesn't flush, so it's safe to call from the trace callback after a failed write */
+static void close_trace_file(GB_gameboy_t *gb)
+{
+    if (fclose(gb->trace_file)) {
+        GB_log(gb, "Could not finish writing the trace: %s\n", strerror(errno));
+    }
+    free(gb->trace_buffer);
+    gb->trace_file = NULL;
+    gb->trace_buffer = NULL;
+    gb->trace_size = 0;
+    gb->trace_position = 0;
+    gb->trace_wrapped = false;
+    gb->trace_callback = NULL;
+}
 
-#define HELP_NEWLINE "\n             "
+static void trace_file_callback(GB_gameboy_t *gb, const GB_trace_record_t *records, size_t count)
+{
+    if (fwrite(records, sizeof(records[0]), count, gb->trace_file) != count) {
+        GB_log(gb, "Could not write the trace: %s. Tracing stopped.\n", strerror(errno));
+        close_trace_file(gb);
+    }
+}
 
-/* Commands without implementations are aliases of the previous non-alias commands */
-static const debugger_command_t commands[] = {
-    {"continue", 1, cont, "Continue running until next stop"},
-    {"next", 1, next, "Run the next instruction, skipping over function calls"},
-    {"step", 1, step, "Run the next instruction, stepping into function calls"},
-    {"finish", 1, finish, "Run until the current function returns"},
-    {"undo", 1, undo, "Reverts the last command"},
-    {"backtrace", 2, backtrace, "Displays the current call stack"},
-    {"bt", 2, }, /* Alias */
-    {"sld", 3, stack_leak_detection, "Like finish, but stops if a stack leak is detected"},
-    {"ticks", 2, ticks, "Displays the number of CPU ticks since the last time 'ticks' was" HELP_NEWLINE
-                        "used"},
-    {"registers", 1, registers, "Print values of processor registers and other important registers"},
-    {"cartridge", 2, mbc, "Displays information about the MBC and cartridge"},
-    {"mbc", 3, }, /* Alias */
-    {"apu", 3, apu, "Displays information about the current state of the audio chip"},
-    {"wave", 3, wave, "Prints a visual representation of the wave RAM." HELP_NEWLINE
-                      "Modifiers can be used for a (f)ull print (the default)," HELP_NEWLINE
-        "a more (c)ompact one, or a one-(l)iner", "", "(f|c|l)", .modifiers_completer = wave_completer},
-    {"lcd", 3, lcd, "Displays information about the current state of the LCD controller"},
-    {"palettes", 3, palettes, "Displays the current CGB palettes"},
-    {"softbreak", 2, softbreak, "Enables or disables software breakpoints", "(on|off)", .argument_completer = on_off_completer},
-    {"breakpoint", 1, breakpoint, "Add a new breakpoint at the specified address/expression" HELP_NEWLINE
-                                  "Can also modify the condition of existing breakpoints." HELP_NEWLINE
-                                  "If the j modifier is used, the breakpoint will occur just before" HELP_NEWLINE
-                                  "jumping to the target.",
-                                  "<expression>[ if <condition expression>]", "j",
-                                  .argument_completer = symbol_completer, .modifiers_completer = j_completer},
-    {"delete", 2, delete, "Delete a breakpoint by its address, or all breakpoints", "[<expression>]", .argument_completer = symbol_completer},
-    {"watch", 1, watch, "Add a new watchpoint at the specified address/expression." HELP_NEWLINE
-                        "Can also modify the condition and type of existing watchpoints." HELP_NEWLINE
-                        "Default watchpoint type is write-only.",
-                        "<expression>[ if <condition expression>]", "(r|w|rw)",
-                        .argument_completer = symbol_completer, .modifiers_completer = rw_completer
-    },
-    {"unwatch", 3, unwatch, "Delete a watchpoint by its address, or all watchpoints", "[<expression>]", .argument_completer = symbol_completer},
-    {"list", 1, list, "List all set breakpoints and watchpoints"},
-    {"print", 1, print, "Evaluate and print an expression" HELP_NEWLINE
-                        "Use modifier to format as an address (a, default) or as a number in" HELP_NEWLINE
-                        "decimal (d), hexadecimal (x), octal (o) or binary (b).",
-                        "<expression>", "format", .argument_completer = symbol_completer, .modifiers_completer = format_completer},
-    {"eval", 2, }, /* Alias */
-    {"examine", 2, examine, "Examine values at address", "<expression>", "count", .argument_completer = symbol_completer},
-    {"x", 1, }, /* Alias */
-    {"disassemble", 1, disassemble, "Disassemble instructions at address", "<expression>", "count", .argument_completer = symbol_completer},
+static bool trace(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *path = lstrip(arguments);
 
+    if (!path[0]) {
+        if (!gb->trace_buffer) {
+            GB_log(gb, "Not tracing.\n");
+            return true;
+        }
+        GB_set_trace_buffer(gb, NULL, 0, NULL);
+        GB_log(gb, "Tracing stopped.\n");
+        return true;
+    }
 
-    {"help", 1, help, "List available commands or show help for the specified command", "[<command>]"},
-    {NULL,}, /* Null terminator */
-};
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        GB_log(gb, "Could not open %s: %s\n", path, strerror(errno));
+        return true;
+    }
 
-static const debugger_command_t *find_command(const char *string)
-{
-    size_t length = strlen(string);
-    for (const debugger_command_t *command = commands; command->command; command++) {
-        if (command->min_length > length) continue;
-        if (memcmp(command->command, string, length) == 0) { /* Is a substring? */
-            /* Aliases */
-            while (!command->implementation) {
-                command--;
-            }
-            return command;
-        }
+    GB_trace_file_header_t header = {{'S', 'B', 'T', 'R'}, GB_TRACE_FILE_VERSION, sizeof(GB_trace_record_t)};
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        GB_log(gb, "Could not write %s: %s\n", path, strerror(errno));
+        fclose(file);
+        return true;
     }
 
-    return NULL;
+    const size_t size = 0x4000;
+    GB_set_trace_buffer(gb, malloc(size * sizeof(GB_trace_record_t)), size, trace_file_callback);
+    gb->trace_file = file;
+    GB_log(gb, "Tracing to %s\n", path);
+    return true;
 }
 
-static void print_command_shortcut(GB_gameboy_t *gb, const debugger_command_t *command)
+/* Profiler */
+
+#define PROFILE_NO_STACK 0xFFFFFFFF
+
+typedef struct {
+    uint32_t stack; /* PROFILE_NO_STACK marks an empty slot */
+    uint32_t key; /* bank << 16 | pc */
+    uint64_t cycles;
+} profile_entry_t;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t depth;
+    uint32_t frames; /* Index of the outermost call site in the frame pool */
+} profile_stack_t;
+
+struct GB_profile_s {
+    unsigned period;
+    uint64_t last_sample;
+    uint32_t current_stack; /* PROFILE_NO_STACK after every call and return */
+    /* The stack and bank << 16 | pc of the last sample, which the cycles until the next one are charged to.
+       sample_stack is PROFILE_NO_STACK when there is no sample to charge. */
+    uint32_t sample_stack, sample_key;
+
+    /* (stack, bank:pc) -> cycles, open addressed */
+    profile_entry_t *entries;
+    size_t n_entries, entries_mask;
+
+    /* Call stacks seen so far, as bank << 16 | addr keys of their call sites, outermost first */
+    profile_stack_t *stacks;
+    uint32_t *stack_slots; /* Open addressed index into stacks */
+    size_t n_stacks, stack_slots_mask;
+    uint32_t *frames;
+    size_t n_frames, frames_allocation;
+};
+
+typedef struct {
+    uint32_t key;
+    uint64_t cycles;
+} profile_total_t;
+
+typedef struct {
+    char *stack;
+    uint64_t cycles;
+} profile_line_t;
+
+static inline uint32_t profile_mix(uint32_t hash)
 {
-    GB_attributed_log(gb, GB_LOG_BOLD | GB_LOG_UNDERLINE, "%.*s", command->min_length, command->command);
-    GB_attributed_log(gb, GB_LOG_BOLD, "%s", command->command + command->min_length);
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352D;
+    hash ^= hash >> 15;
+    return hash;
 }
 
-static void print_command_description(GB_gameboy_t *gb, const debugger_command_t *command)
+static void profile_grow_entries(struct GB_profile_s *profile)
+{
+    profile_entry_t *old = profile->entries;
+    size_t old_size = profile->entries_mask + 1;
+
+    profile->entries_mask = old_size * 2 - 1;
+    profile->entries = malloc(old_size * 2 * sizeof(profile->entries[0]));
+    memset(profile->entries, 0xFF, old_size * 2 * sizeof(profile->entries[0]));
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].stack == PROFILE_NO_STACK) continue;
+        size_t slot = profile_mix(old[i].key ^ profile_mix(old[i].stack)) & profile->entries_mask;
+        while (profile->entries[slot].stack != PROFILE_NO_STACK) {
+            slot = (slot + 1) & profile->entries_mask;
+        }
+        profile->entries[slot] = old[i];
+    }
+    free(old);
+}
+
+static profile_entry_t *profile_entry(struct GB_profile_s *profile, uint32_t stack, uint32_t key)
+{
+    if ((profile->n_entries + 1) * 2 > profile->entries_mask + 1) {
+        profile_grow_entries(profile);
+    }
+
+    size_t slot = profile_mix(key ^ profile_mix(stack)) & profile->entries_mask;
+    while (true) {
+        profile_entry_t *entry = &profile->entries[slot];
+        if (entry->stack == stack && entry->key == key) return entry;
+        if (entry->stack == PROFILE_NO_STACK) {
+            entry->stack = stack;
+            entry->key = key;
+            entry->cycles = 0;
+            profile->n_entries++;
+            return entry;
+        }
+        slot = (slot + 1) & profile->entries_mask;
+    }
+}
+
+static void profile_grow_stacks(struct GB_profile_s *profile)
+{
+    size_t size = (profile->stack_slots_mask + 1) * 2;
+
+    profile->stack_slots_mask = size - 1;
+    profile->stack_slots = realloc(profile->stack_slots, size * sizeof(profile->stack_slots[0]));
+    profile->stacks = realloc(profile->stacks, size / 2 * sizeof(profile->stacks[0]));
+    memset(profile->stack_slots, 0xFF, size * sizeof(profile->stack_slots[0]));
+    for (uint32_t i = 0; i < profile->n_stacks; i++) {
+        size_t slot = profile->stacks[i].hash & profile->stack_slots_mask;
+        while (profile->stack_slots[slot] != PROFILE_NO_STACK) {
+            slot = (slot + 1) & profile->stack_slots_mask;
+        }
+        profile->stack_slots[slot] = i;
+    }
+}
+
+/* Returns the index of the current backtrace in stacks, adding it if it was not seen before */
+static uint32_t profile_intern_stack(GB_gameboy_t *gb, struct GB_profile_s *profile)
+{
+    uint32_t frames[sizeof(gb->backtrace_returns) / sizeof(gb->backtrace_returns[0])];
+    uint32_t depth = gb->backtrace_size;
+    uint32_t hash = depth;
+    for (unsigned i = 0; i < depth; i++) {
+        frames[i] = gb->backtrace_returns[i].bank << 16 | gb->backtrace_returns[i].addr;
+        hash = profile_mix(hash ^ frames[i]);
+    }
+
+    if ((profile->n_stacks + 1) * 2 > profile->stack_slots_mask + 1) {
+        profile_grow_stacks(profile);
+    }
+
+    size_t slot = hash & profile->stack_slots_mask;
+    while (profile->stack_slots[slot] != PROFILE_NO_STACK) {
+        const profile_stack_t *stack = &profile->stacks[profile->stack_slots[slot]];
+        if (stack->hash == hash && stack->depth == depth &&
+            memcmp(profile->frames + stack->frames, frames, depth * sizeof(frames[0])) == 0) {
+            return profile->stack_slots[slot];
+        }
+        slot = (slot + 1) & profile->stack_slots_mask;
+    }
+
+    if (profile->n_frames + depth > profile->frames_allocation) {
+        while (profile->n_frames + depth > profile->frames_allocation) {
+            profile->frames_allocation *= 2;
+        }
+        profile->frames = realloc(profile->frames, profile->frames_allocation * sizeof(profile->frames[0]));
+    }
+    memcpy(profile->frames + profile->n_frames, frames, depth * sizeof(frames[0]));
+
+    profile->stacks[profile->n_stacks] = (profile_stack_t){hash, depth, profile->n_frames};
+    profile->n_frames += depth;
+    profile->stack_slots[slot] = profile->n_stacks;
+    return profile->n_stacks++;
+}
+
+/* The function containing an address is the closest symbol before it, as in debugger_value_to_string */
+static const GB_bank_symbol_t *profile_function(GB_gameboy_t *gb, uint32_t key)
+{
+    uint16_t addr = key;
+    const GB_bank_symbol_t *symbol = GB_map_find_symbol(gb->bank_symbols[key >> 16], addr);
+    if (symbol && (addr - symbol->addr > 0x1000 || symbol->addr == 0)) {
+        return NULL;
+    }
+    return symbol;
+}
+
+/* Writes the name of the function containing key to output if it is not NULL, and returns its length */
+static size_t profile_function_name(GB_gameboy_t *gb, uint32_t key, char *output)
+{
+    const GB_bank_symbol_t *symbol = profile_function(gb, key);
+    char address[sizeof("$xxxx:$xxxx")];
+    const char *name = address;
+    if (symbol) {
+        name = symbol->name;
+    }
+    else {
+        sprintf(address, "$%02x:$%04x", key >> 16, key & 0xFFFF);
+    }
+
+    size_t length = strlen(name);
+    if (output) {
+        memcpy(output, name, length);
+    }
+    return length;
+}
+
+static int profile_total_key_compare(const void *a, const void *b)
+{
+    uint32_t key_a = ((const profile_total_t *)a)->key;
+    uint32_t key_b = ((const profile_total_t *)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+static int profile_total_cycles_compare(const void *a, const void *b)
+{
+    uint64_t cycles_a = ((const profile_total_t *)a)->cycles;
+    uint64_t cycles_b = ((const profile_total_t *)b)->cycles;
+    return (cycles_a < cycles_b) - (cycles_a > cycles_b);
+}
+
+static int profile_line_compare(const void *a, const void *b)
+{
+    return strcmp(((const profile_line_t *)a)->stack, ((const profile_line_t *)b)->stack);
+}
+
+/* Merges totals with equal keys and sorts them from hottest to coldest, returns the new count */
+static size_t profile_merge_totals(profile_total_t *totals, size_t count)
+{
+    if (!count) return 0;
+
+    qsort(totals, count, sizeof(totals[0]), profile_total_key_compare);
+    size_t merged = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (totals[i].key == totals[merged].key) {
+            totals[merged].cycles += totals[i].cycles;
+        }
+        else {
+            totals[++merged] = totals[i];
+        }
+    }
+    merged++;
+    qsort(totals, merged, sizeof(totals[0]), profile_total_cycles_compare);
+    return merged;
+}
+
+static void profile_print_totals(GB_gameboy_t *gb, const profile_total_t *totals, size_t count, uint64_t total_cycles)
+{
+    if (count > 10) {
+        count = 10;
+    }
+    for (size_t i = 0; i < count; i++) {
+        GB_log(gb, " %6.2f%% %12llu  %s\n", totals[i].cycles * 100.0 / total_cycles, (unsigned long long)totals[i].cycles,
+               debugger_value_to_string(gb, (value_t){true, totals[i].key >> 16, totals[i].key & 0xFFFF}, true));
+    }
+}
+
+static void profile_report(GB_gameboy_t *gb)
+{
+    const struct GB_profile_s *profile = gb->profile;
+    if (!profile || !profile->n_entries) {
+        GB_log(gb, "No profile recorded.\n");
+        return;
+    }
+
+    profile_total_t *addresses = malloc(profile->n_entries * sizeof(addresses[0]));
+    profile_total_t *functions = malloc(profile->n_entries * sizeof(functions[0]));
+    uint64_t total_cycles = 0;
+    size_t count = 0;
+    for (size_t i = 0; i <= profile->entries_mask; i++) {
+        const profile_entry_t *entry = &profile->entries[i];
+        if (entry->stack == PROFILE_NO_STACK) continue;
+        const GB_bank_symbol_t *symbol = profile_function(gb, entry->key);
+        addresses[count] = (profile_total_t){entry->key, entry->cycles};
+        functions[count] = (profile_total_t){symbol? (entry->key & 0xFFFF0000) | symbol->addr : entry->key, entry->cycles};
+        total_cycles += entry->cycles;
+        count++;
+    }
+
+    if (total_cycles) {
+        GB_log(gb, "Profiled %llu cycles%s.\n", (unsigned long long)total_cycles, GB_is_profiling(gb)? " so far" : "");
+        GB_log(gb, "Hottest functions:\n");
+        profile_print_totals(gb, functions, profile_merge_totals(functions, count), total_cycles);
+        GB_log(gb, "Hottest addresses:\n");
+        profile_print_totals(gb, addresses, profile_merge_totals(addresses, count), total_cycles);
+    }
+    else {
+        GB_log(gb, "No profile recorded.\n");
+    }
+
+    free(addresses);
+    free(functions);
+}
+
+static bool profile(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *argument = lstrip(arguments);
+
+    if (!argument[0]) {
+        profile_report(gb);
+        return true;
+    }
+
+    if (memcmp(argument, "on", 2) == 0 && (argument[2] == 0 || argument[2] == ' ')) {
+        unsigned period = 1;
+        if (argument[2]) {
+            bool error = false;
+            value_t result = debugger_evaluate(gb, argument + 3, (unsigned)strlen(argument + 3), &error, NULL, NULL);
+            if (error) return true;
+            if (!result.value) {
+                print_usage(gb, command);
+                return true;
+            }
+            period = result.value;
+        }
+        GB_start_profiling(gb, period);
+        GB_log(gb, "Profiling every %u cycle%s.\n", period, period == 1? "" : "s");
+        return true;
+    }
+
+    if (strcmp(argument, "off") == 0) {
+        if (!GB_is_profiling(gb)) {
+            GB_log(gb, "Not profiling.\n");
+            return true;
+        }
+        GB_stop_profiling(gb);
+        GB_log(gb, "Profiling stopped.\n");
+        return true;
+    }
+
+    if (!gb->profile) {
+        GB_log(gb, "No profile recorded.\n");
+        return true;
+    }
+
+    int error = GB_save_profile(gb, argument);
+    if (error) {
+        GB_log(gb, "Could not write %s: %s\n", argument, strerror(error));
+        return true;
+    }
+    GB_log(gb, "Saved folded call stacks to %s\n", argument);
+    return true;
+}
+
+/* Coverage */
+
+struct GB_coverage_s {
+    size_t rom_size, cart_ram_size, ram_size;
+    uint16_t instruction; /* Address of the instruction being executed */
+    uint16_t next_instruction; /* Where it falls through to, any other address is a jump target */
+    uint8_t instruction_length;
+    bool fetching; /* The next read is an opcode fetch */
+    uint8_t flags[]; /* ROM, then cartridge RAM, then WRAM, then HRAM */
+};
+
+static const uint8_t instruction_lengths[0x100] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, /* 0X */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 1X */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 2X */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 3X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 4X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 5X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 6X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 7X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 8X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 9X */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* AX */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* BX */
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, /* CX */
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, /* DX */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, /* EX */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, /* FX */
+};
+
+/* Returns the coverage flags of the byte addr is currently mapped to, or NULL if it is not covered */
+static uint8_t *coverage_flags(GB_gameboy_t *gb, uint16_t addr)
+{
+    struct GB_coverage_s *coverage = gb->coverage;
+    size_t offset;
+
+    if (addr < 0x8000) {
+        if (!gb->boot_rom_finished && (addr < 0x100 || (addr >= 0x200 && addr < 0x900 && GB_is_cgb(gb)))) {
+            return NULL;
+        }
+        if (!gb->rom_size) return NULL;
+        offset = ((addr & 0x3FFF) + (addr < 0x4000? gb->mbc_rom0_bank : gb->mbc_rom_bank) * 0x4000) & (gb->rom_size - 1);
+        return offset < coverage->rom_size? &coverage->flags[offset] : NULL;
+    }
+
+    if (addr < 0xA000) return NULL;
+
+    if (addr < 0xC000) {
+        if (!gb->mbc_ram_size || gb->camera_registers_mapped) return NULL;
+        if (gb->cartridge_type->has_rtc && gb->cartridge_type->mbc_type != GB_HUC3 &&
+            gb->mbc3_rtc_mapped && gb->mbc_ram_bank <= 4) {
+            return NULL;
+        }
+        uint8_t effective_bank = gb->mbc_ram_bank;
+        if (gb->cartridge_type->mbc_type == GB_MBC3 && !gb->is_mbc30) {
+            effective_bank &= 0x3;
+        }
+        offset = ((addr & 0x1FFF) + effective_bank * 0x2000) & (gb->mbc_ram_size - 1);
+        return offset < coverage->cart_ram_size? &coverage->flags[coverage->rom_size + offset] : NULL;
+    }
+
+    if (addr < 0xFE00) {
+        offset = (addr & 0x0FFF) + ((addr & 0x1000)? gb->cgb_ram_bank * 0x1000 : 0);
+        return offset < coverage->ram_size? &coverage->flags[coverage->rom_size + coverage->cart_ram_size + offset] : NULL;
+    }
+
+    if (addr >= 0xFF80 && addr != 0xFFFF) {
+        return &coverage->flags[coverage->rom_size + coverage->cart_ram_size + coverage->ram_size + addr - 0xFF80];
+    }
+
+    return NULL;
+}
+
+static void coverage_print_region(GB_gameboy_t *gb, const char *name, const uint8_t *flags, size_t size)
+{
+    size_t executed = 0, read = 0, written = 0, jump_targets = 0, used = 0;
+    for (size_t i = 0; i < size; i++) {
+        executed += !!(flags[i] & GB_COVERAGE_EXECUTED);
+        read += !!(flags[i] & GB_COVERAGE_READ);
+        written += !!(flags[i] & GB_COVERAGE_WRITTEN);
+        jump_targets += !!(flags[i] & GB_COVERAGE_JUMP_TARGET);
+        used += !!flags[i];
+    }
+    GB_log(gb, "%-14s %6.2f%% of %zu bytes used. %zu executed, %zu jump targets, %zu read, %zu written\n",
+           name, size? used * 100.0 / size : 0.0, size, executed, jump_targets, read, written);
+}
+
+static bool coverage(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *argument = lstrip(arguments);
+
+    if (!argument[0]) {
+        const struct GB_coverage_s *coverage = gb->coverage;
+        if (!coverage) {
+            GB_log(gb, "Coverage is disabled.\n");
+            return true;
+        }
+        const uint8_t *flags = coverage->flags;
+        coverage_print_region(gb, "ROM:", flags, coverage->rom_size);
+        flags += coverage->rom_size;
+        if (coverage->cart_ram_size) {
+            coverage_print_region(gb, "Cartridge RAM:", flags, coverage->cart_ram_size);
+        }
+        flags += coverage->cart_ram_size;
+        coverage_print_region(gb, "WRAM:", flags, coverage->ram_size);
+        flags += coverage->ram_size;
+        coverage_print_region(gb, "HRAM:", flags, 0x7F);
+        return true;
+    }
+
+    if (strcmp(argument, "on") == 0) {
+        GB_set_coverage_enabled(gb, true);
+        return true;
+    }
+
+    if (strcmp(argument, "off") == 0) {
+        GB_set_coverage_enabled(gb, false);
+        return true;
+    }
+
+    if (memcmp(argument, "save ", 5) == 0 || memcmp(argument, "load ", 5) == 0) {
+        bool save = argument[0] == 's';
+        const char *path = lstrip(argument + 5);
+        if (save && !gb->coverage) {
+            GB_log(gb, "Coverage is disabled.\n");
+            return true;
+        }
+        int error = save? GB_save_coverage(gb, path) : GB_load_coverage(gb, path);
+        if (error == EINVAL) {
+            GB_log(gb, "%s is not a coverage file of the current ROM and model\n", path);
+        }
+        else if (error) {
+            GB_log(gb, "Could not %s %s: %s\n", save? "write" : "read", path, strerror(error));
+        }
+        else {
+            GB_log(gb, save? "Saved coverage to %s\n" : "Merged coverage from %s\n", path);
+        }
+        return true;
+    }
+
+    print_usage(gb, command);
+    return true;
+}
+
+/* Heatmap */
+
+static void heatmap_print_summary(GB_gameboy_t *gb)
+{
+    const GB_heatmap_t *heatmap = gb->heatmap;
+    profile_total_t pages[0x100];
+    uint64_t reads = 0, writes = 0;
+    for (unsigned page = 0; page < 0x100; page++) {
+        pages[page] = (profile_total_t){page, 0};
+        for (unsigned i = page << 8; i < (page + 1) << 8; i++) {
+            pages[page].cycles += heatmap->reads[i] + heatmap->writes[i];
+            reads += heatmap->reads[i];
+            writes += heatmap->writes[i];
+        }
+    }
+    GB_log(gb, "%llu reads, %llu writes.\n", (unsigned long long)reads, (unsigned long long)writes);
+    if (!reads && !writes) return;
+
+    GB_log(gb, "Hottest pages:\n");
+    qsort(pages, 0x100, sizeof(pages[0]), profile_total_cycles_compare);
+    for (unsigned i = 0; i < 10 && pages[i].cycles; i++) {
+        uint32_t page_reads = 0, page_writes = 0;
+        for (unsigned j = pages[i].key << 8; j < (pages[i].key + 1) << 8; j++) {
+            page_reads += heatmap->reads[j];
+            page_writes += heatmap->writes[j];
+        }
+        GB_log(gb, " $%02x00-$%02xff: %10u reads, %10u writes\n", pages[i].key, pages[i].key, page_reads, page_writes);
+    }
+
+    for (unsigned bank = 0; bank < 0x200; bank++) {
+        if (heatmap->rom_bank_reads[bank]) {
+            GB_log(gb, " ROM bank $%02x: %10u reads\n", bank, heatmap->rom_bank_reads[bank]);
+        }
+    }
+    for (unsigned bank = 0; bank < 0x100; bank++) {
+        if (heatmap->cart_ram_bank_reads[bank] || heatmap->cart_ram_bank_writes[bank]) {
+            GB_log(gb, " Cartridge RAM bank $%02x: %10u reads, %10u writes\n", bank,
+                   heatmap->cart_ram_bank_reads[bank], heatmap->cart_ram_bank_writes[bank]);
+        }
+    }
+}
+
+static bool heatmap(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *argument = lstrip(arguments);
+
+    if (strcmp(argument, "on") == 0) {
+        GB_set_heatmap_enabled(gb, true);
+        return true;
+    }
+
+    if (strcmp(argument, "off") == 0) {
+        GB_set_heatmap_enabled(gb, false);
+        return true;
+    }
+
+    if (!gb->heatmap) {
+        GB_log(gb, "Heatmap is disabled.\n");
+        return true;
+    }
+
+    if (!argument[0]) {
+        heatmap_print_summary(gb);
+        return true;
+    }
+
+    if (strcmp(argument, "reset") == 0) {
+        GB_reset_heatmap(gb);
+        return true;
+    }
+
+    if (memcmp(argument, "save ", 5) == 0 || memcmp(argument, "image ", 6) == 0) {
+        bool image = argument[0] == 'i';
+        const char *path = lstrip(argument + (image? 6 : 5));
+        int error = GB_save_heatmap(gb, path, image? GB_HEATMAP_FORMAT_IMAGE : GB_HEATMAP_FORMAT_BINARY);
+        if (error) {
+            GB_log(gb, "Could not write %s: %s\n", path, strerror(error));
+        }
+        else {
+            GB_log(gb, "Saved heatmap to %s\n", path);
+        }
+        return true;
+    }
+
+    print_usage(gb, command);
+    return true;
+}
+
+/* Reverse execution */
+
+/* Snapshots are taken every interval while history is recorded, and reverse execution restores the
+   nearest one and replays from it. The interval adapts so replaying a whole one takes about this long. */
+#define REVERSE_REPLAY_BUDGET_MS 20
+#define REVERSE_MIN_INTERVAL (LCDC_PERIOD / 4)
+#define REVERSE_MAX_INTERVAL (LCDC_PERIOD * 64)
+#define REVERSE_MEMORY_BUDGET (32 * 1024 * 1024)
+/* Bytes returned by input callbacks, past which the older half of the history is dropped */
+#define REVERSE_INPUT_BUDGET (8 * 1024 * 1024)
+/* Replaying towards an earlier instruction snapshots this many times more often, so stepping back again is quick */
+#define REVERSE_DENSE_FACTOR 16
+
+typedef struct {
+    uint64_t step; /* debugger_steps of the instruction the snapshot was taken before */
+    uint64_t debugger_ticks;
+    uint64_t input_position; /* Where replays from this snapshot start taking input from */
+    bool keys[4][GB_KEY_MAX]; /* Not part of save states */
+    unsigned key_position; /* The first key change replays from this snapshot apply */
+
+    /* Call tracking of the debugger itself */
+    signed debug_call_depth;
+    uint16_t sp_for_call_depth[0x200];
+    uint16_t addr_for_call_depth[0x200];
+    unsigned backtrace_size;
+    uint16_t backtrace_sps[0x200];
+    struct {
+        uint16_t bank;
+        uint16_t addr;
+    } backtrace_returns[0x200];
+
+    size_t size;
+    uint8_t state[];
+} reverse_snapshot_t;
+
+typedef struct {
+    uint64_t step; /* debugger_steps of the instruction the change was seen before */
+    bool keys[4][GB_KEY_MAX];
+} reverse_key_change_t;
+
+struct GB_reverse_s {
+    reverse_snapshot_t **snapshots; /* Sorted by step */
+    unsigned count, capacity;
+    uint64_t interval, next_snapshot; /* In debugger ticks */
+    bool keys[4][GB_KEY_MAX]; /* Joypad state as of the newest key change */
+    bool replaying, searching, dense;
+    uint64_t last_stop; /* While searching, the last step the debugger would have stopped at */
+    uint64_t replayed_ticks;
+    int64_t replay_time; /* In nanoseconds */
+
+    /* What input callbacks returned, in order, so replays don't call them again */
+    uint8_t *inputs;
+    size_t input_count, input_capacity;
+    uint64_t input_base; /* Position of inputs[0], older input was dropped with its snapshots */
+    uint64_t input_position; /* Position of the next input */
+
+    /* Joypad changes by step, which replays apply again since the joypad is not part of save states */
+    reverse_key_change_t *key_changes;
+    unsigned key_change_count, key_change_capacity;
+    unsigned key_position; /* The next key change to apply while replaying */
+};
+
+static void reverse_log_callback(GB_gameboy_t *gb, const char *string, GB_log_attributes attributes)
+{
+}
+
+/* Drops snapshots and key changes of steps from step on */
+static void reverse_truncate(struct GB_reverse_s *reverse, uint64_t step)
+{
+    while (reverse->count && reverse->snapshots[reverse->count - 1]->step >= step) {
+        free(reverse->snapshots[--reverse->count]);
+    }
+    while (reverse->key_change_count && reverse->key_changes[reverse->key_change_count - 1].step >= step) {
+        reverse->key_change_count--;
+    }
+}
+
+/* Drops the key changes the oldest snapshot already includes */
+static void reverse_drop_old_key_changes(struct GB_reverse_s *reverse)
+{
+    unsigned dropped = reverse->snapshots[0]->key_position;
+    if (!dropped) return;
+    memmove(reverse->key_changes, reverse->key_changes + dropped, (reverse->key_change_count - dropped) * sizeof(reverse->key_changes[0]));
+    reverse->key_change_count -= dropped;
+    for (unsigned i = 0; i < reverse->count; i++) {
+        reverse->snapshots[i]->key_position -= dropped;
+    }
+}
+
+static void reverse_record_keys(GB_gameboy_t *gb)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    if (reverse->key_change_count == reverse->key_change_capacity) {
+        reverse->key_change_capacity = reverse->key_change_capacity? reverse->key_change_capacity * 2 : 0x100;
+        reverse->key_changes = realloc(reverse->key_changes, reverse->key_change_capacity * sizeof(reverse->key_changes[0]));
+    }
+    reverse_key_change_t *change = &reverse->key_changes[reverse->key_change_count++];
+    change->step = gb->debugger_steps;
+    memcpy(change->keys, gb->keys, sizeof(change->keys));
+    memcpy(reverse->keys, gb->keys, sizeof(reverse->keys));
+}
+
+/* Applies the recorded key changes seen before step or at it */
+static void reverse_replay_keys(GB_gameboy_t *gb, uint64_t step)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    while (reverse->key_position < reverse->key_change_count && reverse->key_changes[reverse->key_position].step <= step) {
+        memcpy(gb->keys, reverse->key_changes[reverse->key_position].keys, sizeof(gb->keys));
+        reverse->key_position++;
+        GB_update_joyp(gb);
+    }
+}
+
+/* Keeps the newer half and every other snapshot of the older half, so older history gets sparser */
+static void reverse_thin(struct GB_reverse_s *reverse)
+{
+    unsigned half = reverse->count / 2;
+    unsigned kept = 0;
+    for (unsigned i = 0; i < reverse->count; i++) {
+        if (i < half && (i & 1)) {
+            free(reverse->snapshots[i]);
+            continue;
+        }
+        reverse->snapshots[kept++] = reverse->snapshots[i];
+    }
+    reverse->count = kept;
+}
+
+static void reverse_take_snapshot(GB_gameboy_t *gb)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    size_t size = GB_get_save_state_size(gb);
+    reverse_snapshot_t *snapshot = malloc(sizeof(*snapshot) + size);
+    snapshot->step = gb->debugger_steps;
+    snapshot->debugger_ticks = gb->debugger_ticks;
+    snapshot->input_position = reverse->input_position;
+    memcpy(snapshot->keys, gb->keys, sizeof(snapshot->keys));
+    snapshot->key_position = reverse->replaying? reverse->key_position : reverse->key_change_count;
+    snapshot->debug_call_depth = gb->debug_call_depth;
+    memcpy(snapshot->sp_for_call_depth, gb->sp_for_call_depth, sizeof(snapshot->sp_for_call_depth));
+    memcpy(snapshot->addr_for_call_depth, gb->addr_for_call_depth, sizeof(snapshot->addr_for_call_depth));
+    snapshot->backtrace_size = gb->backtrace_size;
+    memcpy(snapshot->backtrace_sps, gb->backtrace_sps, sizeof(snapshot->backtrace_sps));
+    memcpy(snapshot->backtrace_returns, gb->backtrace_returns, sizeof(snapshot->backtrace_returns));
+    snapshot->size = size;
+    GB_save_state_to_buffer(gb, snapshot->state);
+
+    reverse->next_snapshot = gb->debugger_ticks + (reverse->dense? reverse->interval / REVERSE_DENSE_FACTOR : reverse->interval);
+
+    if (reverse->count == reverse->capacity) {
+        reverse_thin(reverse);
+    }
+
+    /* Snapshots taken while replaying land between existing ones */
+    unsigned index = reverse->count;
+    while (index && reverse->snapshots[index - 1]->step > snapshot->step) {
+        index--;
+    }
+    if (index && reverse->snapshots[index - 1]->step == snapshot->step) {
+        free(reverse->snapshots[index - 1]);
+        reverse->snapshots[index - 1] = snapshot;
+        return;
+    }
+    memmove(reverse->snapshots + index + 1, reverse->snapshots + index, (reverse->count - index) * sizeof(reverse->snapshots[0]));
+    reverse->snapshots[index] = snapshot;
+    reverse->count++;
+}
+
+static void reverse_start(GB_gameboy_t *gb)
+{
+    struct GB_reverse_s *reverse = calloc(1, sizeof(*reverse));
+    size_t snapshot_size = sizeof(reverse_snapshot_t) + GB_get_save_state_size(gb);
+    reverse->capacity = REVERSE_MEMORY_BUDGET / snapshot_size;
+    if (reverse->capacity < 16) {
+        reverse->capacity = 16;
+    }
+    reverse->snapshots = malloc(reverse->capacity * sizeof(reverse->snapshots[0]));
+    reverse->interval = LCDC_PERIOD * 4;
+    memcpy(reverse->keys, gb->keys, sizeof(reverse->keys));
+    gb->reverse = reverse;
+    reverse_take_snapshot(gb);
+}
+
+void GB_debugger_reverse_discard(GB_gameboy_t *gb)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    if (!reverse) return;
+    reverse_truncate(reverse, 0);
+    free(reverse->snapshots);
+    free(reverse->inputs);
+    free(reverse->key_changes);
+    free(reverse);
+    gb->reverse = NULL;
+}
+
+void GB_set_reverse_recording(GB_gameboy_t *gb, bool enabled)
+{
+    gb->reverse_recording = enabled;
+    if (!enabled) {
+        GB_debugger_reverse_discard(gb);
+    }
+    /* While stopped, the history can start right away, otherwise it starts before the next instruction */
+    else if (!gb->reverse && gb->debug_stopped) {
+        reverse_start(gb);
+    }
+}
+
+bool GB_is_reverse_recording(GB_gameboy_t *gb)
+{
+    return gb->reverse_recording;
+}
+
+bool GB_debugger_is_replaying(GB_gameboy_t *gb)
+{
+    return gb->reverse && gb->reverse->replaying;
+}
+
+/* Makes room for size more bytes of input. Once they use up their budget, the older half of the snapshots is
+   dropped along with the input only they replay. */
+static void reverse_reserve_input(struct GB_reverse_s *reverse, size_t size)
+{
+    while (reverse->input_count + size > reverse->input_capacity) {
+        if (reverse->input_capacity >= REVERSE_INPUT_BUDGET && reverse->count > 1) {
+            unsigned half = reverse->count / 2;
+            size_t dropped = reverse->snapshots[half]->input_position - reverse->input_base;
+            if (dropped) {
+                for (unsigned i = 0; i < half; i++) {
+                    free(reverse->snapshots[i]);
+                }
+                memmove(reverse->snapshots, reverse->snapshots + half, (reverse->count - half) * sizeof(reverse->snapshots[0]));
+                reverse->count -= half;
+                memmove(reverse->inputs, reverse->inputs + dropped, reverse->input_count - dropped);
+                reverse->input_count -= dropped;
+                reverse->input_base += dropped;
+                reverse_drop_old_key_changes(reverse);
+                continue;
+            }
+        }
+        reverse->input_capacity = reverse->input_capacity? reverse->input_capacity * 2 : 0x1000;
+        reverse->inputs = realloc(reverse->inputs, reverse->input_capacity);
+    }
+}
+
+bool GB_debugger_replay_input(GB_gameboy_t *gb, void *data, size_t size)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    if (!reverse || !reverse->replaying) return false;
+    size_t offset = reverse->input_position - reverse->input_base;
+    if (offset + size > reverse->input_count) return false;
+    memcpy(data, reverse->inputs + offset, size);
+    reverse->input_position += size;
+    return true;
+}
+
+void GB_debugger_record_input(GB_gameboy_t *gb, const void *data, size_t size)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    if (!reverse || reverse->replaying) return;
+    /* Input past this point belongs to history that was reversed over */
+    reverse->input_count = reverse->input_position - reverse->input_base;
+    reverse_reserve_input(reverse, size);
+    memcpy(reverse->inputs + reverse->input_count, data, size);
+    reverse->input_count += size;
+    reverse->input_position += size;
+}
+
+/* Loading a state discards the history otherwise, which is only meant for states loaded by the frontend */
+static void load_state_keeping_history(GB_gameboy_t *gb, const uint8_t *buffer, size_t length)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    gb->reverse = NULL;
+    GB_load_state_from_buffer(gb, buffer, length);
+    gb->reverse = reverse;
+}
+
+/* Called every time the debugger runs while history is recorded, returns true while replaying */
+static bool reverse_run(GB_gameboy_t *gb)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    if (reverse->replaying) {
+        reverse_replay_keys(gb, gb->debugger_steps);
+        if (reverse->dense && gb->debugger_ticks >= reverse->next_snapshot) {
+            reverse_take_snapshot(gb);
+        }
+        if (reverse->searching && gb->breakpoints && should_break(gb, gb->pc, false)) {
+            reverse->last_stop = gb->debugger_steps;
+        }
+        return true;
+    }
+
+    if (memcmp(gb->keys, reverse->keys, sizeof(gb->keys)) != 0) {
+        reverse_record_keys(gb);
+    }
+    if (gb->debugger_ticks >= reverse->next_snapshot) {
+        reverse_take_snapshot(gb);
+    }
+    return false;
+}
+
+/* The newest snapshot taken before or at step, if any */
+static const reverse_snapshot_t *reverse_find_snapshot(struct GB_reverse_s *reverse, uint64_t step)
+{
+    for (unsigned i = reverse->count; i--;) {
+        if (reverse->snapshots[i]->step <= step) {
+            return reverse->snapshots[i];
+        }
+    }
+    return NULL;
+}
+
+static void reverse_restore(GB_gameboy_t *gb, const reverse_snapshot_t *snapshot)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+    load_state_keeping_history(gb, snapshot->state, snapshot->size);
+
+    /* The replay runs the snapshot's instruction first */
+    gb->debugger_steps = snapshot->step - 1;
+    gb->debugger_ticks = snapshot->debugger_ticks;
+    reverse->input_position = snapshot->input_position;
+    memcpy(gb->keys, snapshot->keys, sizeof(gb->keys));
+    reverse->key_position = snapshot->key_position;
+    gb->debug_call_depth = snapshot->debug_call_depth;
+    memcpy(gb->sp_for_call_depth, snapshot->sp_for_call_depth, sizeof(gb->sp_for_call_depth));
+    memcpy(gb->addr_for_call_depth, snapshot->addr_for_call_depth, sizeof(gb->addr_for_call_depth));
+    gb->backtrace_size = snapshot->backtrace_size;
+    memcpy(gb->backtrace_sps, snapshot->backtrace_sps, sizeof(gb->backtrace_sps));
+    memcpy(gb->backtrace_returns, snapshot->backtrace_returns, sizeof(gb->backtrace_returns));
+}
+
+/* Restores snapshot and runs until the instruction at step target is next. When searching, returns the last step
+   before search_limit the debugger would have stopped at, or 0 if there is none. Otherwise, snapshots past target
+   are dropped, since running forward again may not reproduce them. */
+static uint64_t reverse_replay(GB_gameboy_t *gb, const reverse_snapshot_t *snapshot, uint64_t target, uint64_t search_limit)
+{
+    struct GB_reverse_s *reverse = gb->reverse;
+
+    /* Everything the frontend already received, or that logs, records or stops, is suspended */
+    GB_log_callback_t log_callback = gb->log_callback;
+    GB_vblank_callback_t vblank_callback = gb->vblank_callback;
+    GB_frame_callback_t frame_callback = gb->frame_callback;
+    GB_input_callback_t async_input_callback = gb->async_input_callback;
+    void *rewind_sequences = gb->rewind_sequences;
+    size_t rewind_buffer_length = gb->rewind_buffer_length;
+    GB_trace_record_t *trace_buffer = gb->trace_buffer;
+    struct GB_profile_s *profile = gb->profile;
+    struct GB_coverage_s *coverage = gb->coverage;
+    GB_heatmap_t *heatmap = GB_debugger_heatmap_suspend(gb);
+    bool turbo = gb->turbo;
+    bool turbo_dont_skip = gb->turbo_dont_skip;
+    bool audio_disabled = gb->apu_output.disable_rendering;
+
+    gb->log_callback = reverse_log_callback;
+    gb->vblank_callback = NULL;
+    gb->frame_callback = NULL;
+    gb->async_input_callback = NULL;
+    gb->rewind_sequences = NULL;
+    gb->rewind_buffer_length = 0;
+    gb->trace_buffer = NULL;
+    gb->profile = NULL;
+    gb->coverage = NULL;
+    gb->turbo = true;
+    gb->turbo_dont_skip = false;
+    GB_set_audio_rendering_disabled(gb, true);
+
+    reverse_restore(gb, snapshot);
+    reverse->replaying = true;
+    reverse->searching = search_limit != 0;
+    reverse->dense = !reverse->searching;
+    reverse->last_stop = 0;
+    reverse->next_snapshot = gb->debugger_ticks + reverse->interval / REVERSE_DENSE_FACTOR;
+    uint64_t start_ticks = gb->debugger_ticks;
+    int64_t start_time = GB_get_nanoseconds();
+
+    gb->debug_stopped = false;
+    while (gb->debugger_steps + 1 < target) {
+        GB_run(gb);
+        if (gb->debug_stopped) {
+            /* Watchpoints and software breakpoints stop before the instruction after the one that hit them */
+            gb->debug_stopped = false;
+            if (reverse->searching && gb->debugger_steps + 1 < search_limit) {
+                reverse->last_stop = gb->debugger_steps + 1;
+            }
+        }
+    }
+    /* Like a stop inside GB_debugger_run, target's own run is already counted */
+    gb->debugger_steps = target;
+    gb->debug_stopped = true;
+    reverse_replay_keys(gb, target);
+    memcpy(reverse->keys, gb->keys, sizeof(reverse->keys));
+
+    reverse->replay_time += GB_get_nanoseconds() - start_time;
+    reverse->replayed_ticks += gb->debugger_ticks - start_ticks;
+    reverse->replaying = false;
+    reverse->dense = false;
+    reverse->next_snapshot = gb->debugger_ticks + reverse->interval;
+    if (!reverse->searching) {
+        reverse_truncate(reverse, target + 1);
+    }
+
+    gb->log_callback = log_callback;
+    gb->vblank_callback = vblank_callback;
+    gb->frame_callback = frame_callback;
+    gb->async_input_callback = async_input_callback;
+    gb->rewind_sequences = rewind_sequences;
+    gb->rewind_buffer_length = rewind_buffer_length;
+    gb->trace_buffer = trace_buffer;
+    gb->profile = profile;
+    gb->coverage = coverage;
+    GB_debugger_heatmap_resume(gb, heatmap);
+    gb->turbo = turbo;
+    gb->turbo_dont_skip = turbo_dont_skip;
+    GB_set_audio_rendering_disabled(gb, audio_disabled);
+
+    /* Time went backwards */
+    if (gb->debugger_ticks_mark > gb->debugger_ticks) {
+        gb->debugger_ticks_mark = gb->debugger_ticks;
+    }
+    if (profile) {
+        /* The last sample's cycles are lost with the history that was reversed over */
+        profile->current_stack = PROFILE_NO_STACK;
+        profile->sample_stack = PROFILE_NO_STACK;
+        profile->last_sample = gb->debugger_ticks;
+        if (gb->profile_next_sample != UINT64_MAX) {
+            gb->profile_next_sample = gb->debugger_ticks;
+        }
+    }
+
+    return reverse->last_stop;
+}
+
+/* Aims for replaying a whole interval, the worst case for reverse-step, to take REVERSE_REPLAY_BUDGET_MS */
+static void reverse_adapt_interval(struct GB_reverse_s *reverse)
+{
+    if (reverse->replay_time < 10000000) return; /* Too little to measure yet */
+
+    uint64_t interval = reverse->replayed_ticks * (REVERSE_REPLAY_BUDGET_MS * 1000000ULL) / reverse->replay_time;
+    if (interval < REVERSE_MIN_INTERVAL) {
+        interval = REVERSE_MIN_INTERVAL;
+    }
+    if (interval > REVERSE_MAX_INTERVAL) {
+        interval = REVERSE_MAX_INTERVAL;
+    }
+    reverse->interval = interval;
+
+    /* Older measurements fade out, so the interval follows what the game currently does */
+    if (reverse->replay_time > 1000000000) {
+        reverse->replay_time /= 2;
+        reverse->replayed_ticks /= 2;
+    }
+}
+
+/* A command changed the state, so replaying history would no longer lead to it */
+static void reverse_state_modified(GB_gameboy_t *gb, bool stopped)
+{
+    if (!stopped) {
+        /* Between instructions, there is no step to attach a snapshot to */
+        GB_debugger_reverse_discard(gb);
+        return;
+    }
+    reverse_truncate(gb->reverse, gb->debugger_steps);
+    reverse_take_snapshot(gb);
+}
+
+static bool reverse_available(GB_gameboy_t *gb)
+{
+    if (!gb->debug_stopped) {
+        GB_log(gb, "Reverse execution is only available while stopped\n");
+        return false;
+    }
+    if (!gb->reverse_recording) {
+        GB_log(gb, "Execution history is not being recorded, enable it with the record command\n");
+        return false;
+    }
+    if (!gb->reverse || gb->reverse->snapshots[0]->step >= gb->debugger_steps) {
+        GB_log(gb, "No earlier execution history is available\n");
+        return false;
+    }
+    return true;
+}
+
+static bool reverse_step(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    if (strlen(lstrip(arguments))) {
+        print_usage(gb, command);
+        return true;
+    }
+
+    if (!reverse_available(gb)) return true;
+
+    uint64_t target = gb->debugger_steps - 1;
+    reverse_replay(gb, reverse_find_snapshot(gb->reverse, target), target, 0);
+    reverse_adapt_interval(gb->reverse);
+    GB_cpu_disassemble(gb, gb->pc, 5);
+    return true;
+}
+
+static bool reverse_continue(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    if (strlen(lstrip(arguments))) {
+        print_usage(gb, command);
+        return true;
+    }
+
+    if (!reverse_available(gb)) return true;
+
+    struct GB_reverse_s *reverse = gb->reverse;
+    uint64_t current = gb->debugger_steps;
+    uint64_t stop = 0;
+
+    /* Replay the history between snapshots from the newest, until a stretch with a stop is found */
+    for (unsigned i = reverse->count; i-- && !stop;) {
+        const reverse_snapshot_t *snapshot = reverse->snapshots[i];
+        if (snapshot->step >= current) continue;
+        uint64_t end = current;
+        if (i + 1 < reverse->count && reverse->snapshots[i + 1]->step < current) {
+            end = reverse->snapshots[i + 1]->step;
+        }
+        stop = reverse_replay(gb, snapshot, end, current);
+    }
+
+    if (stop) {
+        reverse_replay(gb, reverse_find_snapshot(reverse, stop), stop, 0);
+        if (gb->breakpoints && should_break(gb, gb->pc, false)) {
+            GB_log(gb, "Breakpoint: PC = %s\n", value_to_string(gb, gb->pc, true));
+        }
+    }
+    else {
+        reverse_replay(gb, reverse->snapshots[0], reverse->snapshots[0]->step, 0);
+        GB_log(gb, "Reached the beginning of the execution history\n");
+    }
+    reverse_adapt_interval(reverse);
+    GB_cpu_disassemble(gb, gb->pc, 5);
+    return true;
+}
+
+static bool record(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command)
+{
+    NO_MODIFIERS
+    const char *argument = lstrip(arguments);
+
+    if (!argument[0]) {
+        if (!gb->reverse_recording) {
+            GB_log(gb, "Execution history is not being recorded.\n");
+        }
+        else if (!gb->reverse) {
+            GB_log(gb, "Execution history is recorded from the next instruction.\n");
+        }
+        else {
+            struct GB_reverse_s *reverse = gb->reverse;
+            size_t size = 0;
+            for (unsigned i = 0; i < reverse->count; i++) {
+                size += sizeof(*reverse->snapshots[i]) + reverse->snapshots[i]->size;
+            }
+            GB_log(gb, "%llu instructions of history in %u snapshots (%zu KiB), one every %llu ticks\n",
+                   (unsigned long long)(gb->debugger_steps - reverse->snapshots[0]->step),
+                   reverse->count, size / 1024, (unsigned long long)reverse->interval);
+        }
+        return true;
+    }
+
+    if (strcmp(argument, "on") == 0) {
+        GB_set_reverse_recording(gb, true);
+        return true;
+    }
+
+    if (strcmp(argument, "off") == 0) {
+        GB_set_reverse_recording(gb, false);
+        return true;
+    }
+
+    print_usage(gb, command);
+    return true;
+}
+
+static bool help(GB_gameboy_t *gb, char *arguments, char *modifiers, const debugger_command_t *command);
+
+#define HELP_NEWLINE "\n             "
+
+/* Commands without implementations are aliases of the previous non-alias commands */
+static const debugger_command_t commands[] = {
+    {"continue", 1, cont, "Continue running until next stop"},
+    {"next", 1, next, "Run the next instruction, skipping over function calls"},
+    {"step", 1, step, "Run the next instruction, stepping into function calls"},
+    {"finish", 1, finish, "Run until the current function returns"},
+    {"undo", 1, undo, "Reverts the last command"},
+    {"reverse-step", 9, reverse_step, "Runs backwards to before the previous instruction"},
+    {"rs", 2, }, /* Alias */
+    {"reverse-continue", 9, reverse_continue, "Runs backwards until the previous breakpoint or watchpoint, or to the" HELP_NEWLINE
+                                              "beginning of the execution history"},
+    {"rc", 2, }, /* Alias */
+    {"record", 3, record, "Starts or stops recording execution history for reverse-step and" HELP_NEWLINE
+                          "reverse-continue, or summarizes the recorded history", "[on|off]",
+                          .argument_completer = on_off_completer},
+    {"backtrace", 2, backtrace, "Displays the current call stack"},
+    {"bt", 2, }, /* Alias */
+    {"sld", 3, stack_leak_detection, "Like finish, but stops if a stack leak is detected"},
+    {"ticks", 2, ticks, "Displays the number of CPU ticks since the last time 'ticks' was" HELP_NEWLINE
+                        "used"},
+    {"timing", 3, timing, "Displays how well emulation is being paced to real time, or resets" HELP_NEWLINE
+                          "the statistics", "[reset]"},
+    {"trace", 2, trace, "Records every executed instruction into a binary trace file, or stops" HELP_NEWLINE
+                        "recording if no file is specified", "[<path>]"},
+    {"profile", 3, profile, "Starts or stops sampling the running code every <period> cycles (1 by" HELP_NEWLINE
+                            "default). Without arguments, lists the hottest functions and" HELP_NEWLINE
+                            "addresses; with a path, saves folded call stacks for flamegraph tools",
+                            "[on [<period>]|off|<path>]", .argument_completer = on_off_completer},
+    {"coverage", 3, coverage, "Enables or disables recording which ROM and RAM bytes are executed," HELP_NEWLINE
+                              "read, written or jumped to, summarizes it, or saves it to or merges" HELP_NEWLINE
+                              "it from a file", "[on|off|save <path>|load <path>]", .argument_completer = on_off_completer},
+    {"heatmap", 3, heatmap, "Enables or disables counting reads and writes of every address," HELP_NEWLINE
+                            "lists the hottest pages and banks, resets the counters, or saves" HELP_NEWLINE
+                            "them as raw counters or as a 256x256 image",
+                            "[on|off|reset|save <path>|image <path>]", .argument_completer = on_off_completer},
+    {"registers", 1, registers, "Print values of processor registers and other important registers"},
+    {"cartridge", 2, mbc, "Displays information about the MBC and cartridge"},
+    {"mbc", 3, }, /* Alias */
+    {"apu", 3, apu, "Displays information about the current state of the audio chip"},
+    {"wave", 3, wave, "Prints a visual representation of the wave RAM." HELP_NEWLINE
+                      "Modifiers can be used for a (f)ull print (the default)," HELP_NEWLINE
+        "a more (c)ompact one, or a one-(l)iner", "", "(f|c|l)", .modifiers_completer = wave_completer},
+    {"lcd", 3, lcd, "Displays information about the current state of the LCD controller"},
+    {"palettes", 3, palettes, "Displays the current CGB palettes"},
+    {"softbreak", 2, softbreak, "Enables or disables software breakpoints", "(on|off)", .argument_completer = on_off_completer},
+    {"breakpoint", 1, breakpoint, "Add a new breakpoint at the specified address/expression" HELP_NEWLINE
+                                  "Can also modify the condition of existing breakpoints." HELP_NEWLINE
+                                  "If the j modifier is used, the breakpoint will occur just before" HELP_NEWLINE
+                                  "jumping to the target.",
+                                  "<expression>[ if <condition expression>]", "j",
+                                  .argument_completer = symbol_completer, .modifiers_completer = j_completer},
+    {"delete", 2, delete, "Delete a breakpoint by its address, or all breakpoints", "[<expression>]", .argument_completer = symbol_completer},
+    {"watch", 1, watch, "Add a new watchpoint at the specified address/expression, or address range." HELP_NEWLINE
+                        "Can also modify the condition, type and range of existing watchpoints." HELP_NEWLINE
+                        "Default watchpoint type is write-only.",
+                        "<expression>[ to <end expression>][ if <condition expression>]", "(r|w|rw)",
+                        .argument_completer = symbol_completer, .modifiers_completer = rw_completer
+    },
+    {"unwatch", 3, unwatch, "Delete a watchpoint by its address, or all watchpoints", "[<expression>]", .argument_completer = symbol_completer},
+    {"list", 1, list, "List all set breakpoints and watchpoints"},
+    {"print", 1, print, "Evaluate and print an expression" HELP_NEWLINE
+                        "Use modifier to format as an address (a, default) or as a number in" HELP_NEWLINE
+                        "decimal (d), hexadecimal (x), octal (o) or binary (b).",
+                        "<expression>", "format", .argument_completer = symbol_completer, .modifiers_completer = format_completer},
+    {"eval", 2, }, /* Alias */
+    {"examine", 2, examine, "Examine values at address", "<expression>", "count", .argument_completer = symbol_completer},
+    {"x", 1, }, /* Alias */
+    {"disassemble", 1, disassemble, "Disassemble instructions at address", "<expression>", "count", .argument_completer = symbol_completer},
+
+
+    {"help", 1, help, "List available commands or show help for the specified command", "[<command>]"},
+    {NULL,}, /* Null terminator */
+};
+
+static const debugger_command_t *find_command(const char *string)
+{
+    size_t length = strlen(string);
+    for (const debugger_command_t *command = commands; command->command; command++) {
+        if (command->min_length > length) continue;
+        if (memcmp(command->command, string, length) == 0) { /* Is a substring? */
+            /* Aliases */
+            while (!command->implementation) {
+                command--;
+            }
+            return command;
+        }
+    }
+
+    return NULL;
+}
+
+static void print_command_shortcut(GB_gameboy_t *gb, const debugger_command_t *command)
+{
+    GB_attributed_log(gb, GB_LOG_BOLD | GB_LOG_UNDERLINE, "%.*s", command->min_length, command->command);
+    GB_attributed_log(gb, GB_LOG_BOLD, "%s", command->command + command->min_length);
+}
+
+static void print_command_description(GB_gameboy_t *gb, const debugger_command_t *command)
 {
     print_command_shortcut(gb, command);
     GB_log(gb, ": ");
@@ -2064,6 +3528,10 @@ void GB_debugger_call_hook(GB_gameboy_t *gb, uint16_t call_addr)
         gb->backtrace_size++;
     }
 
+    if (gb->profile) {
+        gb->profile->current_stack = PROFILE_NO_STACK;
+    }
+
     gb->debug_call_depth++;
 }
 
@@ -2096,31 +3564,29 @@ void GB_debugger_ret_hook(GB_gameboy_t *gb)
             break;
         }
     }
+
+    if (gb->profile) {
+        gb->profile->current_stack = PROFILE_NO_STACK;
+    }
 }
 
 static bool _GB_debugger_test_write_watchpoint(GB_gameboy_t *gb, value_t addr, uint8_t value)
 {
     uint16_t index = find_watchpoint(gb, addr);
-    uint32_t key = WP_KEY(addr);
+    uint16_t bank = addr.has_bank? addr.bank : -1;
 
-    if (index < gb->n_watchpoints && gb->watchpoints[index].key == key) {
-        if (!(gb->watchpoints[index].flags & GB_WATCHPOINT_W)) {
-            return false;
-        }
-        if (!gb->watchpoints[index].condition) {
-            gb->debug_stopped = true;
-            GB_log(gb, "Watchpoint: [%s] = $%02x\n", debugger_value_to_string(gb, addr, true), value);
-            return true;
-        }
-        bool error;
-        bool condition = debugger_evaluate(gb, gb->watchpoints[index].condition,
-                                           (unsigned)strlen(gb->watchpoints[index].condition), &error, &addr.value, &value).value;
-        if (error) {
-            /* Should never happen */
-            GB_log(gb, "An internal error has occured\n");
-            return false;
+    if (index < gb->n_watchpoints && gb->watchpoints[index].key == WP_KEY(addr)) {
+        index++;
+    }
+
+    /* Scan back through this bank's watchpoints that start at or before addr */
+    while (index-- && gb->watchpoints[index].bank == bank && gb->watchpoints[index].max_end >= addr.value) {
+        struct GB_watchpoint_s *watchpoint = &gb->watchpoints[index];
+        if (watchpoint->end < addr.value || !(watchpoint->flags & GB_WATCHPOINT_W)) {
+            continue;
         }
-        if (condition) {
+        if (!watchpoint->condition ||
+            run_expression(gb, &watchpoint->condition->expression, &addr.value, &value).value) {
             gb->debug_stopped = true;
             GB_log(gb, "Watchpoint: [%s] = $%02x\n", debugger_value_to_string(gb, addr, true), value);
             return true;
@@ -2132,6 +3598,7 @@ static bool _GB_debugger_test_write_watchpoint(GB_gameboy_t *gb, value_t addr, u
 void GB_debugger_test_write_watchpoint(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
 {
     if (gb->debug_stopped) return;
+    if (!MAP_TEST(gb->write_watchpoint_map, addr)) return;
 
     /* Try any-bank breakpoint */
     value_t full_addr = (VALUE_16(addr));
@@ -2146,26 +3613,20 @@ void GB_debugger_test_write_watchpoint(GB_gameboy_t *gb, uint16_t addr, uint8_t
 static bool _GB_debugger_test_read_watchpoint(GB_gameboy_t *gb, value_t addr)
 {
     uint16_t index = find_watchpoint(gb, addr);
-    uint32_t key = WP_KEY(addr);
+    uint16_t bank = addr.has_bank? addr.bank : -1;
 
-    if (index < gb->n_watchpoints && gb->watchpoints[index].key == key) {
-        if (!(gb->watchpoints[index].flags & GB_WATCHPOINT_R)) {
-            return false;
-        }
-        if (!gb->watchpoints[index].condition) {
-            gb->debug_stopped = true;
-            GB_log(gb, "Watchpoint: [%s]\n", debugger_value_to_string(gb, addr, true));
-            return true;
-        }
-        bool error;
-        bool condition = debugger_evaluate(gb, gb->watchpoints[index].condition,
-                                           (unsigned)strlen(gb->watchpoints[index].condition), &error, &addr.value, NULL).value;
-        if (error) {
-            /* Should never happen */
-            GB_log(gb, "An internal error has occured\n");
-            return false;
+    if (index < gb->n_watchpoints && gb->watchpoints[index].key == WP_KEY(addr)) {
+        index++;
+    }
+
+    /* Scan back through this bank's watchpoints that start at or before addr */
+    while (index-- && gb->watchpoints[index].bank == bank && gb->watchpoints[index].max_end >= addr.value) {
+        struct GB_watchpoint_s *watchpoint = &gb->watchpoints[index];
+        if (watchpoint->end < addr.value || !(watchpoint->flags & GB_WATCHPOINT_R)) {
+            continue;
         }
-        if (condition) {
+        if (!watchpoint->condition ||
+            run_expression(gb, &watchpoint->condition->expression, &addr.value, NULL).value) {
             gb->debug_stopped = true;
             GB_log(gb, "Watchpoint: [%s]\n", debugger_value_to_string(gb, addr, true));
             return true;
@@ -2177,6 +3638,7 @@ static bool _GB_debugger_test_read_watchpoint(GB_gameboy_t *gb, value_t addr)
 void GB_debugger_test_read_watchpoint(GB_gameboy_t *gb, uint16_t addr)
 {
     if (gb->debug_stopped) return;
+    if (!MAP_TEST(gb->read_watchpoint_map, addr)) return;
 
     /* Try any-bank breakpoint */
     value_t full_addr = (VALUE_16(addr));
@@ -2217,6 +3679,7 @@ bool GB_debugger_execute_command(GB_gameboy_t *gb, char *input)
     if (command) {
         uint8_t *old_state = malloc(GB_get_save_state_size(gb));
         GB_save_state_to_buffer(gb, old_state);
+        bool stopped = gb->debug_stopped;
         bool ret = command->implementation(gb, arguments, modifiers, command);
         if (!ret) { // Command continues, save state in any case
             free(gb->undo_state);
@@ -2231,6 +3694,9 @@ bool GB_debugger_execute_command(GB_gameboy_t *gb, char *input)
                 free(gb->undo_state);
                 gb->undo_state = old_state;
                 gb->undo_label = command->command;
+                if (gb->reverse && command->implementation != reverse_step && command->implementation != reverse_continue) {
+                    reverse_state_modified(gb, stopped);
+                }
             }
             else {
                 // Nothing changed, just free the old state
@@ -2320,6 +3786,12 @@ void GB_debugger_run(GB_gameboy_t *gb)
         GB_save_state_to_buffer(gb, gb->undo_state);
     }
 
+    gb->debugger_steps++;
+    if (gb->reverse_recording && !gb->reverse) {
+        reverse_start(gb);
+    }
+    if (gb->reverse && reverse_run(gb)) return;
+
     char *input = NULL;
     if (gb->debug_next_command && gb->debug_call_depth <= 0 && !gb->halted) {
         gb->debug_stopped = true;
@@ -2353,8 +3825,11 @@ next_command:
                 gb->non_trivial_jump_breakpoint_occured = true;
                 GB_log(gb, "Jumping to breakpoint: PC = %s\n", value_to_string(gb, gb->pc, true));
                 GB_cpu_disassemble(gb, gb->pc, 5);
-                GB_load_state_from_buffer(gb, gb->nontrivial_jump_state, -1);
+                load_state_keeping_history(gb, gb->nontrivial_jump_state, -1);
                 gb->debug_stopped = true;
+                if (gb->reverse) {
+                    reverse_state_modified(gb, true);
+                }
             }
         }
         else if (jump_to_result == JUMP_TO_BREAK) {
@@ -2413,6 +3888,30 @@ void GB_debugger_handle_async_commands(GB_gameboy_t *gb)
     }
 }
 
+/* Symbol names and reversed map nodes are allocated from arenas that are freed together when clearing symbols */
+struct GB_symbol_arena_s {
+    struct GB_symbol_arena_s *next;
+    size_t size, used;
+    char data[];
+};
+
+static void *symbol_arena_alloc(GB_gameboy_t *gb, size_t size)
+{
+    size = (size + 7) & ~7;
+    struct GB_symbol_arena_s *arena = gb->symbol_arenas;
+    if (!arena || arena->size - arena->used < size) {
+        size_t arena_size = size > 0x1000? size : 0x1000;
+        arena = malloc(sizeof(*arena) + arena_size);
+        arena->size = arena_size;
+        arena->used = 0;
+        arena->next = gb->symbol_arenas;
+        gb->symbol_arenas = arena;
+    }
+    void *ret = arena->data + arena->used;
+    arena->used += size;
+    return ret;
+}
+
 void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, const char *symbol)
 {
     bank &= 0x1FF;
@@ -2420,39 +3919,135 @@ void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, c
     if (!gb->bank_symbols[bank]) {
         gb->bank_symbols[bank] = GB_map_alloc();
     }
-    GB_bank_symbol_t *allocated_symbol = GB_map_add_symbol(gb->bank_symbols[bank], address, symbol);
+    size_t length = strlen(symbol) + 1;
+    char *name = memcpy(symbol_arena_alloc(gb, length), symbol, length);
+    GB_bank_symbol_t *allocated_symbol = GB_map_add_symbol(gb->bank_symbols[bank], address, name);
     if (allocated_symbol) {
-        GB_reversed_map_add_symbol(&gb->reversed_symbol_map, bank, allocated_symbol);
+        GB_symbol_t *reversed = symbol_arena_alloc(gb, sizeof(*reversed));
+        reversed->name = name;
+        reversed->addr = address;
+        reversed->bank = bank;
+        GB_reversed_map_add_symbol(&gb->reversed_symbol_map, reversed);
+    }
+}
+
+typedef struct {
+    uint16_t bank;
+    uint16_t addr;
+    char *name;
+} loaded_symbol_t;
+
+static bool is_symbol_file_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static signed hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* Parses a hex number the way sscanf's %x does */
+static bool parse_symbol_file_hex(char **position, char *end, unsigned *value)
+{
+    char *c = *position;
+    while (c < end && is_symbol_file_space(*c)) c++;
+    if (end - c > 2 && c[0] == '0' && (c[1] == 'x' || c[1] == 'X') && hex_digit_value(c[2]) >= 0) {
+        c += 2;
+    }
+    if (c == end || hex_digit_value(*c) < 0) return false;
+
+    *value = 0;
+    signed digit;
+    while (c < end && (digit = hex_digit_value(*c)) >= 0) {
+        *value = *value << 4 | digit;
+        c++;
     }
+    *position = c;
+    return true;
 }
 
 void GB_debugger_load_symbol_file(GB_gameboy_t *gb, const char *path)
 {
-    FILE *f = fopen(path, "r");
+    FILE *f = fopen(path, "rb");
     if (!f) return;
 
-    char *line = NULL;
-    size_t size = 0;
-    size_t length = 0;
-    while ((length = getline(&line, &size, f)) != -1) {
-        for (unsigned i = 0; i < length; i++) {
-            if (line[i] == ';' || line[i] == '\n' || line[i] == '\r') {
-                line[i] = 0;
-                length = i;
-                break;
-            }
-        }
-        if (length == 0) continue;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(f);
+        return;
+    }
+
+    /* The file is read into an arena once, and names are terminated in place */
+    char *file = symbol_arena_alloc(gb, size + 1);
+    size = fread(file, 1, size, f);
+    fclose(f);
+    file[size] = 0;
+
+    size_t n_symbols = 0, allocated = 0x100;
+    loaded_symbol_t *symbols = malloc(allocated * sizeof(symbols[0]));
+    for (char *line = file, *file_end = file + size, *next_line; line < file_end; line = next_line) {
+        next_line = memchr(line, '\n', file_end - line);
+        next_line = next_line? next_line + 1 : file_end;
+
+        char *end = line;
+        while (end < next_line && *end != ';' && *end != '\n' && *end != '\r') end++;
 
         unsigned bank, address;
-        char symbol[length];
+        char *c = line;
+        if (!parse_symbol_file_hex(&c, end, &bank) || c == end || *(c++) != ':') continue;
+        if (!parse_symbol_file_hex(&c, end, &address)) continue;
+        while (c < end && is_symbol_file_space(*c)) c++;
+        if (c == end) continue;
+
+        char *name = c;
+        while (c < end && !is_symbol_file_space(*c)) c++;
+        *c = 0;
+
+        if (n_symbols == allocated) {
+            allocated *= 2;
+            symbols = realloc(symbols, allocated * sizeof(symbols[0]));
+        }
+        symbols[n_symbols++] = (loaded_symbol_t){bank & 0x1FF, address, name};
+    }
+
+    /* Reversed map entries are added in file order, so later symbols take precedence like with GB_debugger_add_symbol */
+    GB_symbol_t *reversed = symbol_arena_alloc(gb, n_symbols * sizeof(reversed[0]));
+    for (size_t i = 0; i < n_symbols; i++) {
+        reversed[i].name = symbols[i].name;
+        reversed[i].addr = symbols[i].addr;
+        reversed[i].bank = symbols[i].bank;
+        GB_reversed_map_add_symbol(&gb->reversed_symbol_map, &reversed[i]);
+    }
 
-        if (sscanf(line, "%x:%x %s", &bank, &address, symbol) == 3) {
-            GB_debugger_add_symbol(gb, bank, address, symbol);
+    /* Counting sort by bank, so every map receives its symbols in file order */
+    size_t bank_offsets[0x201] = {0,};
+    for (size_t i = 0; i < n_symbols; i++) {
+        bank_offsets[symbols[i].bank + 1]++;
+    }
+    for (unsigned bank = 0; bank < 0x200; bank++) {
+        bank_offsets[bank + 1] += bank_offsets[bank];
+    }
+    GB_bank_symbol_t *bank_symbols = malloc(n_symbols * sizeof(bank_symbols[0]));
+    for (size_t i = 0; i < n_symbols; i++) {
+        bank_symbols[bank_offsets[symbols[i].bank]++] = (GB_bank_symbol_t){symbols[i].name, symbols[i].addr};
+    }
+    /* Every offset now points to the end of its bank, which is where the next bank starts */
+    for (unsigned bank = 0, start = 0; bank < 0x200; start = bank_offsets[bank++]) {
+        if (bank_offsets[bank] == start) continue;
+        if (!gb->bank_symbols[bank]) {
+            gb->bank_symbols[bank] = GB_map_alloc();
         }
+        GB_map_add_symbols(gb->bank_symbols[bank], bank_symbols + start, bank_offsets[bank] - start);
     }
-    free(line);
-    fclose(f);
+
+    free(bank_symbols);
+    free(symbols);
 }
 
 void GB_debugger_clear_symbols(GB_gameboy_t *gb)
@@ -2463,12 +4058,11 @@ void GB_debugger_clear_symbols(GB_gameboy_t *gb)
             gb->bank_symbols[i] = 0;
         }
     }
-    for (unsigned i = sizeof(gb->reversed_symbol_map.buckets) / sizeof(gb->reversed_symbol_map.buckets[0]); i--;) {
-        while (gb->reversed_symbol_map.buckets[i]) {
-            GB_symbol_t *next = gb->reversed_symbol_map.buckets[i]->next;
-            free(gb->reversed_symbol_map.buckets[i]);
-            gb->reversed_symbol_map.buckets[i] = next;
-        }
+    memset(&gb->reversed_symbol_map, 0, sizeof(gb->reversed_symbol_map));
+    while (gb->symbol_arenas) {
+        struct GB_symbol_arena_s *next = gb->symbol_arenas->next;
+        free(gb->symbol_arenas);
+        gb->symbol_arenas = next;
     }
 }
 
@@ -2509,6 +4103,478 @@ void GB_debugger_break(GB_gameboy_t *gb)
     gb->debug_stopped = true;
 }
 
+void GB_set_trace_buffer(GB_gameboy_t *gb, GB_trace_record_t *buffer, size_t size, GB_trace_callback_t callback)
+{
+    if (gb->trace_file) {
+        /* Tracing was started by the trace command, which owns the buffer and file. If the final
+           flush fails, the callback already closed them. */
+        GB_flush_trace(gb);
+        if (gb->trace_file) {
+            close_trace_file(gb);
+        }
+    }
+    gb->trace_buffer = size? buffer : NULL;
+    gb->trace_size = size;
+    gb->trace_position = 0;
+    gb->trace_wrapped = false;
+    gb->trace_callback = callback;
+}
+
+void GB_flush_trace(GB_gameboy_t *gb)
+{
+    if (gb->trace_callback && gb->trace_position) {
+        gb->trace_callback(gb, gb->trace_buffer, gb->trace_position);
+        gb->trace_position = 0;
+    }
+}
+
+size_t GB_get_trace_records(GB_gameboy_t *gb, GB_trace_record_t *records, size_t count)
+{
+    /* Flushes restart the buffer mid-way, so its contents are only ordered as a ring without a callback */
+    if (gb->trace_callback) return 0;
+    size_t available = gb->trace_wrapped? gb->trace_size : gb->trace_position;
+    if (count > available) {
+        count = available;
+    }
+    /* The newest count records end at trace_position, possibly wrapping around */
+    size_t tail = count < gb->trace_position? count : gb->trace_position;
+    size_t head = count - tail;
+    memcpy(records, gb->trace_buffer + gb->trace_size - head, head * sizeof(records[0]));
+    memcpy(records + head, gb->trace_buffer + gb->trace_position - tail, tail * sizeof(records[0]));
+    return count;
+}
+
+void GB_debugger_trace_instruction(GB_gameboy_t *gb, uint16_t pc, uint8_t opcode)
+{
+    GB_trace_record_t *record = &gb->trace_buffer[gb->trace_position];
+    record->cycle = gb->debugger_ticks;
+    record->bank = bank_for_addr(gb, pc);
+    record->pc = pc;
+    record->af = gb->registers[GB_REGISTER_AF];
+    record->bc = gb->registers[GB_REGISTER_BC];
+    record->de = gb->registers[GB_REGISTER_DE];
+    record->hl = gb->registers[GB_REGISTER_HL];
+    record->sp = gb->registers[GB_REGISTER_SP];
+    record->opcode = opcode;
+    record->padding = 0;
+
+    if (++gb->trace_position == gb->trace_size) {
+        gb->trace_wrapped = true;
+        if (gb->trace_callback) {
+            gb->trace_callback(gb, gb->trace_buffer, gb->trace_size);
+        }
+        gb->trace_position = 0;
+    }
+}
+
+/* Charges the cycles since the last sample, including halts and interrupt dispatches, to it */
+static void profile_charge_sample(GB_gameboy_t *gb, struct GB_profile_s *profile)
+{
+    if (profile->sample_stack != PROFILE_NO_STACK) {
+        profile_entry(profile, profile->sample_stack, profile->sample_key)->cycles += gb->debugger_ticks - profile->last_sample;
+    }
+    profile->last_sample = gb->debugger_ticks;
+}
+
+void GB_debugger_profile_sample(GB_gameboy_t *gb, uint16_t pc)
+{
+    struct GB_profile_s *profile = gb->profile;
+    if (profile->current_stack == PROFILE_NO_STACK) {
+        profile->current_stack = profile_intern_stack(gb, profile);
+    }
+
+    profile_charge_sample(gb, profile);
+    profile->sample_stack = profile->current_stack;
+    profile->sample_key = bank_for_addr(gb, pc) << 16 | pc;
+    gb->profile_next_sample = gb->debugger_ticks + profile->period;
+}
+
+void GB_start_profiling(GB_gameboy_t *gb, unsigned sample_period)
+{
+    GB_clear_profile(gb);
+
+    struct GB_profile_s *profile = calloc(1, sizeof(*profile));
+    profile->period = sample_period? sample_period : 1;
+    profile->last_sample = gb->debugger_ticks;
+    profile->current_stack = PROFILE_NO_STACK;
+    profile->sample_stack = PROFILE_NO_STACK;
+    profile->entries_mask = 0xFFF;
+    profile->entries = malloc(0x1000 * sizeof(profile->entries[0]));
+    memset(profile->entries, 0xFF, 0x1000 * sizeof(profile->entries[0]));
+    profile->stack_slots_mask = 0xFF;
+    profile->stack_slots = malloc(0x100 * sizeof(profile->stack_slots[0]));
+    memset(profile->stack_slots, 0xFF, 0x100 * sizeof(profile->stack_slots[0]));
+    profile->stacks = malloc(0x80 * sizeof(profile->stacks[0]));
+    /* Allocated up front so empty stacks never copy into or compare against a NULL array */
+    profile->frames_allocation = 0x400;
+    profile->frames = malloc(0x400 * sizeof(profile->frames[0]));
+
+    gb->profile = profile;
+    gb->profile_next_sample = gb->debugger_ticks;
+}
+
+void GB_stop_profiling(GB_gameboy_t *gb)
+{
+    if (gb->profile && gb->profile_next_sample != UINT64_MAX) {
+        profile_charge_sample(gb, gb->profile);
+        gb->profile->sample_stack = PROFILE_NO_STACK;
+    }
+    gb->profile_next_sample = UINT64_MAX;
+}
+
+bool GB_is_profiling(GB_gameboy_t *gb)
+{
+    return gb->profile && gb->profile_next_sample != UINT64_MAX;
+}
+
+void GB_clear_profile(GB_gameboy_t *gb)
+{
+    struct GB_profile_s *profile = gb->profile;
+    if (!profile) return;
+
+    free(profile->entries);
+    free(profile->stacks);
+    free(profile->stack_slots);
+    free(profile->frames);
+    free(profile);
+    gb->profile = NULL;
+    gb->profile_next_sample = UINT64_MAX;
+}
+
+int GB_save_profile(GB_gameboy_t *gb, const char *path)
+{
+    const struct GB_profile_s *profile = gb->profile;
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return errno;
+    }
+    if (!profile) {
+        fclose(f);
+        return 0;
+    }
+
+    /* Entries of different PCs in the same function fold into the same line */
+    profile_line_t *lines = malloc(profile->n_entries * sizeof(lines[0]));
+    size_t count = 0;
+    for (size_t i = 0; i <= profile->entries_mask; i++) {
+        const profile_entry_t *entry = &profile->entries[i];
+        if (entry->stack == PROFILE_NO_STACK || !entry->cycles) continue;
+
+        const profile_stack_t *stack = &profile->stacks[entry->stack];
+        const uint32_t *frames = profile->frames + stack->frames;
+        size_t length = profile_function_name(gb, entry->key, NULL) + 1;
+        for (unsigned j = 0; j < stack->depth; j++) {
+            length += profile_function_name(gb, frames[j], NULL) + 1;
+        }
+
+        char *line = malloc(length);
+        char *position = line;
+        for (unsigned j = 0; j < stack->depth; j++) {
+            position += profile_function_name(gb, frames[j], position);
+            *(position++) = ';';
+        }
+        position += profile_function_name(gb, entry->key, position);
+        *position = 0;
+
+        lines[count++] = (profile_line_t){line, entry->cycles};
+    }
+
+    qsort(lines, count, sizeof(lines[0]), profile_line_compare);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t cycles = lines[i].cycles;
+        while (i + 1 < count && strcmp(lines[i].stack, lines[i + 1].stack) == 0) {
+            free(lines[i].stack);
+            cycles += lines[++i].cycles;
+        }
+        fprintf(f, "%s %llu\n", lines[i].stack, (unsigned long long)cycles);
+        free(lines[i].stack);
+    }
+    free(lines);
+
+    int error = ferror(f)? EIO : 0;
+    if (fclose(f) != 0 && !error) {
+        error = errno;
+    }
+    return error;
+}
+
+void GB_debugger_coverage_fetch(GB_gameboy_t *gb, uint16_t pc)
+{
+    struct GB_coverage_s *coverage = gb->coverage;
+    if (pc != coverage->next_instruction) {
+        uint8_t *flags = coverage_flags(gb, pc);
+        if (flags) {
+            *flags |= GB_COVERAGE_JUMP_TARGET;
+        }
+    }
+    coverage->instruction = pc;
+    coverage->fetching = true;
+}
+
+void GB_debugger_coverage_read(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
+{
+    struct GB_coverage_s *coverage = gb->coverage;
+    if (coverage->fetching) {
+        /* Operands are marked as executed even if they are never read, like STOP's */
+        coverage->fetching = false;
+        coverage->instruction_length = instruction_lengths[value];
+        /* The HALT bug runs the instruction with PC one byte behind */
+        coverage->next_instruction = addr + coverage->instruction_length - gb->halt_bug;
+        for (unsigned i = 0; i < coverage->instruction_length; i++) {
+            uint8_t *flags = coverage_flags(gb, addr + i);
+            if (flags) {
+                *flags |= GB_COVERAGE_EXECUTED;
+            }
+        }
+        return;
+    }
+
+    if ((uint16_t)(addr - coverage->instruction) < coverage->instruction_length) return; /* Operand fetch */
+
+    uint8_t *flags = coverage_flags(gb, addr);
+    if (flags) {
+        *flags |= GB_COVERAGE_READ;
+    }
+}
+
+void GB_debugger_coverage_write(GB_gameboy_t *gb, uint16_t addr)
+{
+    if (addr < 0x8000) return; /* MBC registers */
+
+    uint8_t *flags = coverage_flags(gb, addr);
+    if (flags) {
+        *flags |= GB_COVERAGE_WRITTEN;
+    }
+}
+
+void GB_set_coverage_enabled(GB_gameboy_t *gb, bool enabled)
+{
+    if (!enabled) {
+        free(gb->coverage);
+        gb->coverage = NULL;
+        return;
+    }
+    if (gb->coverage) return;
+
+    size_t rom_size = gb->rom_size, cart_ram_size = gb->mbc_ram_size, ram_size = gb->ram_size;
+    struct GB_coverage_s *coverage = calloc(1, sizeof(*coverage) + rom_size + cart_ram_size + ram_size + 0x7F);
+    coverage->rom_size = rom_size;
+    coverage->cart_ram_size = cart_ram_size;
+    coverage->ram_size = ram_size;
+    coverage->next_instruction = gb->pc;
+    gb->coverage = coverage;
+}
+
+void GB_debugger_coverage_restart(GB_gameboy_t *gb)
+{
+    if (!gb->coverage) return;
+    GB_set_coverage_enabled(gb, false);
+    GB_set_coverage_enabled(gb, true);
+}
+
+bool GB_is_coverage_enabled(GB_gameboy_t *gb)
+{
+    return gb->coverage;
+}
+
+uint8_t *GB_get_coverage(GB_gameboy_t *gb, size_t *size)
+{
+    struct GB_coverage_s *coverage = gb->coverage;
+    if (!coverage) {
+        *size = 0;
+        return NULL;
+    }
+    *size = coverage->rom_size + coverage->cart_ram_size + coverage->ram_size + 0x7F;
+    return coverage->flags;
+}
+
+static void coverage_file_header(GB_gameboy_t *gb, GB_coverage_file_header_t *header, size_t size)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, "SBCV", 4);
+    header->version = GB_COVERAGE_FILE_VERSION;
+    if (gb->rom_size >= 0x150) {
+        header->global_checksum = gb->rom[0x14E] << 8 | gb->rom[0x14F];
+    }
+    header->model = gb->model;
+    header->size = size;
+}
+
+int GB_save_coverage(GB_gameboy_t *gb, const char *path)
+{
+    size_t size;
+    const uint8_t *flags = GB_get_coverage(gb, &size);
+    if (!flags) return EINVAL;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return errno;
+    }
+    GB_coverage_file_header_t header;
+    coverage_file_header(gb, &header, size);
+    if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(flags, 1, size, f) != size) {
+        fclose(f);
+        return EIO;
+    }
+    if (fclose(f) != 0) {
+        return errno;
+    }
+    return 0;
+}
+
+int GB_load_coverage(GB_gameboy_t *gb, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return errno;
+    }
+
+    bool was_enabled = gb->coverage;
+    GB_set_coverage_enabled(gb, true);
+    size_t size;
+    uint8_t *flags = GB_get_coverage(gb, &size);
+    GB_coverage_file_header_t header, expected;
+    coverage_file_header(gb, &expected, size);
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(&header, &expected, sizeof(header)) != 0) {
+        fclose(f);
+        GB_set_coverage_enabled(gb, was_enabled);
+        return EINVAL;
+    }
+
+    uint8_t buffer[0x1000];
+    for (size_t offset = 0; offset < size;) {
+        size_t count = fread(buffer, 1, sizeof(buffer), f);
+        if (!count) {
+            fclose(f);
+            GB_set_coverage_enabled(gb, was_enabled);
+            return EIO;
+        }
+        for (size_t i = 0; i < count; i++) {
+            flags[offset + i] |= buffer[i];
+        }
+        offset += count;
+    }
+    fclose(f);
+    return 0;
+}
+
+GB_heatmap_t *GB_debugger_heatmap_suspend(GB_gameboy_t *gb)
+{
+    GB_heatmap_t *heatmap = gb->heatmap;
+    gb->heatmap = NULL;
+    return heatmap;
+}
+
+void GB_debugger_heatmap_resume(GB_gameboy_t *gb, GB_heatmap_t *saved)
+{
+    gb->heatmap = saved;
+}
+
+void GB_debugger_heatmap_read(GB_gameboy_t *gb, uint16_t addr)
+{
+    GB_heatmap_t *heatmap = gb->heatmap;
+    heatmap->reads[addr]++;
+    if (addr < 0x8000) {
+        heatmap->rom_bank_reads[(addr < 0x4000? gb->mbc_rom0_bank : gb->mbc_rom_bank) & 0x1FF]++;
+    }
+    else if (addr >= 0xA000 && addr < 0xC000) {
+        heatmap->cart_ram_bank_reads[gb->mbc_ram_bank]++;
+    }
+}
+
+void GB_debugger_heatmap_write(GB_gameboy_t *gb, uint16_t addr)
+{
+    GB_heatmap_t *heatmap = gb->heatmap;
+    heatmap->writes[addr]++;
+    if (addr >= 0xA000 && addr < 0xC000) {
+        heatmap->cart_ram_bank_writes[gb->mbc_ram_bank]++;
+    }
+}
+
+void GB_debugger_heatmap_vblank(GB_gameboy_t *gb)
+{
+    if (++gb->heatmap_frames < gb->heatmap_interval) return;
+    gb->heatmap_frames = 0;
+    if (gb->heatmap_callback) {
+        gb->heatmap_callback(gb, gb->heatmap);
+    }
+    GB_reset_heatmap(gb);
+}
+
+void GB_set_heatmap_enabled(GB_gameboy_t *gb, bool enabled)
+{
+    if (!enabled) {
+        free(gb->heatmap);
+        gb->heatmap = NULL;
+        return;
+    }
+    if (!gb->heatmap) {
+        gb->heatmap = calloc(1, sizeof(*gb->heatmap));
+        gb->heatmap_frames = 0;
+    }
+}
+
+const GB_heatmap_t *GB_get_heatmap(GB_gameboy_t *gb)
+{
+    return gb->heatmap;
+}
+
+void GB_reset_heatmap(GB_gameboy_t *gb)
+{
+    if (gb->heatmap) {
+        memset(gb->heatmap, 0, sizeof(*gb->heatmap));
+    }
+}
+
+void GB_set_heatmap_callback(GB_gameboy_t *gb, GB_heatmap_callback_t callback, unsigned frames)
+{
+    gb->heatmap_callback = callback;
+    gb->heatmap_interval = frames;
+    gb->heatmap_frames = 0;
+}
+
+int GB_save_heatmap(GB_gameboy_t *gb, const char *path, GB_heatmap_format_t format)
+{
+    const GB_heatmap_t *heatmap = gb->heatmap;
+    if (!heatmap) return EINVAL;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return errno;
+    }
+
+    if (format == GB_HEATMAP_FORMAT_BINARY) {
+        fwrite(heatmap, sizeof(*heatmap), 1, f);
+    }
+    else {
+        /* Reads are green and writes are red, both on a logarithmic scale relative to the hottest address */
+        uint32_t max_reads = 0, max_writes = 0;
+        for (unsigned i = 0; i < 0x10000; i++) {
+            if (heatmap->reads[i] > max_reads) max_reads = heatmap->reads[i];
+            if (heatmap->writes[i] > max_writes) max_writes = heatmap->writes[i];
+        }
+        double read_scale = max_reads? 255 / log1p(max_reads) : 0;
+        double write_scale = max_writes? 255 / log1p(max_writes) : 0;
+
+        fprintf(f, "P6\n256 256\n255\n");
+        uint8_t row[0x100 * 3];
+        for (unsigned y = 0; y < 0x100; y++) {
+            for (unsigned x = 0; x < 0x100; x++) {
+                row[x * 3] = log1p(heatmap->writes[y << 8 | x]) * write_scale;
+                row[x * 3 + 1] = log1p(heatmap->reads[y << 8 | x]) * read_scale;
+                row[x * 3 + 2] = 0;
+            }
+            fwrite(row, sizeof(row), 1, f);
+        }
+    }
+
+    int error = ferror(f)? EIO : 0;
+    if (fclose(f) != 0 && !error) {
+        error = errno;
+    }
+    return error;
+}
+
 bool GB_debugger_is_stopped(GB_gameboy_t *gb)
 {
     return gb->debug_stopped;
@@ -2517,6 +4583,9 @@ bool GB_debugger_is_stopped(GB_gameboy_t *gb)
 void GB_debugger_set_disabled(GB_gameboy_t *gb, bool disabled)
 {
     gb->debug_disable = disabled;
+    if (disabled) {
+        GB_debugger_reverse_discard(gb);
+    }
 }
 
 /* Jump-to breakpoints */
@@ -2693,11 +4762,13 @@ static jump_to_return_t test_jump_to_breakpoints(GB_gameboy_t *gb, uint16_t *add
 
     uint16_t n_watchpoints = gb->n_watchpoints;
     gb->n_watchpoints = 0;
+    GB_heatmap_t *heatmap = GB_debugger_heatmap_suspend(gb);
 
     uint8_t opcode = GB_read_memory(gb, gb->pc);
 
     if (opcode == 0x76) {
         gb->n_watchpoints = n_watchpoints;
+        GB_debugger_heatmap_resume(gb, heatmap);
         if (gb->ime) { /* Already handled in above */
             return JUMP_TO_NONE;
         }
@@ -2712,12 +4783,14 @@ static jump_to_return_t test_jump_to_breakpoints(GB_gameboy_t *gb, uint16_t *add
     GB_opcode_address_getter_t *getter = opcodes[opcode];
     if (!getter) {
         gb->n_watchpoints = n_watchpoints;
+        GB_debugger_heatmap_resume(gb, heatmap);
         return JUMP_TO_NONE;
     }
 
     uint16_t new_pc = getter(gb, opcode);
 
     gb->n_watchpoints = n_watchpoints;
+    GB_debugger_heatmap_resume(gb, heatmap);
 
     if (address) {
         *address = new_pc;
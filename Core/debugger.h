@@ -2,9 +2,63 @@
 #define debugger_h
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "gb_struct_def.h"
 #include "symbol_hash.h"
 
+/* One executed instruction, with the registers as they were before executing it */
+typedef struct {
+    uint64_t cycle;
+    uint16_t bank;
+    uint16_t pc;
+    uint16_t af, bc, de, hl, sp;
+    uint8_t opcode;
+    uint8_t padding;
+} GB_trace_record_t;
+
+/* Trace files written by the trace command are this header followed by records, in host byte order */
+#define GB_TRACE_FILE_VERSION 1
+typedef struct {
+    char magic[4]; /* "SBTR" */
+    uint16_t version;
+    uint16_t record_size;
+} GB_trace_file_header_t;
+
+typedef enum {
+    GB_COVERAGE_EXECUTED = 1,
+    GB_COVERAGE_READ = 2,
+    GB_COVERAGE_WRITTEN = 4,
+    GB_COVERAGE_JUMP_TARGET = 8,
+} GB_coverage_flags_t;
+
+/* Coverage files are this header followed by the coverage, in host byte order */
+#define GB_COVERAGE_FILE_VERSION 1
+typedef struct {
+    char magic[4]; /* "SBCV" */
+    uint16_t version;
+    uint16_t global_checksum; /* Of the ROM, as stored at $14E-$14F */
+    uint32_t model; /* GB_model_t */
+    uint32_t size; /* Of the coverage that follows */
+} GB_coverage_file_header_t;
+
+typedef void (*GB_trace_callback_t)(GB_gameboy_t *gb, const GB_trace_record_t *records, size_t count);
+
+/* Memory accesses by address, matrices are indexed by address, i.e. [high byte][low byte] */
+typedef struct {
+    uint32_t reads[0x10000];
+    uint32_t writes[0x10000];
+    uint32_t rom_bank_reads[0x200];
+    uint32_t cart_ram_bank_reads[0x100];
+    uint32_t cart_ram_bank_writes[0x100];
+} GB_heatmap_t;
+
+typedef enum {
+    GB_HEATMAP_FORMAT_BINARY, /* GB_heatmap_t as is, in host byte order */
+    GB_HEATMAP_FORMAT_IMAGE, /* 256x256 binary PPM, writes in red and reads in green */
+} GB_heatmap_format_t;
+
+typedef void (*GB_heatmap_callback_t)(GB_gameboy_t *gb, const GB_heatmap_t *heatmap);
+
 
 #ifdef GB_INTERNAL
 #ifdef GB_DISABLE_DEBUGGER
@@ -15,6 +69,21 @@
 #define GB_debugger_test_write_watchpoint(gb, addr, value) ((void)addr, (void)value)
 #define GB_debugger_test_read_watchpoint(gb, addr) (void)addr
 #define GB_debugger_add_symbol(gb, bank, address, symbol) ((void)bank, (void)address, (void)symbol)
+#define GB_debugger_trace_instruction(gb, pc, opcode) ((void)(pc), (void)(opcode))
+#define GB_debugger_profile_sample(gb, pc) (void)(pc)
+#define GB_debugger_coverage_fetch(gb, pc) (void)(pc)
+#define GB_debugger_coverage_read(gb, addr, value) ((void)(addr), (void)(value))
+#define GB_debugger_coverage_write(gb, addr) (void)(addr)
+#define GB_debugger_coverage_restart(gb) (void)0
+#define GB_debugger_heatmap_read(gb, addr) (void)(addr)
+#define GB_debugger_heatmap_write(gb, addr) (void)(addr)
+#define GB_debugger_heatmap_vblank(gb) (void)0
+#define GB_debugger_heatmap_suspend(gb) NULL
+#define GB_debugger_heatmap_resume(gb, saved) (void)(saved)
+#define GB_debugger_reverse_discard(gb) (void)0
+#define GB_debugger_is_replaying(gb) false
+#define GB_debugger_replay_input(gb, data, size) ((void)(data), (void)(size), false)
+#define GB_debugger_record_input(gb, data, size) ((void)(data), (void)(size))
 
 #else
 void GB_debugger_run(GB_gameboy_t *gb);
@@ -25,6 +94,23 @@ void GB_debugger_test_write_watchpoint(GB_gameboy_t *gb, uint16_t addr, uint8_t
 void GB_debugger_test_read_watchpoint(GB_gameboy_t *gb, uint16_t addr);
 const GB_bank_symbol_t *GB_debugger_find_symbol(GB_gameboy_t *gb, uint16_t addr);
 void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, const char *symbol);
+void GB_debugger_trace_instruction(GB_gameboy_t *gb, uint16_t pc, uint8_t opcode);
+void GB_debugger_profile_sample(GB_gameboy_t *gb, uint16_t pc);
+void GB_debugger_coverage_fetch(GB_gameboy_t *gb, uint16_t pc);
+void GB_debugger_coverage_read(GB_gameboy_t *gb, uint16_t addr, uint8_t value);
+void GB_debugger_coverage_write(GB_gameboy_t *gb, uint16_t addr);
+void GB_debugger_coverage_restart(GB_gameboy_t *gb); /* The ROM or model changed, so the coverage no longer applies */
+void GB_debugger_heatmap_read(GB_gameboy_t *gb, uint16_t addr);
+void GB_debugger_heatmap_write(GB_gameboy_t *gb, uint16_t addr);
+void GB_debugger_heatmap_vblank(GB_gameboy_t *gb);
+/* Accesses the debugger makes between these are not counted, resuming takes what suspending returned */
+GB_heatmap_t *GB_debugger_heatmap_suspend(GB_gameboy_t *gb);
+void GB_debugger_heatmap_resume(GB_gameboy_t *gb, GB_heatmap_t *saved);
+void GB_debugger_reverse_discard(GB_gameboy_t *gb); /* The execution history no longer leads to the current state */
+bool GB_debugger_is_replaying(GB_gameboy_t *gb); /* Output-only frontend callbacks must not run while history is replayed */
+/* Values from input callbacks are recorded into the history, and replays take them from there instead */
+bool GB_debugger_replay_input(GB_gameboy_t *gb, void *data, size_t size);
+void GB_debugger_record_input(GB_gameboy_t *gb, const void *data, size_t size);
 #endif /* GB_DISABLE_DEBUGGER */
 #endif
 
@@ -43,4 +129,48 @@ void GB_debugger_break(GB_gameboy_t *gb);
 bool GB_debugger_is_stopped(GB_gameboy_t *gb);
 void GB_debugger_set_disabled(GB_gameboy_t *gb, bool disabled);
 void GB_debugger_clear_symbols(GB_gameboy_t *gb);
+
+/* Records every executed instruction into buffer. When the buffer fills, it is passed to callback and
+   recording restarts from its beginning. Without a callback, the buffer is a ring holding the most
+   recent size instructions. A NULL buffer stops tracing.
+   The callback runs synchronously on the emulation thread, and the core starts no writer thread of its
+   own; the debugger's trace command writes each chunk with fwrite from it. Frontends that need a
+   background writer should copy the records out and queue them to their own thread. */
+void GB_set_trace_buffer(GB_gameboy_t *gb, GB_trace_record_t *buffer, size_t size, GB_trace_callback_t callback);
+void GB_flush_trace(GB_gameboy_t *gb); /* Passes the partially filled buffer to the callback */
+/* The most recent records, oldest first. Returns 0 while a callback is set, records are then only passed to it. */
+size_t GB_get_trace_records(GB_gameboy_t *gb, GB_trace_record_t *records, size_t count);
+
+/* Samples the executing address and call stack every sample_period cycles, attributing the cycles until the
+   next sample to it. Starting discards the previous profile, stopping keeps it until it is cleared. */
+void GB_start_profiling(GB_gameboy_t *gb, unsigned sample_period);
+void GB_stop_profiling(GB_gameboy_t *gb);
+bool GB_is_profiling(GB_gameboy_t *gb);
+void GB_clear_profile(GB_gameboy_t *gb);
+int GB_save_profile(GB_gameboy_t *gb, const char *path); /* Folded call stacks for flamegraph tools, returns errno on failure */
+
+/* Records GB_coverage_flags_t for every byte of ROM, cartridge RAM, WRAM and HRAM, laid out in that order
+   with the sizes GB_get_direct_access reports. Loading a coverage file merges it into the current coverage,
+   so a file can accumulate coverage across runs of the same ROM and model. */
+void GB_set_coverage_enabled(GB_gameboy_t *gb, bool enabled); /* Disabling discards the coverage */
+bool GB_is_coverage_enabled(GB_gameboy_t *gb);
+uint8_t *GB_get_coverage(GB_gameboy_t *gb, size_t *size);
+int GB_save_coverage(GB_gameboy_t *gb, const char *path); /* Returns errno on failure, EINVAL if coverage is disabled */
+/* Returns errno on failure, EINVAL if the file is not a coverage file of the current ROM and model. Enables coverage
+   if needed, unless loading fails. */
+int GB_load_coverage(GB_gameboy_t *gb, const char *path);
+
+/* Records execution history for the reverse-step and reverse-continue commands, by snapshotting the state
+   periodically and logging joypad changes and input callback values. Disabling discards the history. */
+void GB_set_reverse_recording(GB_gameboy_t *gb, bool enabled);
+bool GB_is_reverse_recording(GB_gameboy_t *gb);
+
+/* Counts every GB_read_memory and GB_write_memory call, except those made by debugger commands and the disassembler.
+   Calls made by the frontend, such as from memory viewers, are counted like the emulated CPU's.
+   With a callback interval, the callback receives the counters every frames frames, which are then reset. */
+void GB_set_heatmap_enabled(GB_gameboy_t *gb, bool enabled); /* Disabling discards the counters */
+const GB_heatmap_t *GB_get_heatmap(GB_gameboy_t *gb); /* NULL if disabled */
+void GB_reset_heatmap(GB_gameboy_t *gb);
+void GB_set_heatmap_callback(GB_gameboy_t *gb, GB_heatmap_callback_t callback, unsigned frames);
+int GB_save_heatmap(GB_gameboy_t *gb, const char *path, GB_heatmap_format_t format); /* Returns errno on failure */
 #endif /* debugger_h */
@@ -6,6 +6,65 @@
 
 /* FIFO functions */
 
+/* Tile data bytes are expanded to 8 pixels with a lookup table, one byte per pixel, in the same order they are
+   stored in the FIFO (leftmost pixel first). The FIFO only operates on whole bytes, so the rest of the code
+   doesn't care about endianess. */
+#ifdef GB_BIG_ENDIAN
+#define EXPAND_BIT(x, i) ((uint64_t)(((x) >> (7 - (i))) & 1) << ((7 - (i)) * 8))
+#else
+#define EXPAND_BIT(x, i) ((uint64_t)(((x) >> (7 - (i))) & 1) << ((i) * 8))
+#endif
+#define EXPAND(x) (EXPAND_BIT(x, 0) | EXPAND_BIT(x, 1) | EXPAND_BIT(x, 2) | EXPAND_BIT(x, 3) | \
+                   EXPAND_BIT(x, 4) | EXPAND_BIT(x, 5) | EXPAND_BIT(x, 6) | EXPAND_BIT(x, 7))
+#define EXPAND_4(x) EXPAND(x), EXPAND(x + 1), EXPAND(x + 2), EXPAND(x + 3)
+#define EXPAND_16(x) EXPAND_4(x), EXPAND_4(x + 4), EXPAND_4(x + 8), EXPAND_4(x + 12)
+#define EXPAND_64(x) EXPAND_16(x), EXPAND_16(x + 16), EXPAND_16(x + 32), EXPAND_16(x + 48)
+
+static const uint64_t tile_data_expand[256] = {
+    EXPAND_64(0), EXPAND_64(64), EXPAND_64(128), EXPAND_64(192)
+};
+
+#undef EXPAND_64
+#undef EXPAND_16
+#undef EXPAND_4
+#undef EXPAND
+#undef EXPAND_BIT
+
+#define BYTES(x) ((x) * 0x0101010101010101ULL)
+
+static inline uint64_t expand_tile_row(uint8_t lower, uint8_t upper, bool flip_x)
+{
+    uint64_t ret = tile_data_expand[lower] | (tile_data_expand[upper] << 1);
+    return flip_x? __builtin_bswap64(ret) : ret;
+}
+
+/* Reads 8 consecutive FIFO entries, wrapping around the end of the FIFO */
+static inline uint64_t fifo_load_row(const void *array, unsigned start)
+{
+    uint64_t ret;
+    if (start <= GB_FIFO_LENGTH - 8) {
+        memcpy(&ret, (const uint8_t *)array + start, 8);
+    }
+    else {
+        uint8_t *dest = (uint8_t *)&ret;
+        memcpy(dest, (const uint8_t *)array + start, GB_FIFO_LENGTH - start);
+        memcpy(dest + GB_FIFO_LENGTH - start, array, start - (GB_FIFO_LENGTH - 8));
+    }
+    return ret;
+}
+
+static inline void fifo_store_row(void *array, unsigned start, uint64_t row)
+{
+    if (start <= GB_FIFO_LENGTH - 8) {
+        memcpy((uint8_t *)array + start, &row, 8);
+    }
+    else {
+        const uint8_t *src = (const uint8_t *)&row;
+        memcpy((uint8_t *)array + start, src, GB_FIFO_LENGTH - start);
+        memcpy(array, src + GB_FIFO_LENGTH - start, start - (GB_FIFO_LENGTH - 8));
+    }
+}
+
 static inline unsigned fifo_size(GB_fifo_t *fifo)
 {
     return (fifo->write_end - fifo->read_end) & (GB_FIFO_LENGTH - 1);
@@ -16,9 +75,10 @@ static void fifo_clear(GB_fifo_t *fifo)
     fifo->read_end = fifo->write_end = 0;
 }
 
-static GB_fifo_item_t *fifo_pop(GB_fifo_t *fifo)
+/* Returns the index of the popped entry */
+static inline unsigned fifo_pop(GB_fifo_t *fifo)
 {
-    GB_fifo_item_t *ret = &fifo->fifo[fifo->read_end];
+    unsigned ret = fifo->read_end;
     fifo->read_end++;
     fifo->read_end &= (GB_FIFO_LENGTH - 1);
     return ret;
@@ -26,65 +86,46 @@ static GB_fifo_item_t *fifo_pop(GB_fifo_t *fifo)
 
 static void fifo_push_bg_row(GB_fifo_t *fifo, uint8_t lower, uint8_t upper, uint8_t palette, bool bg_priority, bool flip_x)
 {
-    if (!flip_x) {
-        UNROLL
-        for (unsigned i = 8; i--;) {
-            fifo->fifo[fifo->write_end] = (GB_fifo_item_t) {
-                (lower >> 7) | ((upper >> 7) << 1),
-                palette,
-                0,
-                bg_priority,
-            };
-            lower <<= 1;
-            upper <<= 1;
-            
-            fifo->write_end++;
-            fifo->write_end &= (GB_FIFO_LENGTH - 1);
-        }
-    }
-    else {
-        UNROLL
-        for (unsigned i = 8; i--;) {
-            fifo->fifo[fifo->write_end] = (GB_fifo_item_t) {
-                (lower & 1) | ((upper & 1) << 1),
-                palette,
-                0,
-                bg_priority,
-            };
-            lower >>= 1;
-            upper >>= 1;
-            
-            fifo->write_end++;
-            fifo->write_end &= (GB_FIFO_LENGTH - 1);
-        }
-    }
+    fifo_store_row(fifo->pixel, fifo->write_end, expand_tile_row(lower, upper, flip_x));
+    fifo_store_row(fifo->palette, fifo->write_end, BYTES(palette));
+    fifo_store_row(fifo->priority, fifo->write_end, 0);
+    fifo_store_row(fifo->bg_priority, fifo->write_end, BYTES(bg_priority));
+    fifo->write_end += 8;
+    fifo->write_end &= (GB_FIFO_LENGTH - 1);
 }
 
 static void fifo_overlay_object_row(GB_fifo_t *fifo, uint8_t lower, uint8_t upper, uint8_t palette, bool bg_priority, uint8_t priority, bool flip_x)
 {
     while (fifo_size(fifo) < 8) {
-        fifo->fifo[fifo->write_end] = (GB_fifo_item_t) {0,};
+        fifo->pixel[fifo->write_end] = 0;
+        fifo->palette[fifo->write_end] = 0;
+        fifo->priority[fifo->write_end] = 0;
+        fifo->bg_priority[fifo->write_end] = false;
         fifo->write_end++;
         fifo->write_end &= (GB_FIFO_LENGTH - 1);
     }
     
-    uint8_t flip_xor = flip_x? 0: 0x7;
+    uint64_t pixels = expand_tile_row(lower, upper, flip_x);
+    uint64_t target_pixels = fifo_load_row(fifo->pixel, fifo->read_end);
+    uint64_t target_priorities = fifo_load_row(fifo->priority, fifo->read_end);
     
-    UNROLL
-    for (unsigned i = 8; i--;) {
-        uint8_t pixel = (lower >> 7) | ((upper >> 7) << 1);
-        GB_fifo_item_t *target = &fifo->fifo[(fifo->read_end + (i ^ flip_xor)) & (GB_FIFO_LENGTH - 1)];
-        if (pixel != 0 && (target->pixel == 0 || target->priority > priority)) {
-            target->pixel = pixel;
-            target->palette = palette;
-            target->bg_priority = bg_priority;
-            target->priority = priority;
-        }
-        lower <<= 1;
-        upper <<= 1;
-    }
+    /* Per byte comparisons. Pixels are 0-3 and priorities are 0-39, so setting the top bit of every byte before
+       subtracting guarantees there are no borrows between bytes. */
+    uint64_t non_transparent = ((pixels | BYTES(0x80)) - BYTES(1)) & BYTES(0x80);
+    uint64_t target_transparent = ~((target_pixels | BYTES(0x80)) - BYTES(1)) & BYTES(0x80);
+    uint64_t lower_priority = ((target_priorities | BYTES(0x80)) - BYTES(priority + 1)) & BYTES(0x80);
+    uint64_t mask = ((non_transparent & (target_transparent | lower_priority)) >> 7) * 0xFF;
+    if (!mask) return;
+    
+    fifo_store_row(fifo->pixel, fifo->read_end, (target_pixels & ~mask) | (pixels & mask));
+    fifo_store_row(fifo->priority, fifo->read_end, (target_priorities & ~mask) | (BYTES(priority) & mask));
+    fifo_store_row(fifo->palette, fifo->read_end,
+                   (fifo_load_row(fifo->palette, fifo->read_end) & ~mask) | (BYTES(palette) & mask));
+    fifo_store_row(fifo->bg_priority, fifo->read_end,
+                   (fifo_load_row(fifo->bg_priority, fifo->read_end) & ~mask) | (BYTES(bg_priority) & mask));
 }
 
+#undef BYTES
 
 /*
  Each line is 456 cycles. Without scrolling, sprites or a window:
@@ -111,9 +152,124 @@ typedef struct __attribute__((packed)) {
     uint8_t flags;
 } GB_object_t;
 
+/* The border rarely changes, so it is composited once into border_pixels, and only copied into output buffers that
+   don't have its current version yet. */
+static void render_border(GB_gameboy_t *gb)
+{
+    if (!gb->border_pixels) {
+        gb->border_pixels = malloc(BORDERED_WIDTH * BORDERED_HEIGHT);
+        if (!gb->border_pixels) return;
+        gb->border_dirty = true;
+    }
+    
+    if (gb->border_dirty) {
+        for (unsigned tile_y = 0; tile_y < 28; tile_y++) {
+            for (unsigned tile_x = 0; tile_x < 32; tile_x++) {
+                if (tile_x >= 6 && tile_x < 26 && tile_y >= 5 && tile_y < 23) {
+                    continue;
+                }
+                uint16_t tile = gb->borrowed_border.map[tile_x + tile_y * 32];
+                uint8_t flip_x = (tile & 0x4000)? 0x7 : 0;
+                uint8_t flip_y = (tile & 0x8000)? 0x7 : 0;
+                uint8_t palette = (tile >> 10) & 3;
+                for (unsigned y = 0; y < 8; y++) {
+                    for (unsigned x = 0; x < 8; x++) {
+                        uint8_t color = gb->borrowed_border.tiles[(tile & 0xFF) * 64 + (x ^ flip_x) + (y ^ flip_y) * 8] & 0xF;
+                        gb->border_pixels[tile_x * 8 + x + (tile_y * 8 + y) * BORDERED_WIDTH] = color? color + palette * 16 : 0;
+                    }
+                }
+            }
+        }
+    }
+    
+    uint32_t key = gb->color_correction_mode | (gb->pixel_format << 8) | (gb->has_sgb_border << 16);
+    if (gb->border_dirty ||
+        gb->pixel_format == GB_PIXEL_FORMAT_INDEXED || // Indices are only valid for a single frame
+        gb->border_colors_key != key ||
+        memcmp(gb->border_colors_palette, gb->borrowed_border.palette, sizeof(gb->border_colors_palette))) {
+        for (unsigned i = 0; i < 16 * 4; i++) {
+            gb->border_colors[i] = GB_convert_rgb15(gb, gb->borrowed_border.palette[i], true);
+        }
+        memcpy(gb->border_colors_palette, gb->borrowed_border.palette, sizeof(gb->border_colors_palette));
+        gb->border_colors_key = key;
+        gb->border_dirty = false;
+        memset(gb->border_drawn_screens, 0, sizeof(gb->border_drawn_screens));
+    }
+    
+    for (unsigned i = 0; i < sizeof(gb->border_drawn_screens) / sizeof(gb->border_drawn_screens[0]); i++) {
+        if (gb->border_drawn_screens[i] == gb->screen) return;
+    }
+    
+    for (unsigned y = 0; y < BORDERED_HEIGHT; y++) {
+        bool gb_area = y >= (BORDERED_HEIGHT - LINES) / 2 && y < (BORDERED_HEIGHT + LINES) / 2;
+        for (unsigned x = 0; x < BORDERED_WIDTH; x++) {
+            if (gb_area && x == (BORDERED_WIDTH - WIDTH) / 2) {
+                x += WIDTH;
+            }
+            size_t offset = x + y * BORDERED_WIDTH;
+            GB_set_pixel(gb, offset, gb->border_colors[gb->border_pixels[offset]]);
+        }
+    }
+    
+    memmove(gb->border_drawn_screens + 1, gb->border_drawn_screens,
+            sizeof(gb->border_drawn_screens) - sizeof(gb->border_drawn_screens[0]));
+    gb->border_drawn_screens[0] = gb->screen;
+}
+
+static uint64_t hash_bytes(const uint8_t *data, size_t size)
+{
+    uint64_t hash = size;
+    while (size) {
+        uint64_t word = 0;
+        size_t chunk = size < sizeof(word)? size : sizeof(word);
+        memcpy(&word, data, chunk);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+        data += chunk;
+        size -= chunk;
+    }
+    return hash;
+}
+
+/* Compares a hash of every output line against the previous frame's */
+static void update_changed_lines(GB_gameboy_t *gb)
+{
+    unsigned width = GB_get_screen_width(gb);
+    unsigned height = GB_get_screen_height(gb);
+    unsigned pixel_size = 4;
+    if (gb->pixel_format == GB_PIXEL_FORMAT_RGB565) {
+        pixel_size = 2;
+    }
+    else if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+        pixel_size = 1;
+    }
+    
+    /* Every line is reported as changed if the layout or, in indexed mode, the colors behind the indices changed */
+    uint64_t key = width | (height << 16) | ((uint64_t)gb->pixel_format << 32);
+    if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+        key ^= hash_bytes((const uint8_t *)gb->frame_palette, gb->frame_palette_size * sizeof(gb->frame_palette[0]));
+    }
+    bool all_changed = !gb->screen || key != gb->changed_lines_key;
+    gb->changed_lines_key = key;
+    
+    memset(gb->changed_lines, 0, sizeof(gb->changed_lines));
+    for (unsigned y = 0; y < height; y++) {
+        uint64_t hash = gb->screen? hash_bytes((const uint8_t *)gb->screen + y * width * pixel_size, width * pixel_size) : 0;
+        if (all_changed || hash != gb->line_hashes[y]) {
+            gb->changed_lines[y / 32] |= 1U << (y % 32);
+        }
+        gb->line_hashes[y] = hash;
+    }
+}
+
 static void display_vblank(GB_gameboy_t *gb)
 {  
     gb->vblank_just_occured = true;
+    gb->frame_sequence++;
+    /* Samples replayed history would produce were already delivered, and rendering them is disabled anyway */
+    if (!GB_debugger_is_replaying(gb)) {
+        GB_apu_flush_samples(gb);
+    }
     
     /* TODO: Slow in turbo mode! */
     if (GB_is_hle_sgb(gb)) {
@@ -122,6 +278,9 @@ static void display_vblank(GB_gameboy_t *gb)
     
     if (gb->turbo) {
         if (GB_timing_sync_turbo(gb)) {
+            if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+                GB_refresh_palettes(gb);
+            }
             return;
         }
     }
@@ -143,13 +302,13 @@ static void display_vblank(GB_gameboy_t *gb)
             if (gb->border_mode == GB_BORDER_ALWAYS) {
                 for (unsigned y = 0; y < LINES; y++) {
                     for (unsigned x = 0; x < WIDTH; x++) {
-                        gb ->screen[x + y * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH] = color;
+                        GB_set_pixel(gb, x + y * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH, color);
                     }
                 }
             }
             else {
                 for (unsigned i = 0; i < WIDTH * LINES; i++) {
-                    gb ->screen[i] = color;
+                    GB_set_pixel(gb, i, color);
                 }
             }
         }
@@ -157,7 +316,6 @@ static void display_vblank(GB_gameboy_t *gb)
     
     if (gb->border_mode == GB_BORDER_ALWAYS && !GB_is_sgb(gb)) {
         GB_borrow_sgb_border(gb);
-        uint32_t border_colors[16 * 4];
         
         if (!gb->has_sgb_border && GB_is_cgb(gb) && gb->model != GB_MODEL_AGB) {
             static uint16_t colors[] = {
@@ -172,39 +330,31 @@ static void display_vblank(GB_gameboy_t *gb)
 
         }
         
-        for (unsigned i = 0; i < 16 * 4; i++) {
-            border_colors[i] = GB_convert_rgb15(gb, gb->borrowed_border.palette[i], true);
-        }
-        
-        for (unsigned tile_y = 0; tile_y < 28; tile_y++) {
-            for (unsigned tile_x = 0; tile_x < 32; tile_x++) {
-                if (tile_x >= 6 && tile_x < 26 && tile_y >= 5 && tile_y < 23) {
-                    continue;
-                }
-                uint16_t tile = gb->borrowed_border.map[tile_x + tile_y * 32];
-                uint8_t flip_x = (tile & 0x4000)? 0x7 : 0;
-                uint8_t flip_y = (tile & 0x8000)? 0x7 : 0;
-                uint8_t palette = (tile >> 10) & 3;
-                for (unsigned y = 0; y < 8; y++) {
-                    for (unsigned x = 0; x < 8; x++) {
-                        uint8_t color = gb->borrowed_border.tiles[(tile & 0xFF) * 64 + (x ^ flip_x) + (y ^ flip_y) * 8] & 0xF;
-                        uint32_t *output = gb->screen + tile_x * 8 + x + (tile_y * 8 + y) * 256;
-                        if (color == 0) {
-                            *output = border_colors[0];
-                        }
-                        else {
-                            *output = border_colors[color + palette * 16];
-                        }
-                    }
-                }
-            }
-        }
+        render_border(gb);
     }
     GB_handle_rumble(gb);
 
+    if (gb->track_changed_lines) {
+        update_changed_lines(gb);
+    }
+    
     if (gb->vblank_callback) {
         gb->vblank_callback(gb);
     }
+    if (gb->heatmap && gb->heatmap_interval) {
+        GB_debugger_heatmap_vblank(gb);
+    }
+    if (gb->frame_callback) {
+        gb->frame_callback(gb, gb->screen, gb->frame_sequence);
+    }
+    if (gb->output_buffer_count) {
+        gb->current_output_buffer = (gb->current_output_buffer + 1) % gb->output_buffer_count;
+        gb->screen = gb->output_buffers[gb->current_output_buffer];
+    }
+    if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+        /* Colors that are no longer in use are dropped from the frame palette */
+        GB_refresh_palettes(gb);
+    }
     GB_timing_sync(gb);
 }
 
@@ -228,8 +378,88 @@ static inline uint8_t scale_channel_with_curve_sgb(uint8_t x)
     return (uint8_t[]){0,2,5,9,15,20,27,34,42,50,58,67,76,85,94,104,114,123,133,143,153,163,173,182,192,202,211,220,229,238,247,255}[x];
 }
 
+/* Finds the existing frame palette entry nearest to a color */
+static uint8_t frame_palette_nearest(GB_gameboy_t *gb, uint32_t rgb)
+{
+    uint8_t r = rgb >> 16, g = rgb >> 8, b = rgb;
+    uint8_t best = 0;
+    unsigned best_distance = -1;
+    for (unsigned i = 0; i < gb->frame_palette_size; i++) {
+        signed dr = (signed)(gb->frame_palette_rgb[i] >> 16) - r;
+        signed dg = (signed)((gb->frame_palette_rgb[i] >> 8) & 0xFF) - g;
+        signed db = (signed)(gb->frame_palette_rgb[i] & 0xFF) - b;
+        unsigned distance = dr * dr + dg * dg + db * db;
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
 
-uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
+/* Finds or allocates an entry for a color in the frame palette. Once all 256 entries are taken, the nearest
+   existing color is used instead. */
+static uint8_t frame_palette_index(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b)
+{
+    uint32_t rgb = (r << 16) | (g << 8) | b;
+    for (unsigned i = 0; i < gb->frame_palette_size; i++) {
+        if (gb->frame_palette_rgb[i] == rgb) return i;
+    }
+    
+    if (gb->frame_palette_size < 0x100) {
+        gb->frame_palette_rgb[gb->frame_palette_size] = rgb;
+        gb->frame_palette[gb->frame_palette_size] = gb->rgb_encode_callback(gb, r, g, b);
+        return gb->frame_palette_size++;
+    }
+    
+    return frame_palette_nearest(gb, rgb);
+}
+
+static uint32_t encode_rgb(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b)
+{
+    switch (gb->pixel_format) {
+        case GB_PIXEL_FORMAT_RGB565:
+            return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        case GB_PIXEL_FORMAT_INDEXED:
+            return frame_palette_index(gb, r, g, b);
+        case GB_PIXEL_FORMAT_RGB_ENCODED:
+        default:
+            return gb->rgb_encode_callback(gb, r, g, b);
+    }
+}
+
+/* Like encode_rgb, but never allocates frame palette entries, for colors that do not appear on screen */
+static uint32_t encode_rgb_for_viewer(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b)
+{
+    if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+        return frame_palette_nearest(gb, (r << 16) | (g << 8) | b);
+    }
+    return encode_rgb(gb, r, g, b);
+}
+
+bool GB_can_encode_colors(GB_gameboy_t *gb)
+{
+    return gb->rgb_encode_callback || gb->pixel_format == GB_PIXEL_FORMAT_RGB565;
+}
+
+void GB_set_pixel(GB_gameboy_t *gb, size_t offset, uint32_t color)
+{
+    switch (gb->pixel_format) {
+        case GB_PIXEL_FORMAT_RGB565:
+            ((uint16_t *)gb->screen)[offset] = color;
+            break;
+        case GB_PIXEL_FORMAT_INDEXED:
+            ((uint8_t *)gb->screen)[offset] = color;
+            break;
+        case GB_PIXEL_FORMAT_RGB_ENCODED:
+        default:
+            ((uint32_t *)gb->screen)[offset] = color;
+            break;
+    }
+}
+
+
+static uint32_t convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
 {
     uint8_t r = (color) & 0x1F;
     uint8_t g = (color >> 5) & 0x1F;
@@ -242,10 +472,10 @@ uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
     }
     else {
         if (GB_is_sgb(gb) || for_border) {
-            return gb->rgb_encode_callback(gb,
-                                           scale_channel_with_curve_sgb(r),
-                                           scale_channel_with_curve_sgb(g),
-                                           scale_channel_with_curve_sgb(b));
+            return encode_rgb(gb,
+                              scale_channel_with_curve_sgb(r),
+                              scale_channel_with_curve_sgb(g),
+                              scale_channel_with_curve_sgb(b));
         }
         bool agb = gb->model == GB_MODEL_AGB;
         r = agb? scale_channel_with_curve_agb(r) : scale_channel_with_curve(r);
@@ -301,12 +531,50 @@ uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
         }
     }
     
-    return gb->rgb_encode_callback(gb, r, g, b);
+    return encode_rgb(gb, r, g, b);
+}
+
+/* Identifies which of the conversions above applies, so a lookup table can tell whether it's still valid */
+static uint8_t rgb15_curve(GB_gameboy_t *gb, bool for_border)
+{
+    if (gb->color_correction_mode == GB_COLOR_CORRECTION_DISABLED || (for_border && !gb->has_sgb_border)) {
+        return 0;
+    }
+    if (GB_is_sgb(gb) || for_border) {
+        return 1;
+    }
+    return 2 + gb->color_correction_mode + (gb->model == GB_MODEL_AGB? 0x10 : 0);
+}
+
+uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
+{
+    /* Indices are allocated as colors are used, so they can't be cached */
+    if (gb->pixel_format == GB_PIXEL_FORMAT_INDEXED) {
+        return convert_rgb15(gb, color, for_border);
+    }
+    
+    uint32_t key = rgb15_curve(gb, for_border) | (gb->pixel_format << 8);
+    uint32_t *lut = gb->rgb15_lut[for_border];
+    if (!lut || !gb->rgb15_lut_valid[for_border] || gb->rgb15_lut_key[for_border] != key) {
+        if (!lut) {
+            lut = gb->rgb15_lut[for_border] = malloc(sizeof(*lut) * 0x8000);
+            if (!lut) {
+                return convert_rgb15(gb, color, for_border);
+            }
+        }
+        for (unsigned i = 0; i < 0x8000; i++) {
+            lut[i] = convert_rgb15(gb, i, for_border);
+        }
+        gb->rgb15_lut_key[for_border] = key;
+        gb->rgb15_lut_valid[for_border] = true;
+    }
+    return lut[color & 0x7FFF];
 }
 
 void GB_palette_changed(GB_gameboy_t *gb, bool background_palette, uint8_t index)
 {
-    if (!gb->rgb_encode_callback || !GB_is_cgb(gb)) return;
+    if (!GB_can_encode_colors(gb) || !GB_is_cgb(gb)) return;
+    GB_display_sync(gb);
     uint8_t *palette_data = background_palette? gb->background_palettes_data : gb->sprite_palettes_data;
     uint16_t color = palette_data[index & ~1] | (palette_data[index | 1] << 8);
 
@@ -324,6 +592,79 @@ void GB_set_color_correction_mode(GB_gameboy_t *gb, GB_color_correction_mode_t m
     }
 }
 
+void GB_update_dmg_palette(GB_gameboy_t *gb)
+{
+    const GB_palette_t *palette = gb->dmg_palette ?: &GB_PALETTE_GREY;
+    if (GB_can_encode_colors(gb) && !GB_is_cgb(gb)) {
+        GB_display_sync(gb);
+        gb->sprite_palettes_rgb[4] = gb->sprite_palettes_rgb[0] = gb->background_palettes_rgb[0] =
+        encode_rgb(gb, palette->colors[3].r, palette->colors[3].g, palette->colors[3].b);
+        gb->sprite_palettes_rgb[5] = gb->sprite_palettes_rgb[1] = gb->background_palettes_rgb[1] =
+        encode_rgb(gb, palette->colors[2].r, palette->colors[2].g, palette->colors[2].b);
+        gb->sprite_palettes_rgb[6] = gb->sprite_palettes_rgb[2] = gb->background_palettes_rgb[2] =
+        encode_rgb(gb, palette->colors[1].r, palette->colors[1].g, palette->colors[1].b);
+        gb->sprite_palettes_rgb[7] = gb->sprite_palettes_rgb[3] = gb->background_palettes_rgb[3] =
+        encode_rgb(gb, palette->colors[0].r, palette->colors[0].g, palette->colors[0].b);
+        
+        // LCD off color
+        gb->background_palettes_rgb[4] =
+        encode_rgb(gb, palette->colors[4].r, palette->colors[4].g, palette->colors[4].b);
+    }
+}
+
+/* Re-encodes every palette, needed whenever the encoding changes. In GB_PIXEL_FORMAT_INDEXED this also starts a
+   new frame palette. */
+void GB_refresh_palettes(GB_gameboy_t *gb)
+{
+    gb->frame_palette_size = 0;
+    GB_update_dmg_palette(gb);
+    
+    for (unsigned i = 0; i < 32; i++) {
+        GB_palette_changed(gb, true, i * 2);
+        GB_palette_changed(gb, false, i * 2);
+    }
+}
+
+void GB_set_pixel_format(GB_gameboy_t *gb, GB_pixel_format_t format)
+{
+    if (format > GB_PIXEL_FORMAT_INDEXED) return;
+    if (format != gb->pixel_format) {
+        gb->border_dirty = true;
+    }
+    gb->pixel_format = format;
+    GB_refresh_palettes(gb);
+}
+
+GB_pixel_format_t GB_get_pixel_format(GB_gameboy_t *gb)
+{
+    return gb->pixel_format;
+}
+
+void GB_set_changed_lines_tracking(GB_gameboy_t *gb, bool enabled)
+{
+    gb->track_changed_lines = enabled;
+    gb->changed_lines_key = 0;
+}
+
+const uint32_t *GB_get_changed_lines(GB_gameboy_t *gb)
+{
+    return gb->changed_lines;
+}
+
+bool GB_is_line_changed(GB_gameboy_t *gb, unsigned line)
+{
+    if (line >= sizeof(gb->changed_lines) * 8) return false;
+    return gb->changed_lines[line / 32] & (1U << (line % 32));
+}
+
+const uint32_t *GB_get_frame_palette(GB_gameboy_t *gb, unsigned *size)
+{
+    if (size) {
+        *size = gb->frame_palette_size;
+    }
+    return gb->frame_palette;
+}
+
 /*
  STAT interrupt is implemented based on this finding:
  http://board.byuu.org/phpbb3/viewtopic.php?p=25527#p25531
@@ -400,6 +741,28 @@ void GB_lcd_off(GB_gameboy_t *gb)
     gb->wy_triggered = false;
 }
 
+/* Writes through pointers from GB_get_direct_access can't be tracked, so they are picked up once per frame */
+static void invalidate_exposed_memory(GB_gameboy_t *gb)
+{
+    if (!gb->vram_oam_exposed) return;
+    memset(gb->decoded_tiles_valid, 0, sizeof(gb->decoded_tiles_valid));
+    gb->object_lines_dirty = true;
+}
+
+static void update_object_lines(GB_gameboy_t *gb, bool height_16)
+{
+    GB_object_t *objects = (GB_object_t *) &gb->oam;
+    memset(gb->object_lines, 0, sizeof(gb->object_lines));
+    for (unsigned i = 0; i < 40; i++) {
+        signed y = objects[i].y - 16;
+        for (signed line = MAX(y, 0); line < y + (height_16? 16 : 8); line++) {
+            gb->object_lines[line] |= 1ULL << i;
+        }
+    }
+    gb->object_lines_dirty = false;
+    gb->object_lines_height_16 = height_16;
+}
+
 static void add_object_from_index(GB_gameboy_t *gb, unsigned index)
 {
     if (gb->n_visible_objs == 10) return;
@@ -416,8 +779,10 @@ static void add_object_from_index(GB_gameboy_t *gb, unsigned index)
     /* This reverse sorts the visible objects by location and priority */
     GB_object_t *objects = (GB_object_t *) &gb->oam;
     bool height_16 = (gb->io_registers[GB_IO_LCDC] & 4) != 0;
-    signed y = objects[index].y - 16;
-    if (y <= gb->current_line && y + (height_16? 16 : 8) > gb->current_line) {
+    if (gb->object_lines_dirty || gb->object_lines_height_16 != height_16) {
+        update_object_lines(gb, height_16);
+    }
+    if (gb->object_lines[gb->current_line] & (1ULL << index)) {
         unsigned j = 0;
         for (; j < gb->n_visible_objs; j++) {
             if (gb->obj_comparators[j] <= objects[index].x) break;
@@ -449,26 +814,23 @@ static uint8_t data_for_tile_sel_glitch(GB_gameboy_t *gb, bool *should_use)
 
 static void render_pixel_if_possible(GB_gameboy_t *gb)
 {
-    GB_fifo_item_t *fifo_item = NULL;
-    GB_fifo_item_t *oam_fifo_item = NULL;
+    unsigned bg_index = 0;
+    unsigned oam_index = 0;
     bool draw_oam = false;
     bool bg_enabled = true, bg_priority = false;
     
-    if (fifo_size(&gb->bg_fifo)) {
-        fifo_item = fifo_pop(&gb->bg_fifo);
-        bg_priority = fifo_item->bg_priority;
-        
-        if (fifo_size(&gb->oam_fifo)) {
-            oam_fifo_item = fifo_pop(&gb->oam_fifo);
-            if (oam_fifo_item->pixel && (gb->io_registers[GB_IO_LCDC] & 2)) {
-                draw_oam = true;
-                bg_priority |= oam_fifo_item->bg_priority;
-            }
+    if (!fifo_size(&gb->bg_fifo)) return;
+    
+    bg_index = fifo_pop(&gb->bg_fifo);
+    bg_priority = gb->bg_fifo.bg_priority[bg_index];
+    
+    if (fifo_size(&gb->oam_fifo)) {
+        oam_index = fifo_pop(&gb->oam_fifo);
+        if (gb->oam_fifo.pixel[oam_index] && (gb->io_registers[GB_IO_LCDC] & 2)) {
+            draw_oam = true;
+            bg_priority |= gb->oam_fifo.bg_priority[oam_index];
         }
     }
-    
-
-    if (!fifo_item) return;
 
     /* Drop pixels for scrollings */
     if (gb->position_in_line >= 160 || (gb->disable_rendering && !gb->sgb)) {
@@ -488,18 +850,18 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
     }
 
     uint8_t icd_pixel = 0;
-    uint32_t *dest = NULL;
+    size_t dest = 0;
     if (!gb->sgb) {
         if (gb->border_mode != GB_BORDER_ALWAYS) {
-            dest = gb->screen + gb->lcd_x + gb->current_line * WIDTH;
+            dest = gb->lcd_x + gb->current_line * WIDTH;
         }
         else {
-            dest = gb->screen + gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
+            dest = gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
         }
     }
     
     {
-        uint8_t pixel = bg_enabled? fifo_item->pixel : 0;
+        uint8_t pixel = bg_enabled? gb->bg_fifo.pixel[bg_index] : 0;
         if (pixel && bg_priority) {
             draw_oam = false;
         }
@@ -517,18 +879,18 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
             }
         }
         else if (gb->cgb_palettes_ppu_blocked) {
-            *dest = gb->rgb_encode_callback(gb, 0, 0, 0);
+            GB_set_pixel(gb, dest, encode_rgb(gb, 0, 0, 0));
         }
         else {
-            *dest = gb->background_palettes_rgb[fifo_item->palette * 4 + pixel];
+            GB_set_pixel(gb, dest, gb->background_palettes_rgb[gb->bg_fifo.palette[bg_index] * 4 + pixel]);
         }
     }
     
     if (draw_oam) {
-        uint8_t pixel = oam_fifo_item->pixel;
+        uint8_t pixel = gb->oam_fifo.pixel[oam_index];
         if (!gb->cgb_mode) {
             /* Todo: Verify access timings */
-            pixel = ((gb->io_registers[oam_fifo_item->palette? GB_IO_OBP1 : GB_IO_OBP0] >> (pixel << 1)) & 3);
+            pixel = ((gb->io_registers[gb->oam_fifo.palette[oam_index]? GB_IO_OBP1 : GB_IO_OBP0] >> (pixel << 1)) & 3);
         }
         if (gb->sgb) {
             if (gb->current_lcd_line < LINES) {
@@ -542,15 +904,15 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
             }
         }
         else if (gb->cgb_palettes_ppu_blocked) {
-            *dest = gb->rgb_encode_callback(gb, 0, 0, 0);
+            GB_set_pixel(gb, dest, encode_rgb(gb, 0, 0, 0));
         }
         else {
-            *dest = gb->sprite_palettes_rgb[oam_fifo_item->palette * 4 + pixel];
+            GB_set_pixel(gb, dest, gb->sprite_palettes_rgb[gb->oam_fifo.palette[oam_index] * 4 + pixel]);
         }
     }
     
     if (gb->model & GB_MODEL_NO_SFC_BIT) {
-        if (gb->icd_pixel_callback) {
+        if (gb->icd_pixel_callback && !GB_debugger_is_replaying(gb)) {
             gb->icd_pixel_callback(gb, icd_pixel);
         }
     }
@@ -774,6 +1136,162 @@ static uint16_t get_object_line_address(GB_gameboy_t *gb, const GB_object_t *obj
     return line_address;
 }
 
+/* Batched rendering
+
+   A line with no objects and no window, whose registers are not touched during mode 3, renders exactly the same
+   way every time, so there's no need to run the FIFO for every single pixel. Instead, the PPU sleeps through the
+   entire mode 3 without modifying any state, and renders the whole line when it wakes up. Any access that may
+   affect the line (VRAM writes, PPU registers, palettes, STOP mode) calls GB_display_sync first, which replays
+   mode 3 from its beginning using the exact FIFO emulation. */
+
+#define SPREAD(x) (((x) & 1) | (((x) & 2) << 1) | (((x) & 4) << 2) | (((x) & 8) << 3) | \
+                   (((x) & 16) << 4) | (((x) & 32) << 5) | (((x) & 64) << 6) | (((x) & 128) << 7))
+#define SPREAD_4(x) SPREAD(x), SPREAD(x + 1), SPREAD(x + 2), SPREAD(x + 3)
+#define SPREAD_16(x) SPREAD_4(x), SPREAD_4(x + 4), SPREAD_4(x + 8), SPREAD_4(x + 12)
+#define SPREAD_64(x) SPREAD_16(x), SPREAD_16(x + 16), SPREAD_16(x + 32), SPREAD_16(x + 48)
+
+/* Spreads the 8 bits of a tile data byte into the even bits of a 16-bit value */
+static const uint16_t tile_data_spread[256] = {
+    SPREAD_64(0), SPREAD_64(64), SPREAD_64(128), SPREAD_64(192)
+};
+
+#undef SPREAD_64
+#undef SPREAD_16
+#undef SPREAD_4
+#undef SPREAD
+
+static bool line_can_be_batched(GB_gameboy_t *gb)
+{
+    if (gb->n_visible_objs) return false;
+    if (gb->wy_triggered && (gb->io_registers[GB_IO_LCDC] & 0x20)) return false;
+    if (gb->wx_triggered || gb->tile_sel_glitch) return false;
+    if (gb->sgb || (gb->model & GB_MODEL_NO_SFC_BIT)) return false;
+    if (gb->stopped || gb->vram_ppu_blocked || gb->cgb_palettes_ppu_blocked) return false;
+    return true;
+}
+
+static inline unsigned batched_line_length(GB_gameboy_t *gb)
+{
+    return 167 + (gb->io_registers[GB_IO_SCX] & 7);
+}
+
+/* Renders the line and leaves the PPU in the same state the FIFO emulation would leave it when reaching pixel 160 */
+static void render_batched_line(GB_gameboy_t *gb)
+{
+    uint8_t lcdc = gb->io_registers[GB_IO_LCDC];
+    uint8_t scx = gb->io_registers[GB_IO_SCX];
+    uint8_t fine_x = scx & 7;
+    uint8_t y = gb->current_line + gb->io_registers[GB_IO_SCY];
+    uint16_t map = ((lcdc & 0x08)? 0x1C00 : 0x1800) + y / 8 * 32;
+    uint8_t attributes = gb->current_tile_attributes;
+    bool bg_enabled = (lcdc & 1) || gb->cgb_mode;
+    
+    /* The last tile whose index, lower data and upper data are fetched before the line ends */
+    unsigned last_index_fetch = (166 + fine_x) / 8;
+    unsigned last_lower_fetch = (164 + fine_x) / 8;
+    unsigned last_upper_fetch = (162 + fine_x) / 8;
+    
+    bool draw = gb->screen && !gb->disable_rendering;
+    size_t dest = 0;
+    if (gb->border_mode != GB_BORDER_ALWAYS) {
+        dest = gb->current_line * WIDTH;
+    }
+    else {
+        dest = gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
+    }
+    uint32_t line[WIDTH];
+    
+    for (unsigned tile_x = 0; tile_x <= last_index_fetch; tile_x++) {
+        gb->last_tile_index_address = map + ((scx / 8 + tile_x) & 0x1F);
+        gb->current_tile = gb->vram[gb->last_tile_index_address];
+        if (GB_is_cgb(gb)) {
+            attributes = gb->current_tile_attributes = gb->vram[gb->last_tile_index_address + 0x2000];
+        }
+        
+        uint16_t tile_address = (lcdc & 0x10)? gb->current_tile * 0x10 : (int8_t)gb->current_tile * 0x10 + 0x1000;
+        if (attributes & 8) {
+            tile_address += 0x2000;
+        }
+        tile_address += ((y & 7) ^ ((attributes & 0x40)? 7 : 0)) * 2;
+        uint8_t lower = gb->vram[tile_address];
+        uint8_t upper = gb->vram[tile_address + 1];
+        if (tile_x <= last_lower_fetch) {
+            gb->current_tile_data[0] = lower;
+        }
+        if (tile_x <= last_upper_fetch) {
+            gb->current_tile_data[1] = upper;
+            gb->last_tile_data_address = tile_address + 1;
+        }
+        if (tile_x > 20) break;
+        
+        /* Pixel i is in bits 2i and 2i+1, counting from the right */
+        uint16_t row = tile_data_spread[lower] | (tile_data_spread[upper] << 1);
+        bool flip_x = attributes & 0x20;
+        
+        /* The last two rows remain in the FIFO */
+        if (tile_x >= 19) {
+            gb->bg_fifo.write_end = ((tile_x + 1) * 8) & (GB_FIFO_LENGTH - 1);
+            fifo_push_bg_row(&gb->bg_fifo, lower, upper, attributes & 7, attributes & 0x80, flip_x);
+        }
+        
+        if (!draw) continue;
+        
+        uint32_t colors[4];
+        for (unsigned i = 0; i < 4; i++) {
+            uint8_t pixel = bg_enabled? i : 0;
+            if (!gb->cgb_mode) {
+                pixel = (gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3;
+            }
+            colors[i] = gb->background_palettes_rgb[(attributes & 7) * 4 + pixel];
+        }
+        for (unsigned i = 0; i < 8; i++) {
+            signed x = tile_x * 8 + i - fine_x;
+            if (x < 0 || x >= WIDTH) continue;
+            line[x] = colors[(row >> ((flip_x? i : 7 - i) * 2)) & 3];
+        }
+    }
+    
+    if (draw) {
+        if (gb->pixel_format == GB_PIXEL_FORMAT_RGB_ENCODED) {
+            memcpy((uint32_t *)gb->screen + dest, line, sizeof(line));
+        }
+        else {
+            for (unsigned x = 0; x < WIDTH; x++) {
+                GB_set_pixel(gb, dest + x, line[x]);
+            }
+        }
+    }
+    
+    if (gb->model > GB_MODEL_CGB_C) {
+        gb->fetcher_y = y;
+    }
+    if (!(lcdc & 0x20)) {
+        gb->wx166_glitch = false;
+    }
+    gb->fetcher_x = ((161 + fine_x) / 8 + 1) & 0x1F;
+    gb->fetcher_state = fine_x;
+    gb->bg_fifo.read_end = (8 + fine_x) & (GB_FIFO_LENGTH - 1);
+    gb->position_in_line = 160;
+    if (!gb->disable_rendering) {
+        gb->lcd_x = 160;
+        gb->window_is_being_fetched = false;
+    }
+    gb->during_object_fetch = false;
+}
+
+void GB_display_sync(GB_gameboy_t *gb)
+{
+    /* State 43 is the batched mode 3 sleep */
+    if (gb->display_state != 43) return;
+    
+    /* Undo the sleep and replay the line so far using the FIFO */
+    unsigned length = batched_line_length(gb);
+    gb->display_cycles += length * 2;
+    gb->cycles_for_line -= length;
+    gb->display_state = 44;
+    GB_display_run(gb, 0);
+}
+
 /*
  TODO: It seems that the STAT register's mode bits are always "late" by 4 T-cycles.
        The PPU logic can be greatly simplified if that delay is simply emulated.
@@ -833,6 +1351,8 @@ void GB_display_run(GB_gameboy_t *gb, uint8_t cycles)
         GB_STATE(gb, display, 40);
         GB_STATE(gb, display, 41);
         GB_STATE(gb, display, 42);
+        GB_STATE(gb, display, 43);
+        GB_STATE(gb, display, 44);
     }
     
     if (!(gb->io_registers[GB_IO_LCDC] & 0x80)) {
@@ -852,6 +1372,7 @@ void GB_display_run(GB_gameboy_t *gb, uint8_t cycles)
 
     /* Handle mode 2 on the very first line 0 */
     gb->current_line = 0;
+    invalidate_exposed_memory(gb);
     gb->window_y = -1;
     /* Todo: verify timings */
     if (gb->io_registers[GB_IO_WY] == 0) {
@@ -1009,7 +1530,14 @@ void GB_display_run(GB_gameboy_t *gb, uint8_t cycles)
             
             /* The actual rendering cycle */
             gb->fetcher_state = 0;
+            if (line_can_be_batched(gb)) {
+                gb->cycles_for_line += batched_line_length(gb);
+                GB_SLEEP(gb, display, 43, batched_line_length(gb));
+                render_batched_line(gb);
+                goto mode_3_end;
+            }
             while (true) {
+            display44: /* Entered from GB_display_sync */
                 /* Handle window */
                 /* TODO: It appears that WX checks if the window begins *next* pixel, not *this* pixel. For this reason,
                    WX=167 has no effect at all (It checks if the PPU X position is 161, which never happens) and WX=166
@@ -1071,7 +1599,10 @@ void GB_display_run(GB_gameboy_t *gb, uint8_t cycles)
                     // Insert a pixel right at the FIFO's end
                     gb->bg_fifo.read_end--;
                     gb->bg_fifo.read_end &= GB_FIFO_LENGTH - 1;
-                    gb->bg_fifo.fifo[gb->bg_fifo.read_end] = (GB_fifo_item_t){0,};
+                    gb->bg_fifo.pixel[gb->bg_fifo.read_end] = 0;
+                    gb->bg_fifo.palette[gb->bg_fifo.read_end] = 0;
+                    gb->bg_fifo.priority[gb->bg_fifo.read_end] = 0;
+                    gb->bg_fifo.bg_priority[gb->bg_fifo.read_end] = false;
                     gb->window_is_being_fetched = false;
                 }
 
@@ -1171,6 +1702,7 @@ abort_fetching_object:
                 gb->cycles_for_line++;
                 GB_SLEEP(gb, display, 21, 1);
             }
+        mode_3_end:
             
             /* TODO: Verify */
             if (gb->fetcher_state == 4 || gb->fetcher_state == 5) {
@@ -1182,14 +1714,14 @@ abort_fetching_object:
             
             while (gb->lcd_x != 160 && !gb->disable_rendering && gb->screen && !gb->sgb) {
                 /* Oh no! The PPU and LCD desynced! Fill the rest of the line whith white. */
-                uint32_t *dest = NULL;
+                size_t dest = 0;
                 if (gb->border_mode != GB_BORDER_ALWAYS) {
-                    dest = gb->screen + gb->lcd_x + gb->current_line * WIDTH;
+                    dest = gb->lcd_x + gb->current_line * WIDTH;
                 }
                 else {
-                    dest = gb->screen + gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
+                    dest = gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
                 }
-                *dest = gb->background_palettes_rgb[0];
+                GB_set_pixel(gb, dest, gb->background_palettes_rgb[0]);
                 gb->lcd_x++;
 
             }
@@ -1252,7 +1784,7 @@ abort_fetching_object:
                 display_vblank(gb);
             }
             
-            if (gb->icd_hreset_callback) {
+            if (gb->icd_hreset_callback && !GB_debugger_is_replaying(gb)) {
                 gb->icd_hreset_callback(gb);
             }
         }
@@ -1337,6 +1869,7 @@ abort_fetching_object:
         
         
         gb->current_line = 0;
+        invalidate_exposed_memory(gb);
         /* Todo: verify timings */
         if ((gb->io_registers[GB_IO_LCDC] & 0x20) &&
             (gb->io_registers[GB_IO_WY] == 0)) {
@@ -1348,12 +1881,40 @@ abort_fetching_object:
         
         // TODO: not the correct timing
         gb->current_lcd_line = 0;
-        if (gb->icd_vreset_callback) {
+        if (gb->icd_vreset_callback && !GB_debugger_is_replaying(gb)) {
             gb->icd_vreset_callback(gb);
         }
     }
 }
 
+/* Tiles are decoded to one color index per pixel on first use, and invalidated by VRAM writes */
+static const uint8_t *get_decoded_tile(GB_gameboy_t *gb, unsigned tile)
+{
+    uint8_t *decoded = gb->decoded_tiles + tile * 64;
+    if (gb->decoded_tiles_valid[tile / 64] & (1ULL << (tile % 64))) {
+        return decoded;
+    }
+    
+    uint16_t tile_address = (tile % 384) * 0x10 + (tile >= 384? 0x2000 : 0);
+    for (unsigned y = 0; y < 8; y++) {
+        uint8_t lower = gb->vram[tile_address + y * 2];
+        uint8_t upper = gb->vram[tile_address + y * 2 + 1];
+        for (unsigned x = 0; x < 8; x++) {
+            *(decoded++) = ((lower >> (7 - x)) & 1) | (((upper >> (7 - x)) & 1) << 1);
+        }
+    }
+    gb->decoded_tiles_valid[tile / 64] |= 1ULL << (tile % 64);
+    return decoded - 64;
+}
+
+static bool allocate_decoded_tiles(GB_gameboy_t *gb)
+{
+    if (gb->decoded_tiles) return true;
+    gb->decoded_tiles = malloc(GB_DECODED_TILES * 64);
+    memset(gb->decoded_tiles_valid, 0, sizeof(gb->decoded_tiles_valid));
+    return gb->decoded_tiles;
+}
+
 void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette_type, uint8_t palette_index)
 {
     uint32_t none_palette[4];
@@ -1362,10 +1923,10 @@ void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
     switch (GB_is_cgb(gb)? palette_type : GB_PALETTE_NONE) {
         default:
         case GB_PALETTE_NONE:
-            none_palette[0] = gb->rgb_encode_callback(gb, 0xFF, 0xFF, 0xFF);
-            none_palette[1] = gb->rgb_encode_callback(gb, 0xAA, 0xAA, 0xAA);
-            none_palette[2] = gb->rgb_encode_callback(gb, 0x55, 0x55, 0x55);
-            none_palette[3] = gb->rgb_encode_callback(gb, 0,    0,    0   );
+            none_palette[0] = encode_rgb_for_viewer(gb, 0xFF, 0xFF, 0xFF);
+            none_palette[1] = encode_rgb_for_viewer(gb, 0xAA, 0xAA, 0xAA);
+            none_palette[2] = encode_rgb_for_viewer(gb, 0x55, 0x55, 0x55);
+            none_palette[3] = encode_rgb_for_viewer(gb, 0,    0,    0   );
             palette = none_palette;
             break;
         case GB_PALETTE_BACKGROUND:
@@ -1376,30 +1937,39 @@ void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
             break;
     }
     
-    for (unsigned y = 0; y < 192; y++) {
-        for (unsigned x = 0; x < 256; x++) {
-            if (x >= 128 && !GB_is_cgb(gb)) {
-                *(dest++) = gb->background_palettes_rgb[0];
-                continue;
+    if (!allocate_decoded_tiles(gb)) return;
+    
+    uint32_t colors[4];
+    for (unsigned i = 0; i < 4; i++) {
+        uint8_t pixel = i;
+        if (!gb->cgb_mode) {
+            if (palette_type == GB_PALETTE_BACKGROUND) {
+                pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
             }
-            uint16_t tile = (x % 128) / 8 + y / 8 * 16;
-            uint16_t tile_address = tile * 0x10 + (x >= 128? 0x2000 : 0);
-            uint8_t pixel = (((gb->vram[tile_address + (y & 7) * 2    ] >> ((~x)&7)) & 1 ) |
-                             ((gb->vram[tile_address + (y & 7) * 2 + 1] >> ((~x)&7)) & 1) << 1);
-            
-            if (!gb->cgb_mode) {
-                if (palette_type == GB_PALETTE_BACKGROUND) {
-                    pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
-                }
-                else if (!gb->cgb_mode) {
-                    if (palette_type == GB_PALETTE_OAM) {
-                        pixel = ((gb->io_registers[palette_index == 0? GB_IO_OBP0 : GB_IO_OBP1] >> (pixel << 1)) & 3);
+            else if (palette_type == GB_PALETTE_OAM) {
+                pixel = ((gb->io_registers[palette_index == 0? GB_IO_OBP0 : GB_IO_OBP1] >> (pixel << 1)) & 3);
+            }
+        }
+        colors[i] = palette[pixel];
+    }
+    
+    for (unsigned tile_y = 0; tile_y < 24; tile_y++) {
+        for (unsigned tile_x = 0; tile_x < 32; tile_x++) {
+            uint32_t *tile_dest = dest + tile_x * 8 + tile_y * 8 * 256;
+            if (tile_x >= 16 && !GB_is_cgb(gb)) {
+                for (unsigned y = 0; y < 8; y++) {
+                    for (unsigned x = 0; x < 8; x++) {
+                        tile_dest[x + y * 256] = gb->background_palettes_rgb[0];
                     }
                 }
+                continue;
+            }
+            const uint8_t *tile = get_decoded_tile(gb, (tile_x % 16) + tile_y * 16 + (tile_x >= 16? 384 : 0));
+            for (unsigned y = 0; y < 8; y++) {
+                for (unsigned x = 0; x < 8; x++) {
+                    tile_dest[x + y * 256] = colors[*(tile++)];
+                }
             }
-            
-            
-            *(dest++) = palette[pixel];
         }
     }
 }
@@ -1412,10 +1982,10 @@ void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
     
     switch (GB_is_cgb(gb)? palette_type : GB_PALETTE_NONE) {
         case GB_PALETTE_NONE:
-            none_palette[0] = gb->rgb_encode_callback(gb, 0xFF, 0xFF, 0xFF);
-            none_palette[1] = gb->rgb_encode_callback(gb, 0xAA, 0xAA, 0xAA);
-            none_palette[2] = gb->rgb_encode_callback(gb, 0x55, 0x55, 0x55);
-            none_palette[3] = gb->rgb_encode_callback(gb, 0,    0,    0   );
+            none_palette[0] = encode_rgb_for_viewer(gb, 0xFF, 0xFF, 0xFF);
+            none_palette[1] = encode_rgb_for_viewer(gb, 0xAA, 0xAA, 0xAA);
+            none_palette[2] = encode_rgb_for_viewer(gb, 0x55, 0x55, 0x55);
+            none_palette[3] = encode_rgb_for_viewer(gb, 0,    0,    0   );
             palette = none_palette;
             break;
         case GB_PALETTE_BACKGROUND:
@@ -1436,39 +2006,50 @@ void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
         tileset_type = (gb->io_registers[GB_IO_LCDC] & 0x10)? GB_TILESET_8800 : GB_TILESET_8000;
     }
     
-    for (unsigned y = 0; y < 256; y++) {
-        for (unsigned x = 0; x < 256; x++) {
-            uint8_t tile = gb->vram[map + x/8 + y/8 * 32];
-            uint16_t tile_address;
+    if (!allocate_decoded_tiles(gb)) return;
+    
+    /* Maps a decoded color index to the DMG shade, if needed */
+    uint8_t shades[4] = {0, 1, 2, 3};
+    if (!gb->cgb_mode && (palette_type == GB_PALETTE_BACKGROUND || palette_type == GB_PALETTE_AUTO)) {
+        for (unsigned i = 0; i < 4; i++) {
+            shades[i] = ((gb->io_registers[GB_IO_BGP] >> (i << 1)) & 3);
+        }
+    }
+    
+    for (unsigned tile_y = 0; tile_y < 32; tile_y++) {
+        for (unsigned tile_x = 0; tile_x < 32; tile_x++) {
+            uint8_t tile = gb->vram[map + tile_x + tile_y * 32];
             uint8_t attributes = 0;
+            unsigned tile_index;
             
             if (tileset_type == GB_TILESET_8800) {
-                tile_address = tile * 0x10;
+                tile_index = tile;
             }
             else {
-                tile_address = (int8_t) tile * 0x10 + 0x1000;
+                tile_index = (int8_t) tile + 0x100;
             }
             
             if (gb->cgb_mode) {
-                attributes = gb->vram[map + x/8 + y/8 * 32 + 0x2000];
+                attributes = gb->vram[map + tile_x + tile_y * 32 + 0x2000];
             }
             
             if (attributes & 0x8) {
-                tile_address += 0x2000;
+                tile_index += 384;
             }
             
-            uint8_t pixel = (((gb->vram[tile_address + (((attributes & 0x40)? ~y : y) & 7) * 2    ] >> (((attributes & 0x20)? x : ~x)&7)) & 1 ) |
-                             ((gb->vram[tile_address + (((attributes & 0x40)? ~y : y) & 7) * 2 + 1] >> (((attributes & 0x20)? x : ~x)&7)) & 1) << 1);
-            
-            if (!gb->cgb_mode && (palette_type == GB_PALETTE_BACKGROUND || palette_type == GB_PALETTE_AUTO)) {
-                pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
+            uint32_t colors[4];
+            for (unsigned i = 0; i < 4; i++) {
+                colors[i] = palette? palette[shades[i]] : gb->background_palettes_rgb[(attributes & 7) * 4 + shades[i]];
             }
             
-            if (palette) {
-                *(dest++) = palette[pixel];
-            }
-            else {
-                *(dest++) = gb->background_palettes_rgb[(attributes & 7) * 4 + pixel];
+            const uint8_t *decoded = get_decoded_tile(gb, tile_index);
+            uint8_t flip_x = (attributes & 0x20)? 7 : 0;
+            uint8_t flip_y = (attributes & 0x40)? 7 : 0;
+            uint32_t *tile_dest = dest + tile_x * 8 + tile_y * 8 * 256;
+            for (unsigned y = 0; y < 8; y++) {
+                for (unsigned x = 0; x < 8; x++) {
+                    tile_dest[x + y * 256] = colors[decoded[(x ^ flip_x) + (y ^ flip_y) * 8]];
+                }
             }
         }
     }
@@ -10,6 +10,11 @@ void GB_display_run(GB_gameboy_t *gb, uint8_t cycles);
 void GB_palette_changed(GB_gameboy_t *gb, bool background_palette, uint8_t index);
 void GB_STAT_update(GB_gameboy_t *gb);
 void GB_lcd_off(GB_gameboy_t *gb);
+void GB_display_sync(GB_gameboy_t *gb);
+void GB_update_dmg_palette(GB_gameboy_t *gb);
+void GB_refresh_palettes(GB_gameboy_t *gb);
+void GB_set_pixel(GB_gameboy_t *gb, size_t offset, uint32_t color);
+bool GB_can_encode_colors(GB_gameboy_t *gb);
 
 enum {
   GB_OBJECT_PRIORITY_UNDEFINED, // For save state compatibility
@@ -53,10 +58,33 @@ typedef enum {
     GB_COLOR_CORRECTION_REDUCE_CONTRAST,
 } GB_color_correction_mode_t;
 
+typedef enum {
+    GB_PIXEL_FORMAT_RGB_ENCODED, // 32-bit, encoded by the RGB encode callback
+    GB_PIXEL_FORMAT_RGB565,      // 16-bit native endian RGB565, the RGB encode callback is not used
+    GB_PIXEL_FORMAT_INDEXED,     // 8-bit indices into the frame palette, see GB_get_frame_palette
+} GB_pixel_format_t;
+
 void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette_type, uint8_t palette_index);
 void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette_type, uint8_t palette_index, GB_map_type_t map_type, GB_tileset_type_t tileset_type);
 uint8_t GB_get_oam_info(GB_gameboy_t *gb, GB_oam_info_t *dest, uint8_t *sprite_height);
 uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border);
 void GB_set_color_correction_mode(GB_gameboy_t *gb, GB_color_correction_mode_t mode);
 bool GB_is_odd_frame(GB_gameboy_t *gb);
+/* Colors returned by GB_convert_rgb15, GB_draw_tileset, GB_draw_tilemap and GB_get_oam_info follow the pixel
+   format as well, but are always 32-bit wide. In GB_PIXEL_FORMAT_INDEXED, the DMG shades GB_draw_tileset and
+   GB_draw_tilemap use for GB_PALETTE_NONE map to the nearest existing frame palette entries.
+   Changing the format doesn't convert what is already in the output buffers, so frontends must pass buffers sized for
+   the new format with GB_set_pixels_output or GB_set_pixels_output_buffers before the next frame. With
+   GB_BORDER_ALWAYS, the border is drawn again in the new format into each buffer the next time it is used. */
+void GB_set_pixel_format(GB_gameboy_t *gb, GB_pixel_format_t format);
+GB_pixel_format_t GB_get_pixel_format(GB_gameboy_t *gb);
+/* In GB_PIXEL_FORMAT_INDEXED, returns the colors (encoded by the RGB encode callback) the indices of the current
+   frame refer to. Only valid inside the vblank callback; up to 256 entries. */
+const uint32_t *GB_get_frame_palette(GB_gameboy_t *gb, unsigned *size);
+/* When enabled, the output lines that differ from the previous frame's are recorded every frame. The bitmap has one
+   bit per line of GB_get_screen_height (line n is bit n % 32 of word n / 32) and is valid inside the vblank callback.
+   Frames skipped in turbo mode are not counted as previous frames. */
+void GB_set_changed_lines_tracking(GB_gameboy_t *gb, bool enabled);
+const uint32_t *GB_get_changed_lines(GB_gameboy_t *gb);
+bool GB_is_line_changed(GB_gameboy_t *gb, unsigned line);
 #endif /* display_h */
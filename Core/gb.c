@@ -111,6 +111,7 @@ static char *default_async_input_callback(GB_gameboy_t *gb)
 static void load_default_border(GB_gameboy_t *gb)
 {
     if (gb->has_sgb_border) return;
+    gb->border_dirty = true;
     
     #define LOAD_BORDER() do { \
         memcpy(gb->borrowed_border.map, tilemap, sizeof(tilemap));\
@@ -202,11 +203,30 @@ void GB_free(GB_gameboy_t *gb)
     if (gb->nontrivial_jump_state) {
         free(gb->nontrivial_jump_state);
     }
+    for (unsigned i = 0; i < 2; i++) {
+        if (gb->rgb15_lut[i]) {
+            free(gb->rgb15_lut[i]);
+        }
+    }
+    if (gb->border_pixels) {
+        free(gb->border_pixels);
+    }
+    if (gb->decoded_tiles) {
+        free(gb->decoded_tiles);
+    }
     if (gb->undo_state) {
         free(gb->undo_state);
     }
+    if (gb->apu_output.channel_blep_buffers) {
+        free(gb->apu_output.channel_blep_buffers);
+    }
 #ifndef GB_DISABLE_DEBUGGER
     GB_debugger_clear_symbols(gb);
+    GB_set_trace_buffer(gb, NULL, 0, NULL);
+    GB_clear_profile(gb);
+    GB_set_coverage_enabled(gb, false);
+    GB_set_heatmap_enabled(gb, false);
+    GB_debugger_reverse_discard(gb);
 #endif
     GB_rewind_free(gb);
 #ifndef GB_DISABLE_CHEATS
@@ -267,6 +287,7 @@ void GB_borrow_sgb_border(GB_gameboy_t *gb)
         GB_run_frame(&sgb);
         if (sgb.sgb->border_animation) {
             gb->has_sgb_border = true;
+            gb->border_dirty = true;
             memcpy(&gb->borrowed_border, &sgb.sgb->pending_border, sizeof(gb->borrowed_border));
             gb->borrowed_border.palette[0] = sgb.sgb->effective_palettes[0];
             break;
@@ -994,9 +1015,23 @@ uint64_t GB_run_frame(GB_gameboy_t *gb)
     return gb->cycles_since_last_sync * 1000000000LL / 2 / GB_get_clock_rate(gb); /* / 2 because we use 8MHz units */
 }
 
-void GB_set_pixels_output(GB_gameboy_t *gb, uint32_t *output)
+void GB_set_pixels_output(GB_gameboy_t *gb, void *output)
 {
     gb->screen = output;
+    gb->output_buffer_count = 0;
+    memset(gb->border_drawn_screens, 0, sizeof(gb->border_drawn_screens));
+}
+
+void GB_set_pixels_output_buffers(GB_gameboy_t *gb, void *const *buffers, unsigned count)
+{
+    if (count > GB_MAX_OUTPUT_BUFFERS) {
+        count = GB_MAX_OUTPUT_BUFFERS;
+    }
+    memcpy(gb->output_buffers, buffers, sizeof(buffers[0]) * count);
+    gb->output_buffer_count = count;
+    gb->current_output_buffer = 0;
+    gb->screen = count? buffers[0] : NULL;
+    memset(gb->border_drawn_screens, 0, sizeof(gb->border_drawn_screens));
 }
 
 void GB_set_vblank_callback(GB_gameboy_t *gb, GB_vblank_callback_t callback)
@@ -1004,6 +1039,11 @@ void GB_set_vblank_callback(GB_gameboy_t *gb, GB_vblank_callback_t callback)
     gb->vblank_callback = callback;
 }
 
+void GB_set_frame_callback(GB_gameboy_t *gb, GB_frame_callback_t callback)
+{
+    gb->frame_callback = callback;
+}
+
 void GB_set_log_callback(GB_gameboy_t *gb, GB_log_callback_t callback)
 {
     gb->log_callback = callback;
@@ -1031,41 +1071,19 @@ const GB_palette_t GB_PALETTE_DMG  = {{{0x08, 0x18, 0x10}, {0x39, 0x61, 0x39}, {
 const GB_palette_t GB_PALETTE_MGB  = {{{0x07, 0x10, 0x0e}, {0x3a, 0x4c, 0x3a}, {0x81, 0x8d, 0x66}, {0xc2, 0xce, 0x93}, {0xcf, 0xda, 0xac}}};
 const GB_palette_t GB_PALETTE_GBL  = {{{0x0a, 0x1c, 0x15}, {0x35, 0x78, 0x62}, {0x56, 0xb4, 0x95}, {0x7f, 0xe2, 0xc3}, {0x91, 0xea, 0xd0}}};
 
-static void update_dmg_palette(GB_gameboy_t *gb)
-{
-    const GB_palette_t *palette = gb->dmg_palette ?: &GB_PALETTE_GREY;
-    if (gb->rgb_encode_callback && !GB_is_cgb(gb)) {
-        gb->sprite_palettes_rgb[4] = gb->sprite_palettes_rgb[0] = gb->background_palettes_rgb[0] =
-        gb->rgb_encode_callback(gb, palette->colors[3].r, palette->colors[3].g, palette->colors[3].b);
-        gb->sprite_palettes_rgb[5] = gb->sprite_palettes_rgb[1] = gb->background_palettes_rgb[1] =
-        gb->rgb_encode_callback(gb, palette->colors[2].r, palette->colors[2].g, palette->colors[2].b);
-        gb->sprite_palettes_rgb[6] = gb->sprite_palettes_rgb[2] = gb->background_palettes_rgb[2] =
-        gb->rgb_encode_callback(gb, palette->colors[1].r, palette->colors[1].g, palette->colors[1].b);
-        gb->sprite_palettes_rgb[7] = gb->sprite_palettes_rgb[3] = gb->background_palettes_rgb[3] =
-        gb->rgb_encode_callback(gb, palette->colors[0].r, palette->colors[0].g, palette->colors[0].b);
-        
-        // LCD off color
-        gb->background_palettes_rgb[4] =
-        gb->rgb_encode_callback(gb, palette->colors[4].r, palette->colors[4].g, palette->colors[4].b);
-    }
-}
-
 void GB_set_palette(GB_gameboy_t *gb, const GB_palette_t *palette)
 {
     gb->dmg_palette = palette;
-    update_dmg_palette(gb);
+    GB_update_dmg_palette(gb);
 }
 
 void GB_set_rgb_encode_callback(GB_gameboy_t *gb, GB_rgb_encode_callback_t callback)
 {
 
     gb->rgb_encode_callback = callback;
-    update_dmg_palette(gb);
-    
-    for (unsigned i = 0; i < 32; i++) {
-        GB_palette_changed(gb, true, i * 2);
-        GB_palette_changed(gb, false, i * 2);
-    }
+    gb->rgb15_lut_valid[0] = gb->rgb15_lut_valid[1] = false;
+    gb->border_dirty = true;
+    GB_refresh_palettes(gb);
 }
 
 void GB_set_infrared_callback(GB_gameboy_t *gb, GB_infrared_callback_t callback)
@@ -1086,11 +1104,13 @@ void GB_set_rumble_callback(GB_gameboy_t *gb, GB_rumble_callback_t callback)
 void GB_set_serial_transfer_bit_start_callback(GB_gameboy_t *gb, GB_serial_transfer_bit_start_callback_t callback)
 {
     gb->serial_transfer_bit_start_callback = callback;
+    gb->internal_serial_device = false;
 }
 
 void GB_set_serial_transfer_bit_end_callback(GB_gameboy_t *gb, GB_serial_transfer_bit_end_callback_t callback)
 {
     gb->serial_transfer_bit_end_callback = callback;
+    gb->internal_serial_device = false;
 }
 
 bool GB_serial_get_data_bit(GB_gameboy_t *gb)
@@ -1122,6 +1142,7 @@ void GB_disconnect_serial(GB_gameboy_t *gb)
 {
     gb->serial_transfer_bit_start_callback = NULL;
     gb->serial_transfer_bit_end_callback = NULL;
+    gb->internal_serial_device = false;
     
     /* Reset any internally-emulated device. */
     memset(&gb->printer, 0, sizeof(gb->printer));
@@ -1353,11 +1374,17 @@ static void request_boot_rom(GB_gameboy_t *gb)
 
 void GB_reset(GB_gameboy_t *gb)
 {
+    if (gb->reverse) {
+        GB_debugger_reverse_discard(gb);
+    }
     uint32_t mbc_ram_size = gb->mbc_ram_size;
     GB_model_t model = gb->model;
     memset(gb, 0, (size_t)GB_GET_SECTION((GB_gameboy_t *) 0, unsaved));
     gb->model = model;
     gb->version = GB_STRUCT_VERSION;
+    memset(gb->decoded_tiles_valid, 0, sizeof(gb->decoded_tiles_valid));
+    gb->object_lines_dirty = true;
+    gb->split_fifos = true;
     
     gb->mbc_rom_bank = 1;
     gb->last_rtc_second = time(NULL);
@@ -1377,7 +1404,7 @@ void GB_reset(GB_gameboy_t *gb)
         memset(gb->vram, 0, gb->vram_size);
         gb->object_priority = GB_OBJECT_PRIORITY_X;
         
-        update_dmg_palette(gb);
+        GB_update_dmg_palette(gb);
     }
     reset_ram(gb);
     
@@ -1443,6 +1470,7 @@ void GB_switch_model_and_reset(GB_gameboy_t *gb, GB_model_t model)
     }
     GB_rewind_free(gb);
     GB_reset(gb);
+    GB_debugger_coverage_restart(gb);
     load_default_border(gb);
 }
 
@@ -1474,6 +1502,9 @@ void *GB_get_direct_access(GB_gameboy_t *gb, GB_direct_access_t access, size_t *
             *bank = gb->mbc_ram_bank;
             return gb->mbc_ram;
         case GB_DIRECT_ACCESS_VRAM:
+            /* The caller may write to VRAM directly, now or at any later point */
+            memset(gb->decoded_tiles_valid, 0, sizeof(gb->decoded_tiles_valid));
+            gb->vram_oam_exposed = true;
             *size = gb->vram_size;
             *bank = gb->cgb_vram_bank;
             return gb->vram;
@@ -1490,6 +1521,9 @@ void *GB_get_direct_access(GB_gameboy_t *gb, GB_direct_access_t access, size_t *
             *bank = 0;
             return &gb->boot_rom;
         case GB_DIRECT_ACCESS_OAM:
+            /* The caller may write to OAM directly, now or at any later point */
+            gb->object_lines_dirty = true;
+            gb->vram_oam_exposed = true;
             *size = sizeof(gb->oam);
             *bank = 0;
             return &gb->oam;
@@ -1533,6 +1567,7 @@ void GB_set_border_mode(GB_gameboy_t *gb, GB_border_mode_t border_mode)
 {
     if (gb->border_mode > GB_BORDER_ALWAYS) return;
     gb->border_mode = border_mode;
+    gb->border_dirty = true;
 }
 
 unsigned GB_get_screen_width(GB_gameboy_t *gb)
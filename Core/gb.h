@@ -249,6 +249,9 @@ typedef enum {
     GB_BOOT_ROM_AGB,
 } GB_boot_rom_t;
 
+#define GB_MAX_OUTPUT_BUFFERS 3
+#define GB_DECODED_TILES (384 * 2)
+
 #ifdef GB_INTERNAL
 #define LCDC_PERIOD 70224
 #define CPU_FREQUENCY 0x400000
@@ -267,6 +270,7 @@ typedef enum {
 #endif
 
 typedef void (*GB_vblank_callback_t)(GB_gameboy_t *gb);
+typedef void (*GB_frame_callback_t)(GB_gameboy_t *gb, void *frame, uint64_t sequence);
 typedef void (*GB_log_callback_t)(GB_gameboy_t *gb, const char *string, GB_log_attributes attributes);
 typedef char *(*GB_input_callback_t)(GB_gameboy_t *gb);
 typedef uint32_t (*GB_rgb_encode_callback_t)(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b);
@@ -283,17 +287,18 @@ typedef void (*GB_boot_rom_load_callback_t)(GB_gameboy_t *gb, GB_boot_rom_t type
 
 struct GB_breakpoint_s;
 struct GB_watchpoint_s;
-
-typedef struct {
-    uint8_t pixel; // Color, 0-3
-    uint8_t palette; // Palette, 0 - 7 (CGB); 0-1 in DMG (or just 0 for BG)
-    uint8_t priority; // Sprite priority – 0 in DMG, OAM index in CGB
-    bool bg_priority; // For sprite FIFO – the BG priority bit. For the BG FIFO – the CGB attributes priority bit
-} GB_fifo_item_t;
+struct GB_profile_s;
+struct GB_coverage_s;
+struct GB_symbol_arena_s;
+struct GB_reverse_s;
 
 #define GB_FIFO_LENGTH 16
+/* Every pixel property is kept in its own array, so a row of 8 pixels can be pushed or blended at once */
 typedef struct {
-    GB_fifo_item_t fifo[GB_FIFO_LENGTH];
+    uint8_t pixel[GB_FIFO_LENGTH]; // Color, 0-3
+    uint8_t palette[GB_FIFO_LENGTH]; // Palette, 0 - 7 (CGB); 0-1 in DMG (or just 0 for BG)
+    uint8_t priority[GB_FIFO_LENGTH]; // Sprite priority – 0 in DMG, OAM index in CGB
+    bool bg_priority[GB_FIFO_LENGTH]; // For sprite FIFO – the BG priority bit. For the BG FIFO – the CGB attributes priority bit
     uint8_t read_end;
     uint8_t write_end;
 } GB_fifo_t;
@@ -545,6 +550,9 @@ struct GB_gameboy_internal_s {
         uint16_t last_tile_index_address;
         bool cgb_repeated_a_frame;
         uint8_t data_for_sel_glitch;
+        /* Nonzero since the FIFOs keep each property in its own array, 0 when loading older save states.
+           32-bit so the section grows past its old padding, which older save states did not zero. */
+        uint32_t split_fifos;
     );
 
     /* Unsaved data. This includes all pointers, as well as everything that shouldn't be on a save state */
@@ -568,7 +576,12 @@ struct GB_gameboy_internal_s {
         uint8_t *mbc_ram;
 
         /* I/O */
-        uint32_t *screen;
+        void *screen;
+        void *output_buffers[GB_MAX_OUTPUT_BUFFERS];
+        unsigned output_buffer_count;
+        unsigned current_output_buffer;
+        uint64_t frame_sequence;
+        GB_pixel_format_t pixel_format;
         uint32_t background_palettes_rgb[0x20];
         uint32_t sprite_palettes_rgb[0x20];
         const GB_palette_t *dmg_palette;
@@ -578,10 +591,43 @@ struct GB_gameboy_internal_s {
         GB_sgb_border_t borrowed_border;
         bool tried_loading_sgb_border;
         bool has_sgb_border;
+        /* Colors used by the current frame in GB_PIXEL_FORMAT_INDEXED, encoded and as 0xRRGGBB */
+        uint32_t frame_palette[0x100];
+        uint32_t frame_palette_rgb[0x100];
+        unsigned frame_palette_size;
+        /* 32768-entry color conversion tables for screen and border colors, built on demand and rebuilt when the
+           color correction mode, model or pixel format they were built for changes, or when the RGB encode
+           callback is set (even to the same function, as the frontend's encoding may have changed) */
+        uint32_t *rgb15_lut[2];
+        uint32_t rgb15_lut_key[2];
+        bool rgb15_lut_valid[2];
+        /* Cached GB_BORDER_ALWAYS border, see render_border */
+        uint8_t *border_pixels;
+        uint32_t border_colors[0x40];
+        uint16_t border_colors_palette[0x40];
+        uint32_t border_colors_key;
+        void *border_drawn_screens[GB_MAX_OUTPUT_BUFFERS]; // Output buffers that are known to contain the current border
+        bool border_dirty;
+        /* Changed line tracking, one entry per output line (up to 224) */
+        bool track_changed_lines;
+        uint64_t changed_lines_key;
+        uint64_t line_hashes[224];
+        uint32_t changed_lines[224 / 32];
+        /* Decoded VRAM tiles for GB_draw_tileset and GB_draw_tilemap, 8x8 color indices each */
+        uint8_t *decoded_tiles;
+        uint64_t decoded_tiles_valid[GB_DECODED_TILES / 64];
+        /* Bitmap of the objects whose Y range covers each line, rebuilt when OAM or the object height changes */
+        uint64_t object_lines[0x100];
+        bool object_lines_dirty;
+        bool object_lines_height_16;
+        /* VRAM or OAM was handed out by GB_get_direct_access, so the caches above are dropped every frame */
+        bool vram_oam_exposed;
                
         /* Timing */
         uint64_t last_sync;
         uint64_t cycles_since_last_sync; // In 8MHz units
+        int64_t sync_spin_margin; // How long before a deadline to stop sleeping and start spinning, in nanoseconds
+        GB_timing_stats_t timing_stats;
 
         /* Audio */
         GB_apu_output_t apu_output;
@@ -593,12 +639,14 @@ struct GB_gameboy_internal_s {
         GB_input_callback_t async_input_callback;
         GB_rgb_encode_callback_t rgb_encode_callback;
         GB_vblank_callback_t vblank_callback;
+        GB_frame_callback_t frame_callback;
         GB_infrared_callback_t infrared_callback;
         GB_camera_get_pixel_callback_t camera_get_pixel_callback;
         GB_camera_update_request_callback_t camera_update_request_callback;
         GB_rumble_callback_t rumble_callback;
         GB_serial_transfer_bit_start_callback_t serial_transfer_bit_start_callback;
         GB_serial_transfer_bit_end_callback_t serial_transfer_bit_end_callback;
+        bool internal_serial_device; /* The serial callbacks are the printer's or the Workboy's, not the frontend's */
         GB_update_input_hint_callback_t update_input_hint_callback;
         GB_joyp_write_callback_t joyp_write_callback;
         GB_icd_pixel_callback_t icd_pixel_callback;
@@ -620,6 +668,7 @@ struct GB_gameboy_internal_s {
         bool has_jump_to_breakpoints, has_software_breakpoints;
         void *nontrivial_jump_state;
         bool non_trivial_jump_breakpoint_occured;
+        uint8_t breakpoint_map[0x10000 / 8]; /* Addresses with a breakpoint in any bank */
 
         /* SLD (Todo: merge with backtrace) */
         bool stack_leak_detection;
@@ -638,13 +687,40 @@ struct GB_gameboy_internal_s {
         /* Watchpoints */
         uint16_t n_watchpoints;
         struct GB_watchpoint_s *watchpoints;
+        uint8_t read_watchpoint_map[0x10000 / 8], write_watchpoint_map[0x10000 / 8];
 
         /* Symbol tables */
         GB_symbol_map_t *bank_symbols[0x200];
         GB_reversed_symbol_map_t reversed_symbol_map;
+        struct GB_symbol_arena_s *symbol_arenas;
 
         /* Ticks command */
         uint64_t debugger_ticks;
+        uint64_t debugger_ticks_mark;
+
+        /* Execution trace */
+        GB_trace_record_t *trace_buffer;
+        size_t trace_size, trace_position;
+        bool trace_wrapped;
+        GB_trace_callback_t trace_callback;
+        void *trace_file; /* FILE *, set when tracing was started by the trace command */
+
+        /* Profiler */
+        struct GB_profile_s *profile;
+        uint64_t profile_next_sample; /* In debugger ticks, UINT64_MAX when not profiling */
+
+        /* Coverage */
+        struct GB_coverage_s *coverage;
+
+        /* Heatmap */
+        GB_heatmap_t *heatmap;
+        GB_heatmap_callback_t heatmap_callback;
+        unsigned heatmap_interval, heatmap_frames;
+
+        /* Reverse execution */
+        struct GB_reverse_s *reverse;
+        bool reverse_recording;
+        uint64_t debugger_steps; /* Incremented every time the debugger runs, identifies the instruction it runs before */
                
         /* Undo */
         uint8_t *undo_state;
@@ -734,7 +810,11 @@ typedef enum {
 } GB_direct_access_t;
 
 /* Returns a mutable pointer to various hardware memories. If that memory is banked, the current bank
-   is returned at *bank, even if only a portion of the memory is banked. */
+   is returned at *bank, even if only a portion of the memory is banked.
+   Returning VRAM or OAM drops the core's caches of decoded tiles and object positions, and from then on they are
+   also dropped at the start of every frame. Writes made through such a pointer after the call are therefore seen
+   by rendering and the tile viewers up to one frame late. Calling this again after writing makes them visible
+   right away. */
 void *GB_get_direct_access(GB_gameboy_t *gb, GB_direct_access_t access, size_t *size, uint16_t *bank);
 
 void *GB_get_user_data(GB_gameboy_t *gb);
@@ -761,12 +841,24 @@ void GB_set_rendering_disabled(GB_gameboy_t *gb, bool disabled);
 void GB_log(GB_gameboy_t *gb, const char *fmt, ...) __printflike(2, 3);
 void GB_attributed_log(GB_gameboy_t *gb, GB_log_attributes attributes, const char *fmt, ...) __printflike(3, 4);
 
-void GB_set_pixels_output(GB_gameboy_t *gb, uint32_t *output);
+/* Output must point to a buffer of GB_get_screen_width * GB_get_screen_height pixels, in the format set by
+   GB_set_pixel_format (32-bit encoded colors by default). With GB_BORDER_ALWAYS, the border is only redrawn into
+   buffers that don't already contain it, so frontends must not draw over the border area of an output buffer.
+   Calling GB_set_pixels_output or GB_set_pixels_output_buffers again makes the core redraw the border into every
+   buffer, including ones it was drawn into before. */
+void GB_set_pixels_output(GB_gameboy_t *gb, void *output);
+/* Rotates between up to GB_MAX_OUTPUT_BUFFERS buffers of the same size: once a frame is complete it's passed to the
+   frame callback, and the core moves on to the next buffer. A buffer is not written to again until count - 1 more
+   frames were completed, so it can be presented from another thread in the meantime. */
+void GB_set_pixels_output_buffers(GB_gameboy_t *gb, void *const *buffers, unsigned count);
 void GB_set_border_mode(GB_gameboy_t *gb, GB_border_mode_t border_mode);
     
 void GB_set_infrared_input(GB_gameboy_t *gb, bool state);
     
 void GB_set_vblank_callback(GB_gameboy_t *gb, GB_vblank_callback_t callback);
+/* Called after the vblank callback with the finished frame. The sequence number counts every frame, including ones
+   skipped in turbo mode, so gaps indicate dropped frames. */
+void GB_set_frame_callback(GB_gameboy_t *gb, GB_frame_callback_t callback);
 void GB_set_log_callback(GB_gameboy_t *gb, GB_log_callback_t callback);
 void GB_set_input_callback(GB_gameboy_t *gb, GB_input_callback_t callback);
 void GB_set_async_input_callback(GB_gameboy_t *gb, GB_input_callback_t callback);
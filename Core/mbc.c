@@ -164,4 +164,6 @@ void GB_configure_cart(GB_gameboy_t *gb)
     if (gb->cartridge_type->mbc_type == GB_MBC5) {
         gb->mbc5.rom_bank_low = 1;
     }
+    
+    GB_debugger_coverage_restart(gb);
 }
@@ -49,6 +49,7 @@ void GB_trigger_oam_bug(GB_gameboy_t *gb, uint16_t address)
     if (GB_is_cgb(gb)) return;
     
     if (address >= 0xFE00 && address < 0xFF00) {
+        gb->object_lines_dirty = true;
         if (gb->accessed_oam_row != 0xff && gb->accessed_oam_row >= 8) {
             gb->oam[gb->accessed_oam_row] = bitwise_glitch(gb->oam[gb->accessed_oam_row],
                                                            gb->oam[gb->accessed_oam_row - 8],
@@ -68,6 +69,7 @@ void GB_trigger_oam_bug_read(GB_gameboy_t *gb, uint16_t address)
     if (GB_is_cgb(gb)) return;
     
     if (address >= 0xFE00 && address < 0xFF00) {
+        gb->object_lines_dirty = true;
         if (gb->accessed_oam_row != 0xff && gb->accessed_oam_row >= 8) {
             gb->oam[gb->accessed_oam_row - 8] =
             gb->oam[gb->accessed_oam_row]     = bitwise_glitch_read(gb->oam[gb->accessed_oam_row],
@@ -89,6 +91,7 @@ void GB_trigger_oam_bug_read_increase(GB_gameboy_t *gb, uint16_t address)
     if (GB_is_cgb(gb)) return;
     
     if (address >= 0xFE00 && address < 0xFF00) {
+        gb->object_lines_dirty = true;
         if (gb->accessed_oam_row != 0xff && gb->accessed_oam_row >= 0x20 && gb->accessed_oam_row < 0x98) {            
             gb->oam[gb->accessed_oam_row - 0x8] = bitwise_glitch_read_increase(gb->oam[gb->accessed_oam_row - 0x10],
                                                                                gb->oam[gb->accessed_oam_row - 0x08],
@@ -254,6 +257,7 @@ static uint8_t read_high_memory(GB_gameboy_t *gb, uint16_t addr)
         if (gb->oam_read_blocked) {
             if (!GB_is_cgb(gb)) {
                 if (addr < 0xFEA0) {
+                    gb->object_lines_dirty = true;
                     if (gb->accessed_oam_row == 0) {
                         gb->oam[(addr & 0xf8)] =
                         gb->oam[0] = bitwise_glitch_read(gb->oam[0],
@@ -473,22 +477,48 @@ void GB_set_read_memory_callback(GB_gameboy_t *gb, GB_read_memory_callback_t cal
     gb->read_memory_callback = callback;
 }
 
-uint8_t GB_read_memory(GB_gameboy_t *gb, uint16_t addr)
+static inline uint8_t read_memory(GB_gameboy_t *gb, uint16_t addr, bool emulated)
 {
     if (gb->n_watchpoints) {
         GB_debugger_test_read_watchpoint(gb, addr);
     }
+    if (gb->heatmap) {
+        GB_debugger_heatmap_read(gb, addr);
+    }
     if (is_addr_in_dma_use(gb, addr)) {
         addr = gb->dma_current_src;
     }
-    uint8_t data = read_map[addr >> 12](gb, addr);
+    uint8_t data;
+    /* Camera images come from the frontend or from random noise, so replays use the bytes that were read instead */
+    bool camera = emulated && (addr & 0xE000) == 0xA000 && gb->cartridge_type->mbc_subtype == GB_CAMERA;
+    if (!camera || !GB_debugger_replay_input(gb, &data, sizeof(data))) {
+        data = read_map[addr >> 12](gb, addr);
+        if (camera) {
+            GB_debugger_record_input(gb, &data, sizeof(data));
+        }
+    }
     GB_apply_cheat(gb, addr, &data);
     if (gb->read_memory_callback) {
-        data = gb->read_memory_callback(gb, addr, data);
+        /* Only reads the emulated hardware makes happen again when history is replayed */
+        if (!emulated) return gb->read_memory_callback(gb, addr, data);
+        if (!GB_debugger_replay_input(gb, &data, sizeof(data))) {
+            data = gb->read_memory_callback(gb, addr, data);
+            GB_debugger_record_input(gb, &data, sizeof(data));
+        }
     }
     return data;
 }
 
+uint8_t GB_read_memory(GB_gameboy_t *gb, uint16_t addr)
+{
+    return read_memory(gb, addr, false);
+}
+
+uint8_t GB_emulated_read_memory(GB_gameboy_t *gb, uint16_t addr)
+{
+    return read_memory(gb, addr, true);
+}
+
 static void write_mbc(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
 {
     switch (gb->cartridge_type->mbc_type) {
@@ -568,6 +598,7 @@ static void write_vram(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
         //GB_log(gb, "Wrote %02x to %04x (VRAM) during mode 3\n", value, addr);
         return;
     }
+    GB_display_sync(gb);
     /* TODO: not verified */
     if (gb->display_state == 22 && GB_is_cgb(gb) && !gb->cgb_double_speed) {
         if (addr & 0x1000) {
@@ -582,6 +613,10 @@ static void write_vram(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
         }
     }
     gb->vram[(addr & 0x1FFF) + (uint16_t) gb->cgb_vram_bank * 0x2000] = value;
+    if ((addr & 0x1FFF) < 0x1800) {
+        unsigned tile = ((addr & 0x1FFF) >> 4) + gb->cgb_vram_bank * 384;
+        gb->decoded_tiles_valid[tile / 64] &= ~(1ULL << (tile % 64));
+    }
 }
 
 static bool huc3_write(GB_gameboy_t *gb, uint8_t value)
@@ -652,7 +687,7 @@ static bool huc3_write(GB_gameboy_t *gb, uint8_t value)
         case 0xE: { // IR mode
             if (gb->cart_ir != (value & 1)) {
                 gb->cart_ir = value & 1;
-                if (gb->infrared_callback) {
+                if (gb->infrared_callback && !GB_debugger_is_replaying(gb)) {
                     gb->infrared_callback(gb, value & 1);
                 }
             }
@@ -685,7 +720,7 @@ static void write_mbc_ram(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
     if (gb->cartridge_type->mbc_type == GB_HUC1 && gb->huc1.ir_mode) {
         if (gb->cart_ir != (value & 1)) {
             gb->cart_ir = value & 1;
-            if (gb->infrared_callback) {
+            if (gb->infrared_callback && !GB_debugger_is_replaying(gb)) {
                 gb->infrared_callback(gb, value & 1);
             }
         }
@@ -738,6 +773,7 @@ static void write_high_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
             return;
         }
         
+        gb->object_lines_dirty = true;
         if (GB_is_cgb(gb)) {
             if (addr < 0xFEA0) {
                 gb->oam[addr & 0xFF] = value;
@@ -809,6 +845,11 @@ static void write_high_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
     /* Todo: Clean this code up: use a function table and move relevant code to display.c and timing.c
        (APU read and writes are already at apu.c) */
     if (addr < 0xFF80) {
+        /* Registers that may affect a batched line */
+        if ((addr & 0xFF) >= GB_IO_LCDC) {
+            GB_display_sync(gb);
+        }
+        
         /* Hardware registers */
         switch (addr & 0xFF) {
             case GB_IO_WY:
@@ -940,7 +981,7 @@ static void write_high_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
                 return;
 
             case GB_IO_JOYP:
-                if (gb->joyp_write_callback) {
+                if (gb->joyp_write_callback && !GB_debugger_is_replaying(gb)) {
                     gb->joyp_write_callback(gb, value);
                     GB_update_joyp(gb);
                 }
@@ -1087,7 +1128,7 @@ static void write_high_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
                     gb->serial_count = 0;
                     /* Todo: This is probably incorrect for CGB's faster clock mode. */
                     gb->serial_cycles &= 0xFF;
-                    if (gb->serial_transfer_bit_start_callback) {
+                    if (gb->serial_transfer_bit_start_callback && (gb->internal_serial_device || !GB_debugger_is_replaying(gb))) {
                         gb->serial_transfer_bit_start_callback(gb, gb->io_registers[GB_IO_SB] & 0x80);
                     }
                 }
@@ -1101,7 +1142,7 @@ static void write_high_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
                     return;
                 }
                 if ((gb->io_registers[GB_IO_RP] ^ value) & 1) {
-                    if (gb->infrared_callback) {
+                    if (gb->infrared_callback && !GB_debugger_is_replaying(gb)) {
                         gb->infrared_callback(gb, value & 1);
                     }
                 }
@@ -1147,6 +1188,9 @@ void GB_write_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
     if (gb->n_watchpoints) {
         GB_debugger_test_write_watchpoint(gb, addr, value);
     }
+    if (gb->heatmap) {
+        GB_debugger_heatmap_write(gb, addr);
+    }
     if (is_addr_in_dma_use(gb, addr)) {
         /* Todo: What should happen? Will this affect DMA? Will data be written? What and where? */
         return;
@@ -1162,17 +1206,21 @@ void GB_dma_run(GB_gameboy_t *gb)
         gb->dma_steps_left--;
         
         if (gb->dma_current_src < 0xe000) {
-            gb->oam[gb->dma_current_dest++] = GB_read_memory(gb, gb->dma_current_src);
+            gb->oam[gb->dma_current_dest++] = GB_emulated_read_memory(gb, gb->dma_current_src);
         }
         else {
             /* Todo: Not correct on the CGB */
-            gb->oam[gb->dma_current_dest++] = GB_read_memory(gb, gb->dma_current_src & ~0x2000);
+            gb->oam[gb->dma_current_dest++] = GB_emulated_read_memory(gb, gb->dma_current_src & ~0x2000);
         }
         
         /* dma_current_src must be the correct value during GB_read_memory */
         gb->dma_current_src++;
         if (!gb->dma_steps_left) {
             gb->is_dma_restarting = false;
+            /* OAM is only written once dma_cycles is non-negative (or while restarting), and the PPU is blocked from
+               OAM from that point until the DMA ends, so the object lines only need updating once it's done. During
+               the startup delay the PPU can still read OAM, but the DMA hasn't changed it yet. */
+            gb->object_lines_dirty = true;
         }
     }
 }
@@ -1184,7 +1232,7 @@ void GB_hdma_run(GB_gameboy_t *gb)
     while (gb->hdma_cycles >= 0x4) {
         gb->hdma_cycles -= 0x4;
 
-        GB_write_memory(gb, 0x8000 | (gb->hdma_current_dest++ & 0x1FFF), GB_read_memory(gb, (gb->hdma_current_src++)));
+        GB_write_memory(gb, 0x8000 | (gb->hdma_current_dest++ & 0x1FFF), GB_emulated_read_memory(gb, (gb->hdma_current_src++)));
         
         if ((gb->hdma_current_dest & 0xf) == 0) {
             if (--gb->hdma_steps_left == 0) {
@@ -9,6 +9,7 @@ void GB_set_read_memory_callback(GB_gameboy_t *gb, GB_read_memory_callback_t cal
 uint8_t GB_read_memory(GB_gameboy_t *gb, uint16_t addr);
 void GB_write_memory(GB_gameboy_t *gb, uint16_t addr, uint8_t value);
 #ifdef GB_INTERNAL
+uint8_t GB_emulated_read_memory(GB_gameboy_t *gb, uint16_t addr); /* Like GB_read_memory, but part of the reverse history */
 void GB_dma_run(GB_gameboy_t *gb);
 void GB_hdma_run(GB_gameboy_t *gb);
 void GB_trigger_oam_bug(GB_gameboy_t *gb, uint16_t address);
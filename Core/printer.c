@@ -9,6 +9,14 @@
  
          Also, field mask values are assumed. */
 
+static uint32_t encode_color(GB_gameboy_t *gb, uint8_t shade)
+{
+    if (!gb->rgb_encode_callback) {
+        return (shade << 16) | (shade << 8) | shade;
+    }
+    return gb->rgb_encode_callback(gb, shade, shade, shade);
+}
+
 static void handle_command(GB_gameboy_t *gb)
 {
     
@@ -23,15 +31,15 @@ static void handle_command(GB_gameboy_t *gb)
                 gb->printer.status = 6; /* Printing */
                 uint32_t image[gb->printer.image_offset];
                 uint8_t palette = gb->printer.command_data[2];
-                uint32_t colors[4] = {gb->rgb_encode_callback(gb, 0xff, 0xff, 0xff),
-                                      gb->rgb_encode_callback(gb, 0xaa, 0xaa, 0xaa),
-                                      gb->rgb_encode_callback(gb, 0x55, 0x55, 0x55),
-                                      gb->rgb_encode_callback(gb, 0x00, 0x00, 0x00)};
+                uint32_t colors[4] = {encode_color(gb, 0xff),
+                                      encode_color(gb, 0xaa),
+                                      encode_color(gb, 0x55),
+                                      encode_color(gb, 0x00)};
                 for (unsigned i = 0; i < gb->printer.image_offset; i++) {
                     image[i] = colors[(palette >> (gb->printer.image[i] * 2)) & 3];
                 }
                 
-                if (gb->printer_callback) {
+                if (gb->printer_callback && !GB_debugger_is_replaying(gb)) {
                     gb->printer_callback(gb, image, gb->printer.image_offset / 160,
                                          gb->printer.command_data[1] >> 4, gb->printer.command_data[1] & 7,
                                          gb->printer.command_data[3] & 0x7F);
@@ -212,5 +220,6 @@ void GB_connect_printer(GB_gameboy_t *gb, GB_print_image_callback_t callback)
     memset(&gb->printer, 0, sizeof(gb->printer));
     GB_set_serial_transfer_bit_start_callback(gb, serial_start);
     GB_set_serial_transfer_bit_end_callback(gb, serial_end);
+    gb->internal_serial_device = true;
     gb->printer_callback = callback;
 }
@@ -60,5 +60,7 @@ typedef struct
 } GB_printer_t;
 
 
+/* Images are 160 pixels wide, in colors encoded by the RGB encode callback whatever the pixel format is, or as
+   0x00RRGGBB if there is no callback */
 void GB_connect_printer(GB_gameboy_t *gb, GB_print_image_callback_t callback);
 #endif
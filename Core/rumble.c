@@ -17,7 +17,9 @@ void GB_handle_rumble(GB_gameboy_t *gb)
         }
         if (gb->cartridge_type->has_rumble) {
             if (gb->rumble_on_cycles + gb->rumble_off_cycles) {
-                gb->rumble_callback(gb, gb->rumble_on_cycles / (double)(gb->rumble_on_cycles + gb->rumble_off_cycles));
+                if (!GB_debugger_is_replaying(gb)) {
+                    gb->rumble_callback(gb, gb->rumble_on_cycles / (double)(gb->rumble_on_cycles + gb->rumble_off_cycles));
+                }
                 gb->rumble_on_cycles = gb->rumble_off_cycles = 0;
             }
         }
@@ -47,7 +49,9 @@ void GB_handle_rumble(GB_gameboy_t *gb)
                 ch1_rumble = 0;
             }
             
-            gb->rumble_callback(gb, MIN(MAX(ch1_rumble / 2 + ch4_rumble, 0.0), 1.0));
+            if (!GB_debugger_is_replaying(gb)) {
+                gb->rumble_callback(gb, MIN(MAX(ch1_rumble / 2 + ch4_rumble, 0.0), 1.0));
+            }
         }
     }
 }
@@ -26,6 +26,9 @@ int GB_save_state(GB_gameboy_t *gb, const char *path)
         return errno;
     }
     
+    /* A batched line leaves the PPU state untouched until it wakes up, so bring it up to date first */
+    GB_display_sync(gb);
+    
     if (fwrite(GB_GET_SECTION(gb, header), 1, GB_SECTION_SIZE(header), f) != GB_SECTION_SIZE(header)) goto error;
     if (!DUMP_SECTION(gb, f, core_state)) goto error;
     if (!DUMP_SECTION(gb, f, dma       )) goto error;
@@ -94,6 +97,7 @@ static void buffer_dump_section(uint8_t **buffer, const void *src, uint32_t size
 #define DUMP_SECTION(gb, buffer, section) buffer_dump_section(&buffer, GB_GET_SECTION(gb, section), GB_SECTION_SIZE(section))
 void GB_save_state_to_buffer(GB_gameboy_t *gb, uint8_t *buffer)
 {
+    GB_display_sync(gb);
     buffer_write(GB_GET_SECTION(gb, header), GB_SECTION_SIZE(header), &buffer);
     DUMP_SECTION(gb, buffer, core_state);
     DUMP_SECTION(gb, buffer, dma       );
@@ -146,6 +150,19 @@ static bool read_section(FILE *f, void *dest, uint32_t size, bool fix_broken_win
 }
 #undef DUMP_SECTION
 
+/* Older save states store each FIFO entry's pixel, palette, priority and BG priority together */
+static void split_fifo(GB_fifo_t *fifo)
+{
+    uint8_t entries[GB_FIFO_LENGTH][4];
+    memcpy(entries, fifo, sizeof(entries));
+    for (unsigned i = 0; i < GB_FIFO_LENGTH; i++) {
+        fifo->pixel[i] = entries[i][0];
+        fifo->palette[i] = entries[i][1];
+        fifo->priority[i] = entries[i][2];
+        fifo->bg_priority[i] = entries[i][3] != 0;
+    }
+}
+
 static bool verify_and_update_state_compatibility(GB_gameboy_t *gb, GB_gameboy_t *save)
 {
     if (save->ram_size == 0 && (&save->ram_size)[-1] == gb->ram_size) {
@@ -163,6 +180,12 @@ static bool verify_and_update_state_compatibility(GB_gameboy_t *gb, GB_gameboy_t
         }
     }
     
+    if (!save->split_fifos) {
+        split_fifo(&save->bg_fifo);
+        split_fifo(&save->oam_fifo);
+        save->split_fifos = true;
+    }
+    
     if (gb->version != save->version) {
         GB_log(gb, "The save state is for a different version of SameBoy.\n");
         return false;
@@ -199,6 +222,8 @@ static bool verify_and_update_state_compatibility(GB_gameboy_t *gb, GB_gameboy_t
 
 static void sanitize_state(GB_gameboy_t *gb)
 {
+    memset(gb->decoded_tiles_valid, 0, sizeof(gb->decoded_tiles_valid));
+    gb->object_lines_dirty = true;
     for (unsigned i = 0; i < 32; i++) {
         GB_palette_changed(gb, false, i * 2);
         GB_palette_changed(gb, true, i * 2);
@@ -208,7 +233,16 @@ static void sanitize_state(GB_gameboy_t *gb)
     gb->bg_fifo.write_end &= 0xF;
     gb->oam_fifo.read_end &= 0xF;
     gb->oam_fifo.write_end &= 0xF;
-    gb->object_low_line_address &= gb->vram_size & ~1;
+    for (unsigned i = 0; i < GB_FIFO_LENGTH; i++) {
+        gb->bg_fifo.pixel[i] &= 3;
+        gb->bg_fifo.palette[i] &= 7;
+        gb->oam_fifo.pixel[i] &= 3;
+        gb->oam_fifo.palette[i] &= 7;
+        gb->oam_fifo.priority[i] &= 0x3F;
+        gb->bg_fifo.bg_priority[i] = ((uint8_t *)gb->bg_fifo.bg_priority)[i] != 0;
+        gb->oam_fifo.bg_priority[i] = ((uint8_t *)gb->oam_fifo.bg_priority)[i] != 0;
+    }
+    gb->object_low_line_address &= (gb->vram_size - 1) & ~1;
     gb->fetcher_x &= 0x1f;
     if (gb->lcd_x > gb->position_in_line) {
         gb->lcd_x = gb->position_in_line;
@@ -229,6 +263,8 @@ int GB_load_state(GB_gameboy_t *gb, const char *path)
     memcpy(&save, gb, sizeof(save));
     /* ...Except ram size, we use it to detect old saves with incorrect ram sizes */
     save.ram_size = 0;
+    /* ...And the FIFO layout marker, which older saves do not have */
+    save.split_fifos = false;
     
     FILE *f = fopen(path, "rb");
     if (!f) {
@@ -292,6 +328,9 @@ int GB_load_state(GB_gameboy_t *gb, const char *path)
     errno = 0;
     
     sanitize_state(gb);
+    if (gb->reverse) {
+        GB_debugger_reverse_discard(gb);
+    }
     
 error:
     fclose(f);
@@ -354,6 +393,8 @@ int GB_load_state_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t le
     
     /* Every unread value should be kept the same. */
     memcpy(&save, gb, sizeof(save));
+    /* ...Except the FIFO layout marker, which older saves do not have */
+    save.split_fifos = false;
     bool fix_broken_windows_saves = false;
 
     if (buffer_read(GB_GET_SECTION(&save, header), GB_SECTION_SIZE(header), &buffer, &length) != GB_SECTION_SIZE(header)) return -1;
@@ -406,6 +447,9 @@ int GB_load_state_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t le
     memcpy(gb, &save, sizeof(save));
     
     sanitize_state(gb);
+    if (gb->reverse) {
+        GB_debugger_reverse_discard(gb);
+    }
     
     return 0;
 }
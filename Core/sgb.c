@@ -543,7 +543,7 @@ static uint32_t convert_rgb15_with_fade(GB_gameboy_t *gb, uint16_t color, uint8_
 static void render_boot_animation (GB_gameboy_t *gb)
 {
 #include "graphics/sgb_animation_logo.inc"
-    uint32_t *output = gb->screen;
+    size_t output = 0;
     if (gb->border_mode != GB_BORDER_NEVER) {
         output += 48 + 40 * 256;
     }
@@ -572,7 +572,7 @@ static void render_boot_animation (GB_gameboy_t *gb)
     for (unsigned y = 0; y < 144; y++) {
         for (unsigned x = 0; x < 160; x++) {
             if (y < y_min || y >= y_max) {
-                *(output++) = colors[0];
+                GB_set_pixel(gb, output++, colors[0]);
             }
             else {
                 uint8_t color = *input;
@@ -590,7 +590,7 @@ static void render_boot_animation (GB_gameboy_t *gb)
                         color = 0;
                     }
                 }
-                *(output++) = colors[color];
+                GB_set_pixel(gb, output++, colors[color]);
                 input++;
             }
         }
@@ -603,7 +603,7 @@ static void render_boot_animation (GB_gameboy_t *gb)
 static void render_jingle(GB_gameboy_t *gb, size_t count);
 void GB_sgb_render(GB_gameboy_t *gb)
 {
-    if (gb->apu_output.sample_rate) {
+    if (gb->apu_output.sample_rate && !gb->apu_output.disable_rendering) {
         render_jingle(gb, gb->apu_output.sample_rate / GB_get_usual_frame_rate(gb));
     }
     
@@ -670,7 +670,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
         }
     }
     
-    if (!gb->screen || !gb->rgb_encode_callback || gb->disable_rendering) return;
+    if (!gb->screen || !GB_can_encode_colors(gb) || gb->disable_rendering) return;
 
     uint32_t colors[4 * 4];
     for (unsigned i = 0; i < 4 * 4; i++) {
@@ -687,7 +687,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
         render_boot_animation(gb);
     }
     else {
-        uint32_t *output = gb->screen;
+        size_t output = 0;
         if (gb->border_mode != GB_BORDER_NEVER) {
             output += 48 + 40 * 256;
         }
@@ -698,7 +698,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
                 for (unsigned y = 0; y < 144; y++) {
                     for (unsigned x = 0; x < 160; x++) {
                         uint8_t palette = gb->sgb->attribute_map[x / 8 + y / 8 * 20] & 3;
-                        *(output++) = colors[(*(input++) & 3) + palette * 4];
+                        GB_set_pixel(gb, output++, colors[(*(input++) & 3) + palette * 4]);
                     }
                     if (gb->border_mode != GB_BORDER_NEVER) {
                         output += 256 - 160;
@@ -711,7 +711,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
                 uint32_t black = convert_rgb15(gb, 0);
                 for (unsigned y = 0; y < 144; y++) {
                     for (unsigned x = 0; x < 160; x++) {
-                        *(output++) = black;
+                        GB_set_pixel(gb, output++, black);
                     }
                     if (gb->border_mode != GB_BORDER_NEVER) {
                         output += 256 - 160;
@@ -723,7 +723,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
             {
                 for (unsigned y = 0; y < 144; y++) {
                     for (unsigned x = 0; x < 160; x++) {
-                        *(output++) = colors[0];
+                        GB_set_pixel(gb, output++, colors[0]);
                     }
                     if (gb->border_mode != GB_BORDER_NEVER) {
                         output += 256 - 160;
@@ -774,7 +774,7 @@ void GB_sgb_render(GB_gameboy_t *gb)
             for (unsigned y = 0; y < 8; y++) {
                 for (unsigned x = 0; x < 8; x++) {
                     uint8_t color = gb->sgb->border.tiles[(tile & 0xFF) * 64 + (x ^ flip_x) + (y ^ flip_y) * 8] & 0xF;
-                    uint32_t *output = gb->screen;
+                    size_t output = 0;
                     if (gb->border_mode == GB_BORDER_NEVER) {
                         output += (tile_x - 6) * 8 + x + ((tile_y - 5) * 8 + y) * 160;
                     }
@@ -783,10 +783,10 @@ void GB_sgb_render(GB_gameboy_t *gb)
                     }
                     if (color == 0) {
                         if (gb_area) continue;
-                        *output = colors[0];
+                        GB_set_pixel(gb, output, colors[0]);
                     }
                     else {
-                       *output = border_colors[color + palette * 16];
+                       GB_set_pixel(gb, output, border_colors[color + palette * 16]);
                     }
                 }
             }
@@ -864,12 +864,10 @@ static void render_jingle(GB_gameboy_t *gb, size_t count)
         1567.98, // G6
     };
     
-    assert(gb->apu_output.sample_callback);
-    
     if (gb->sgb->intro_animation < 0) {
         GB_sample_t sample = {0, 0};
         for (unsigned i = 0; i < count; i++) {
-            gb->apu_output.sample_callback(gb, &sample);
+            GB_apu_output_sample(gb, &sample, NULL);
         }
         return;
     }
@@ -905,7 +903,7 @@ static void render_jingle(GB_gameboy_t *gb, size_t count)
         }
         
         stereo.left = stereo.right = sample * 0x7000;
-        gb->apu_output.sample_callback(gb, &stereo);
+        GB_apu_output_sample(gb, &stereo, NULL);
     }
     
     return;
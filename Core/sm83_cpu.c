@@ -78,7 +78,10 @@ static uint8_t cycle_read(GB_gameboy_t *gb, uint16_t addr)
     if (gb->pending_cycles) {
         GB_advance_cycles(gb, gb->pending_cycles);
     }
-    uint8_t ret = GB_read_memory(gb, addr);
+    uint8_t ret = GB_emulated_read_memory(gb, addr);
+    if (gb->coverage) {
+        GB_debugger_coverage_read(gb, addr, ret);
+    }
     gb->pending_cycles = 4;
     return ret;
 }
@@ -89,7 +92,10 @@ static uint8_t cycle_read_inc_oam_bug(GB_gameboy_t *gb, uint16_t addr)
         GB_advance_cycles(gb, gb->pending_cycles);
     }
     GB_trigger_oam_bug_read_increase(gb, addr); /* Todo: test T-cycle timing */
-    uint8_t ret = GB_read_memory(gb, addr);
+    uint8_t ret = GB_emulated_read_memory(gb, addr);
+    if (gb->coverage) {
+        GB_debugger_coverage_read(gb, addr, ret);
+    }
     gb->pending_cycles = 4;
     return ret;
 }
@@ -112,6 +118,9 @@ static uint8_t cycle_write_if(GB_gameboy_t *gb, uint8_t value)
 static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
 {
     assert(gb->pending_cycles);
+    if (gb->coverage) {
+        GB_debugger_coverage_write(gb, addr);
+    }
     GB_conflict_t conflict = GB_CONFLICT_READ_OLD;
     if ((addr & 0xFF80) == 0xFF00) {
         const GB_conflict_t *map = NULL;
@@ -166,7 +175,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
         case GB_CONFLICT_STAT_CGB: {
             /* Todo: Verify this with SCX adjustments */
             /* The LYC bit behaves differently */
-            uint8_t old_value = GB_read_memory(gb, addr);
+            uint8_t old_value = GB_emulated_read_memory(gb, addr);
             GB_advance_cycles(gb, gb->pending_cycles);
             GB_write_memory(gb, addr, (old_value & 0x40) | (value & ~0x40));
             GB_advance_cycles(gb, 1);
@@ -182,7 +191,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
             
         case GB_CONFLICT_PALETTE_DMG: {
             GB_advance_cycles(gb, gb->pending_cycles - 2);
-            uint8_t old_value = GB_read_memory(gb, addr);
+            uint8_t old_value = GB_emulated_read_memory(gb, addr);
             GB_write_memory(gb, addr, value | old_value);
             GB_advance_cycles(gb, 1);
             GB_write_memory(gb, addr, value);
@@ -207,8 +216,10 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
             
             
             
-            uint8_t old_value = GB_read_memory(gb, addr);
+            uint8_t old_value = GB_emulated_read_memory(gb, addr);
             GB_advance_cycles(gb, gb->pending_cycles - 2);
+            /* position_in_line must be up to date */
+            GB_display_sync(gb);
             
             if (/* gb->model != GB_MODEL_MGB && */ gb->position_in_line == 0 && (old_value & 2) && !(value & 2)) {
                 old_value &= ~2;
@@ -224,7 +235,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
         case GB_CONFLICT_SGB_LCDC: {
             /* Simplified version of the above */
             
-            uint8_t old_value = GB_read_memory(gb, addr);
+            uint8_t old_value = GB_emulated_read_memory(gb, addr);
             GB_advance_cycles(gb, gb->pending_cycles - 2);
             /* Hack to force aborting object fetch */
             GB_write_memory(gb, addr, value);
@@ -249,6 +260,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
                 // Todo: This is difference is because my timing is off in one of the models
                 if (gb->model > GB_MODEL_CGB_C) {
                     GB_advance_cycles(gb, gb->pending_cycles);
+                    GB_display_sync(gb);
                     gb->tile_sel_glitch = true;
                     GB_advance_cycles(gb, 1);
                     gb->tile_sel_glitch = false;
@@ -257,6 +269,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
                 }
                 else {
                     GB_advance_cycles(gb, gb->pending_cycles - 1);
+                    GB_display_sync(gb);
                     gb->tile_sel_glitch = true;
                     GB_advance_cycles(gb, 1);
                     gb->tile_sel_glitch = false;
@@ -330,6 +343,7 @@ static void nop(GB_gameboy_t *gb, uint8_t opcode)
 
 static void enter_stop_mode(GB_gameboy_t *gb)
 {
+    GB_display_sync(gb);
     gb->stopped = true;
     gb->oam_ppu_blocked = !gb->oam_read_blocked;
     gb->vram_ppu_blocked = !gb->vram_read_blocked;
@@ -1616,7 +1630,16 @@ void GB_cpu_run(GB_gameboy_t *gb)
     }
     /* Run mode */
     else if (!gb->halted) {
+        if (gb->coverage) {
+            GB_debugger_coverage_fetch(gb, gb->pc);
+        }
         gb->last_opcode_read = cycle_read_inc_oam_bug(gb, gb->pc++);
+        if (gb->trace_buffer) {
+            GB_debugger_trace_instruction(gb, gb->pc - 1, gb->last_opcode_read);
+        }
+        if (gb->profile && gb->debugger_ticks >= gb->profile_next_sample) {
+            GB_debugger_profile_sample(gb, gb->pc - 1);
+        }
         if (gb->halt_bug) {
             gb->pc--;
             gb->halt_bug = false;
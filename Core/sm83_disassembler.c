@@ -769,6 +769,8 @@ void GB_cpu_disassemble(GB_gameboy_t *gb, uint16_t pc, uint16_t count)
 
     uint16_t current_function = function_symbol? function_symbol->addr : 0;
 
+    /* Reads made to disassemble are not counted in the heatmap */
+    GB_heatmap_t *heatmap = GB_debugger_heatmap_suspend(gb);
     while (count--) {
         function_symbol = GB_debugger_find_symbol(gb, pc);
         if (function_symbol && function_symbol->addr == pc) {
@@ -786,4 +788,5 @@ void GB_cpu_disassemble(GB_gameboy_t *gb, uint16_t pc, uint16_t count)
         uint8_t opcode = GB_read_memory(gb, pc);
         opcodes[opcode](gb, opcode, &pc);
     }
+    GB_debugger_heatmap_resume(gb, heatmap);
 }
@@ -4,16 +4,16 @@
 #include <string.h>
 #include <sys/types.h>
 
+/* The index of the first symbol past addr, so symbols with the same address stay in the order they were added */
 static size_t GB_map_find_symbol_index(GB_symbol_map_t *map, uint16_t addr)
 {
     if (!map->symbols) {
         return 0;
     }
-    ssize_t min = 0;
-    ssize_t max = map->n_symbols;
+    size_t min = 0;
+    size_t max = map->n_symbols;
     while (min < max) {
         size_t pivot = (min + max) / 2;
-        if (map->symbols[pivot].addr == addr) return pivot;
         if (map->symbols[pivot].addr > addr) {
             max = pivot;
         }
@@ -21,32 +21,77 @@ static size_t GB_map_find_symbol_index(GB_symbol_map_t *map, uint16_t addr)
             min = pivot + 1;
         }
     }
-    return (size_t) min;
+    return min;
 }
 
-GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, const char *name)
+GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, char *name)
 {
     size_t index = GB_map_find_symbol_index(map, addr);
 
     map->symbols = realloc(map->symbols, (map->n_symbols + 1) * sizeof(map->symbols[0]));
     memmove(&map->symbols[index + 1], &map->symbols[index], (map->n_symbols - index) * sizeof(map->symbols[0]));
     map->symbols[index].addr = addr;
-    map->symbols[index].name = strdup(name);
+    map->symbols[index].name = name;
     map->n_symbols++;
     return &map->symbols[index];
 }
 
+void GB_map_add_symbols(GB_symbol_map_t *map, const GB_bank_symbol_t *symbols, size_t count)
+{
+    if (!count) return;
+    size_t total = map->n_symbols + count;
+
+    /* Stable radix sort of the new symbols by address */
+    size_t *order = malloc(count * 2 * sizeof(order[0]));
+    size_t *buffer = order + count;
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (unsigned shift = 0; shift < 16; shift += 8) {
+        size_t offsets[0x100] = {0,};
+        for (size_t i = 0; i < count; i++) {
+            offsets[(symbols[i].addr >> shift) & 0xFF]++;
+        }
+        size_t offset = 0;
+        for (unsigned digit = 0; digit < 0x100; digit++) {
+            size_t digit_count = offsets[digit];
+            offsets[digit] = offset;
+            offset += digit_count;
+        }
+        for (size_t i = 0; i < count; i++) {
+            buffer[offsets[(symbols[order[i]].addr >> shift) & 0xFF]++] = order[i];
+        }
+        size_t *sorted = buffer;
+        buffer = order;
+        order = sorted;
+    }
+
+    /* Merge, with the existing symbols of an address before the new ones */
+    GB_bank_symbol_t *merged = malloc(total * sizeof(merged[0]));
+    for (size_t old = 0, new = 0, slot = 0; slot < total; slot++) {
+        if (new == count || (old < map->n_symbols && map->symbols[old].addr <= symbols[order[new]].addr)) {
+            merged[slot] = map->symbols[old++];
+        }
+        else {
+            merged[slot] = symbols[order[new++]];
+        }
+    }
+
+    free(order); // Back at the start of the allocation after two passes
+    free(map->symbols);
+    map->symbols = merged;
+    map->n_symbols = total;
+}
+
+/* The symbol at addr, or the closest one before it. Of symbols sharing an address, the last one added wins. */
 const GB_bank_symbol_t *GB_map_find_symbol(GB_symbol_map_t *map, uint16_t addr)
 {
     if (!map) return NULL;
     size_t index = GB_map_find_symbol_index(map, addr);
-    if (index < map->n_symbols && map->symbols[index].addr != addr) {
-        index--;
-    }
-    if (index < map->n_symbols) {
-        return &map->symbols[index];
-    }
-    return NULL;
+    if (!index) return NULL;
+    /* Addresses past the last symbol have none */
+    if (index == map->n_symbols && map->symbols[index - 1].addr != addr) return NULL;
+    return &map->symbols[index - 1];
 }
 
 GB_symbol_map_t *GB_map_alloc(void)
@@ -58,10 +103,6 @@ GB_symbol_map_t *GB_map_alloc(void)
 
 void GB_map_free(GB_symbol_map_t *map)
 {
-    for (unsigned i = 0; i < map->n_symbols; i++) {
-        free(map->symbols[i].name);
-    }
-
     if (map->symbols) {
         free(map->symbols);
     }
@@ -83,13 +124,9 @@ static unsigned hash_name(const char *name)
     return r & 0x3FF;
 }
 
-void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, uint16_t bank, GB_bank_symbol_t *bank_symbol)
+void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, GB_symbol_t *symbol)
 {
-    unsigned hash = hash_name(bank_symbol->name);
-    GB_symbol_t *symbol = malloc(sizeof(*symbol));
-    symbol->name = bank_symbol->name;
-    symbol->addr = bank_symbol->addr;
-    symbol->bank = bank;
+    unsigned hash = hash_name(symbol->name);
     symbol->next = map->buckets[hash];
     map->buckets[hash] = symbol;
 }
@@ -27,9 +27,12 @@ typedef struct {
 } GB_reversed_symbol_map_t;
 
 #ifdef GB_INTERNAL
-void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, uint16_t bank, GB_bank_symbol_t *symbol);
+/* Maps do not own names or reversed map nodes, their memory must outlive the map */
+void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, GB_symbol_t *symbol);
 const GB_symbol_t *GB_reversed_map_find_symbol(GB_reversed_symbol_map_t *map, const char *name);
-GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, const char *name);
+GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, char *name);
+/* Same result as calling GB_map_add_symbol for every symbol in order */
+void GB_map_add_symbols(GB_symbol_map_t *map, const GB_bank_symbol_t *symbols, size_t count);
 const GB_bank_symbol_t *GB_map_find_symbol(GB_symbol_map_t *map, uint16_t addr);
 GB_symbol_map_t *GB_map_alloc(void);
 void GB_map_free(GB_symbol_map_t *map);
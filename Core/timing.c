@@ -6,24 +6,36 @@
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <time.h>
 #endif
 
 static const unsigned GB_TAC_TRIGGER_BITS[] = {512, 8, 32, 128};
 
-#ifndef GB_DISABLE_TIMEKEEPING
-static int64_t get_nanoseconds(void)
+int64_t GB_get_nanoseconds(void)
 {
 #ifndef _WIN32
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_nsec + now.tv_sec * 1000000000LL;
+#else
     struct timeval now;
     gettimeofday(&now, NULL);
     return (now.tv_usec) * 1000 + now.tv_sec * 1000000000L;
+#endif
 #else
-    FILETIME time;
-    GetSystemTimeAsFileTime(&time);
-    return (((int64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) * 100L;
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / frequency.QuadPart * 1000000000LL +
+           now.QuadPart % frequency.QuadPart * 1000000000LL / frequency.QuadPart;
 #endif
 }
 
+#ifndef GB_DISABLE_TIMEKEEPING
 static void nsleep(uint64_t nanoseconds)
 {
 #ifndef _WIN32
@@ -40,10 +52,49 @@ static void nsleep(uint64_t nanoseconds)
 #endif
 }
 
+#define SPIN_MARGIN_MIN 50000
+#define SPIN_MARGIN_MAX 4000000
+#define SPIN_MARGIN_DEFAULT 1000000
+
+/* Sleeps until shortly before the deadline, then spins for the rest, since sleeping alone is only as precise as the
+   scheduler. The spinning margin follows how much the OS has been oversleeping. */
+static void wait_until(GB_gameboy_t *gb, int64_t deadline, int64_t now)
+{
+    if (!gb->sync_spin_margin) {
+        gb->sync_spin_margin = SPIN_MARGIN_DEFAULT;
+    }
+    
+    int64_t sleep_time = deadline - now - gb->sync_spin_margin;
+    if (sleep_time > 0) {
+        nsleep(sleep_time);
+        int64_t oversleep = GB_get_nanoseconds() - now - sleep_time;
+        gb->sync_spin_margin += (oversleep * 2 - gb->sync_spin_margin) / 8;
+        if (gb->sync_spin_margin < SPIN_MARGIN_MIN) {
+            gb->sync_spin_margin = SPIN_MARGIN_MIN;
+        }
+        else if (gb->sync_spin_margin > SPIN_MARGIN_MAX) {
+            gb->sync_spin_margin = SPIN_MARGIN_MAX;
+        }
+    }
+    
+    while ((now = GB_get_nanoseconds()) < deadline);
+    
+    uint64_t overshoot = now - deadline;
+    gb->timing_stats.total_overshoot += overshoot;
+    if (overshoot > gb->timing_stats.max_overshoot) {
+        gb->timing_stats.max_overshoot = overshoot;
+    }
+    unsigned bucket = overshoot / 100000;
+    if (bucket >= GB_TIMING_HISTOGRAM_BUCKETS) {
+        bucket = GB_TIMING_HISTOGRAM_BUCKETS - 1;
+    }
+    gb->timing_stats.overshoot_histogram[bucket]++;
+}
+
 bool GB_timing_sync_turbo(GB_gameboy_t *gb)
 {
     if (!gb->turbo_dont_skip) {
-        int64_t nanoseconds = get_nanoseconds();
+        int64_t nanoseconds = GB_get_nanoseconds();
         if (nanoseconds <= gb->last_sync + (1000000000LL * LCDC_PERIOD / GB_get_clock_rate(gb))) {
             return true;
         }
@@ -62,13 +113,18 @@ void GB_timing_sync(GB_gameboy_t *gb)
     if (gb->cycles_since_last_sync < LCDC_PERIOD / 3) return;
 
     uint64_t target_nanoseconds = gb->cycles_since_last_sync * 1000000000LL / 2 / GB_get_clock_rate(gb); /* / 2 because we use 8MHz units */
-    int64_t nanoseconds = get_nanoseconds();
-    int64_t time_to_sleep = target_nanoseconds + gb->last_sync - nanoseconds;
+    int64_t nanoseconds = GB_get_nanoseconds();
+    int64_t deadline = target_nanoseconds + gb->last_sync;
+    int64_t time_to_sleep = deadline - nanoseconds;
+    gb->timing_stats.syncs++;
     if (time_to_sleep > 0 && time_to_sleep < LCDC_PERIOD * 1000000000LL / GB_get_clock_rate(gb)) {
-        nsleep(time_to_sleep);
-        gb->last_sync += target_nanoseconds;
+        wait_until(gb, deadline, nanoseconds);
+        gb->last_sync = deadline;
     }
     else {
+        if (time_to_sleep <= 0 && gb->last_sync) {
+            gb->timing_stats.missed_deadlines++;
+        }
         gb->last_sync = nanoseconds;
     }
 
@@ -90,6 +146,16 @@ void GB_timing_sync(GB_gameboy_t *gb)
 
 #endif
 
+void GB_get_timing_stats(GB_gameboy_t *gb, GB_timing_stats_t *stats)
+{
+    *stats = gb->timing_stats;
+}
+
+void GB_reset_timing_stats(GB_gameboy_t *gb)
+{
+    memset(&gb->timing_stats, 0, sizeof(gb->timing_stats));
+}
+
 #define IR_DECAY 31500
 #define IR_THRESHOLD 19900
 #define IR_MAX IR_THRESHOLD * 2 + IR_DECAY
@@ -212,7 +278,16 @@ static void advance_serial(GB_gameboy_t *gb, uint8_t cycles)
         gb->io_registers[GB_IO_SB] <<= 1;
         
         if (gb->serial_transfer_bit_end_callback) {
-            gb->io_registers[GB_IO_SB] |= gb->serial_transfer_bit_end_callback(gb);
+            bool bit;
+            if (gb->internal_serial_device) {
+                /* Internally-emulated devices are part of the state, so replays simply run them again */
+                bit = gb->serial_transfer_bit_end_callback(gb);
+            }
+            else if (!GB_debugger_replay_input(gb, &bit, sizeof(bit))) {
+                bit = gb->serial_transfer_bit_end_callback(gb);
+                GB_debugger_record_input(gb, &bit, sizeof(bit));
+            }
+            gb->io_registers[GB_IO_SB] |= bit;
         }
         else {
             gb->io_registers[GB_IO_SB] |= 1;
@@ -220,7 +295,7 @@ static void advance_serial(GB_gameboy_t *gb, uint8_t cycles)
         
         if (gb->serial_length) {
             /* Still more bits to send */
-            if (gb->serial_transfer_bit_start_callback) {
+            if (gb->serial_transfer_bit_start_callback && (gb->internal_serial_device || !GB_debugger_is_replaying(gb))) {
                 gb->serial_transfer_bit_start_callback(gb, gb->io_registers[GB_IO_SB] & 0x80);
             }
         }
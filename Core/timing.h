@@ -1,13 +1,28 @@
 #ifndef timing_h
 #define timing_h
+#include <stdint.h>
 #include "gb_struct_def.h"
 
+#define GB_TIMING_HISTOGRAM_BUCKETS 32
+
+typedef struct {
+    uint64_t syncs;
+    uint64_t missed_deadlines; // Syncs where emulation was already running late, so there was nothing to wait for
+    uint64_t total_overshoot; // In nanoseconds, past the deadline after waiting
+    uint64_t max_overshoot;
+    uint32_t overshoot_histogram[GB_TIMING_HISTOGRAM_BUCKETS]; // 100µs buckets, the last one counts everything above
+} GB_timing_stats_t;
+
+void GB_get_timing_stats(GB_gameboy_t *gb, GB_timing_stats_t *stats);
+void GB_reset_timing_stats(GB_gameboy_t *gb);
+
 #ifdef GB_INTERNAL
 void GB_advance_cycles(GB_gameboy_t *gb, uint8_t cycles);
 void GB_rtc_run(GB_gameboy_t *gb);
 void GB_emulate_timer_glitch(GB_gameboy_t *gb, uint8_t old_tac, uint8_t new_tac);
 bool GB_timing_sync_turbo(GB_gameboy_t *gb); /* Returns true if should skip frame */
 void GB_timing_sync(GB_gameboy_t *gb);
+int64_t GB_get_nanoseconds(void); /* Monotonic */
 
 enum {
     GB_TIMA_RUNNING = 0,
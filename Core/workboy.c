@@ -30,7 +30,11 @@ static void serial_start(GB_gameboy_t *gb, bool bit_received)
             gb->workboy.mode = gb->workboy.byte_being_received;
             gb->workboy.buffer_index = 1;
             
-            time_t time = gb->workboy_get_time_callback(gb);
+            time_t time;
+            if (!GB_debugger_replay_input(gb, &time, sizeof(time))) {
+                time = gb->workboy_get_time_callback(gb);
+                GB_debugger_record_input(gb, &time, sizeof(time));
+            }
             struct tm tm;
             tm = *localtime(&time);
             memset(gb->workboy.buffer, 0, sizeof(gb->workboy.buffer));
@@ -120,7 +124,9 @@ static void serial_start(GB_gameboy_t *gb, bool bit_received)
                     tm.tm_mday = bcd_to_int(gb->workboy.buffer[0xA]);
                     tm.tm_mon = bcd_to_int(gb->workboy.buffer[0xB] & 0x3F) - 1;
                     tm.tm_year = (uint8_t)(gb->workboy.buffer[0x14] + (gb->workboy.buffer[0xA] >> 6)); // What were they thinking?
-                    gb->workboy_set_time_callback(gb, mktime(&tm));
+                    if (!GB_debugger_is_replaying(gb)) {
+                        gb->workboy_set_time_callback(gb, mktime(&tm));
+                    }
                     gb->workboy.mode = 'O';
                 }
             }
@@ -145,6 +151,7 @@ void GB_connect_workboy(GB_gameboy_t *gb,
     memset(&gb->workboy, 0, sizeof(gb->workboy));
     GB_set_serial_transfer_bit_start_callback(gb, serial_start);
     GB_set_serial_transfer_bit_end_callback(gb, serial_end);
+    gb->internal_serial_device = true;
     gb->workboy_set_time_callback = set_time_callback;
     gb->workboy_get_time_callback = get_time_callback;
 }
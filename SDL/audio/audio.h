@@ -10,7 +10,8 @@ void GB_audio_set_paused(bool paused);
 void GB_audio_clear_queue(void);
 unsigned GB_audio_get_frequency(void);
 size_t GB_audio_get_queue_length(void);
-void GB_audio_queue_sample(GB_sample_t *sample);
+size_t GB_audio_get_target_queue_length(void);
+void GB_audio_queue_samples(GB_sample_t *samples, size_t count);
 void GB_audio_init(void);
 
 #endif /* sdl_audio_h */
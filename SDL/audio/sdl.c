@@ -25,9 +25,41 @@
 static SDL_AudioDeviceID device_id;
 static SDL_AudioSpec want_aspec, have_aspec;
 
-#define AUDIO_BUFFER_SIZE 512
-static unsigned buffer_pos = 0;
-static GB_sample_t audio_buffer[AUDIO_BUFFER_SIZE];
+/* Single producer (the emulator thread), single consumer (SDL's audio thread) ring. Positions only ever grow, and
+   each is only written by its owner. Large enough for the quarter second the frontend lets it fill up to, plus a
+   block. */
+#define AUDIO_RING_SIZE 0x10000
+static GB_sample_t audio_ring[AUDIO_RING_SIZE];
+static SDL_atomic_t read_position;
+static SDL_atomic_t write_position;
+static GB_sample_t last_sample;
+
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+    GB_sample_t *output = (GB_sample_t *)stream;
+    unsigned count = len / sizeof(*output);
+    unsigned read = SDL_AtomicGet(&read_position);
+    unsigned available = (unsigned)SDL_AtomicGet(&write_position) - read;
+    /* Don't read samples from before the producer published them */
+    SDL_MemoryBarrierAcquire();
+    if (available > count) {
+        available = count;
+    }
+    
+    for (unsigned i = 0; i < available; i++) {
+        output[i] = audio_ring[(read + i) & (AUDIO_RING_SIZE - 1)];
+    }
+    if (available) {
+        last_sample = output[available - 1];
+        /* Don't let the producer reuse slots we're still reading */
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&read_position, read + available);
+    }
+    /* On underrun, hold the last sample rather than clicking to silence */
+    for (unsigned i = available; i < count; i++) {
+        output[i] = last_sample;
+    }
+}
 
 bool GB_audio_is_playing(void)
 {
@@ -42,7 +74,9 @@ void GB_audio_set_paused(bool paused)
 
 void GB_audio_clear_queue(void)
 {
-    SDL_ClearQueuedAudio(device_id);
+    SDL_LockAudioDevice(device_id);
+    SDL_AtomicSet(&read_position, SDL_AtomicGet(&write_position));
+    SDL_UnlockAudioDevice(device_id);
 }
 
 unsigned GB_audio_get_frequency(void)
@@ -52,17 +86,29 @@ unsigned GB_audio_get_frequency(void)
 
 size_t GB_audio_get_queue_length(void)
 {
-    return SDL_GetQueuedAudioSize(device_id);
+    return ((unsigned)SDL_AtomicGet(&write_position) - (unsigned)SDL_AtomicGet(&read_position)) * sizeof(GB_sample_t);
 }
 
-void GB_audio_queue_sample(GB_sample_t *sample)
+size_t GB_audio_get_target_queue_length(void)
 {
-    audio_buffer[buffer_pos++] = *sample;
+    /* Two device buffers, so a full callback never drains the ring */
+    return have_aspec.samples * 2 * sizeof(GB_sample_t);
+}
 
-    if (buffer_pos == AUDIO_BUFFER_SIZE) {
-        buffer_pos = 0;
-        SDL_QueueAudio(device_id, (const void *)audio_buffer, sizeof(audio_buffer));
+void GB_audio_queue_samples(GB_sample_t *samples, size_t count)
+{
+    unsigned write = SDL_AtomicGet(&write_position);
+    unsigned space = AUDIO_RING_SIZE - (write - (unsigned)SDL_AtomicGet(&read_position));
+    /* Don't overwrite slots before the consumer is done reading them */
+    SDL_MemoryBarrierAcquire();
+    /* Drop the block as a whole rather than cutting it short, so playback resumes at a block boundary */
+    if (count > space) return;
+    for (unsigned i = 0; i < count; i++) {
+        audio_ring[(write + i) & (AUDIO_RING_SIZE - 1)] = samples[i];
     }
+    /* Publish the samples before the position that covers them */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&write_position, write + count);
 }
 
 void GB_audio_init(void)
@@ -73,6 +119,7 @@ void GB_audio_init(void)
     want_aspec.format = AUDIO_S16SYS;
     want_aspec.channels = 2;
     want_aspec.samples = 512;
+    want_aspec.callback = audio_callback;
     
     SDL_version _sdl_version;
     SDL_GetVersion(&_sdl_version);
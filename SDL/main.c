@@ -347,16 +347,11 @@ static void vblank(GB_gameboy_t *gb)
         clock_mutliplier += 1.0/16;
         GB_set_clock_multiplier(gb, clock_mutliplier);
     }
-    if (configuration.blending_mode) {
-        render_texture(active_pixel_buffer, previous_pixel_buffer);
-        uint32_t *temp = active_pixel_buffer;
-        active_pixel_buffer = previous_pixel_buffer;
-        previous_pixel_buffer = temp;
-        GB_set_pixels_output(gb, active_pixel_buffer);
-    }
-    else {
-        render_texture(active_pixel_buffer, NULL);
-    }
+    render_texture(active_pixel_buffer, configuration.blending_mode? previous_pixel_buffer : NULL);
+    /* The core moves on to the other output buffer once this callback returns */
+    uint32_t *temp = active_pixel_buffer;
+    active_pixel_buffer = previous_pixel_buffer;
+    previous_pixel_buffer = temp;
     do_rewind = rewind_down;
     handle_events(gb);
 }
@@ -383,30 +378,59 @@ static void debugger_interrupt(int ignore)
     GB_debugger_break(&gb);
 }
 
-static void gb_audio_callback(GB_gameboy_t *gb, GB_sample_t *sample)
-{    
-    if (turbo_down) {
-        static unsigned skip = 0;
-        skip++;
-        if (skip == GB_audio_get_frequency() / 8) {
-            skip = 0;
+/* Maximum deviation from the nominal sample rate used to keep the audio queue at its target length */
+#define AUDIO_RATE_CONTROL 0.005
+/* Smaller changes of the rate are not passed on to the core, which recalculates its mixer rates every time */
+#define AUDIO_RATE_CONTROL_STEP 0.0005
+
+static void gb_audio_callback(GB_gameboy_t *gb, GB_sample_t *samples, size_t count)
+{
+    /* Rate control can't catch up with a long stall of the audio device, drop whole blocks while too far behind */
+    if (GB_audio_get_queue_length() / sizeof(*samples) > GB_audio_get_frequency() / 4) {
+        return;
+    }
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (turbo_down) {
+            static unsigned skip = 0;
+            skip++;
+            if (skip == GB_audio_get_frequency() / 8) {
+                skip = 0;
+            }
+            if (skip > GB_audio_get_frequency() / 16) {
+                continue;
+            }
         }
-        if (skip > GB_audio_get_frequency() / 16) {
-            return;
+        
+        GB_sample_t sample = samples[i];
+        if (configuration.volume != 100) {
+            sample.left = sample.left * configuration.volume / 100;
+            sample.right = sample.right * configuration.volume / 100;
         }
+        samples[kept++] = sample;
     }
     
-    if (GB_audio_get_queue_length() / sizeof(*sample) > GB_audio_get_frequency() / 4) {
-        return;
+    if (kept) {
+        GB_audio_queue_samples(samples, kept);
     }
     
-    if (configuration.volume != 100) {
-        sample->left = sample->left * configuration.volume / 100;
-        sample->right = sample->right * configuration.volume / 100;
+    double ratio = 1;
+    if (!turbo_down) {
+        double direction = 1 - GB_audio_get_queue_length() / (double)GB_audio_get_target_queue_length();
+        if (direction < -1) {
+            direction = -1;
+        }
+        ratio += direction * AUDIO_RATE_CONTROL;
     }
     
-    GB_audio_queue_sample(sample);
-    
+    static double cycles_per_sample = 0;
+    double new_cycles_per_sample = 2 * GB_get_clock_rate(gb) / (GB_audio_get_frequency() * ratio);
+    double change = new_cycles_per_sample - cycles_per_sample;
+    if (change > cycles_per_sample * AUDIO_RATE_CONTROL_STEP || change < -cycles_per_sample * AUDIO_RATE_CONTROL_STEP) {
+        cycles_per_sample = new_cycles_per_sample;
+        GB_set_sample_rate_by_clocks(gb, cycles_per_sample);
+    }
 }
 
     
@@ -491,7 +515,7 @@ restart:
         
         GB_set_boot_rom_load_callback(&gb, load_boot_rom);
         GB_set_vblank_callback(&gb, (GB_vblank_callback_t) vblank);
-        GB_set_pixels_output(&gb, active_pixel_buffer);
+        GB_set_pixels_output_buffers(&gb, (void *const []){active_pixel_buffer, previous_pixel_buffer}, 2);
         GB_set_rgb_encode_callback(&gb, rgb_encode);
         GB_set_rumble_callback(&gb, rumble);
         GB_set_rumble_mode(&gb, configuration.rumble_mode);
@@ -504,7 +528,8 @@ restart:
         GB_set_highpass_filter_mode(&gb, configuration.highpass_mode);
         GB_set_rewind_length(&gb, configuration.rewind_length);
         GB_set_update_input_hint_callback(&gb, handle_events);
-        GB_apu_set_sample_callback(&gb, gb_audio_callback);
+        static GB_sample_t audio_buffer[512];
+        GB_apu_set_sample_buffer(&gb, audio_buffer, sizeof(audio_buffer) / sizeof(audio_buffer[0]), gb_audio_callback);
     }
 
     bool error = false;
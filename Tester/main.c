@@ -17,6 +17,7 @@
 
 #include <Core/gb.h>
 #include <Core/random.h>
+#include "self_tests.h"
 
 static bool running = false;
 static char *filename;
@@ -259,7 +260,7 @@ int main(int argc, char **argv)
     fprintf(stderr, "SameBoy Tester v" xstr(VERSION) "\n");
 
     if (argc == 1) {
-        fprintf(stderr, "Usage: %s [--dmg] [--start] [--length seconds] [--boot path to boot ROM]"
+        fprintf(stderr, "Usage: %s [--dmg] [--start] [--self-test] [--length seconds] [--boot path to boot ROM]"
 #ifndef _WIN32
                         " [--jobs number of tests to run simultaneously]"
 #endif
@@ -273,6 +274,8 @@ int main(int argc, char **argv)
 #endif
 
     bool dmg = false;
+    bool self_test = false;
+    bool failed = false;
     const char *boot_rom_path = NULL;
     
     GB_random_set_enabled(false);
@@ -296,6 +299,12 @@ int main(int argc, char **argv)
             continue;
         }
         
+        if (strcmp(argv[i], "--self-test") == 0) {
+            fprintf(stderr, "Running self tests instead of taking screenshots\n");
+            self_test = true;
+            continue;
+        }
+        
         if (strcmp(argv[i], "--length") == 0 && i != argc - 1) {
             test_length = atoi(argv[++i]) * 60;
             fprintf(stderr, "Test length is %d seconds\n", test_length / 60);
@@ -322,6 +331,7 @@ int main(int argc, char **argv)
             while (current_forks >= max_forks) {
                 int wait_out;
                 while (wait(&wait_out) == -1);
+                failed |= !WIFEXITED(wait_out) || WEXITSTATUS(wait_out);
                 current_forks--;
             }
             
@@ -342,6 +352,24 @@ int main(int argc, char **argv)
         
         fprintf(stderr, "Testing ROM %s\n", filename);
         
+        if (self_test) {
+            const char *default_boot_rom = executable_relative_path(dmg? "dmg_boot.bin" : "cgb_boot.bin");
+            char coverage_path[path_length + 10];
+            replace_extension(filename, path_length, coverage_path, ".coverage");
+            bool passed = run_self_tests(filename, boot_rom_path ?: default_boot_rom, dmg? GB_MODEL_DMG_B : GB_MODEL_CGB_E,
+                                         test_length, coverage_path);
+            if (!passed) {
+                fprintf(stderr, "Self tests failed for ROM %s\n", filename);
+            }
+#ifndef _WIN32
+            if (max_forks > 1) {
+                exit(!passed);
+            }
+#endif
+            failed |= !passed;
+            continue;
+        }
+        
         if (dmg) {
             GB_init(&gb, GB_MODEL_DMG_B);
             if (GB_load_boot_rom(&gb, boot_rom_path ?: executable_relative_path("dmg_boot.bin"))) {
@@ -454,8 +482,10 @@ int main(int argc, char **argv)
     }
 #ifndef _WIN32
     int wait_out;
-    while (wait(&wait_out) != -1);
+    while (wait(&wait_out) != -1) {
+        failed |= !WIFEXITED(wait_out) || WEXITSTATUS(wait_out);
+    }
 #endif
-    return 0;
+    return failed;
 }
 
@@ -0,0 +1,564 @@
+// The self tests require low-level access to the GB struct, like the tester
+#define GB_INTERNAL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "self_tests.h"
+
+#define MAX_SCREEN_SIZE (256 * 224)
+#define SAMPLE_RATE 48000
+#define STATE_RELOAD_INTERVAL 1009 /* In GB_run calls, a prime so reloads land on every part of the frame */
+#define REVERSE_STEP_TESTS 20
+
+typedef struct {
+    GB_gameboy_t gb;
+    uint32_t buffers[GB_MAX_OUTPUT_BUFFERS][MAX_SCREEN_SIZE];
+    const void *frame;
+    bool vblank;
+
+    /* Copied in the vblank callback, the only place they're valid in */
+    uint32_t frame_palette[0x100];
+    unsigned frame_palette_size;
+    bool track_changed_lines;
+    uint32_t changed_lines[224 / 32];
+
+    GB_sample_t *samples;
+    size_t n_samples;
+    GB_sample_t *buffered_samples;
+    size_t n_buffered_samples;
+    GB_sample_t sample_buffer[1024];
+    bool unexpected_samples;
+
+    unsigned reverse_phase;
+    uint64_t reverse_state_hash;
+    unsigned reverse_failures;
+} instance_t;
+
+static const char *test_rom_path;
+
+static void vblank(GB_gameboy_t *gb)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    instance->vblank = true;
+    if (GB_get_pixel_format(gb) == GB_PIXEL_FORMAT_INDEXED) {
+        const uint32_t *palette = GB_get_frame_palette(gb, &instance->frame_palette_size);
+        memcpy(instance->frame_palette, palette, instance->frame_palette_size * sizeof(palette[0]));
+    }
+    if (instance->track_changed_lines) {
+        memcpy(instance->changed_lines, GB_get_changed_lines(gb), sizeof(instance->changed_lines));
+    }
+}
+
+static void frame_callback(GB_gameboy_t *gb, void *frame, uint64_t sequence)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    instance->frame = frame;
+}
+
+static uint32_t rgb_encode(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b)
+{
+    return (r << 16) | (g << 8) | b;
+}
+
+static void log_callback(GB_gameboy_t *gb, const char *string, GB_log_attributes attributes)
+{
+}
+
+static char *async_input_callback(GB_gameboy_t *gb)
+{
+    return NULL;
+}
+
+static void append_samples(GB_sample_t **array, size_t *count, const GB_sample_t *samples, size_t n)
+{
+    /* Grows in steps of a second of audio */
+    size_t capacity = (*count + SAMPLE_RATE - 1) / SAMPLE_RATE * SAMPLE_RATE;
+    if (*count + n > capacity) {
+        *array = realloc(*array, (*count + n + SAMPLE_RATE) / SAMPLE_RATE * SAMPLE_RATE * sizeof(**array));
+    }
+    memcpy(*array + *count, samples, n * sizeof(*samples));
+    *count += n;
+}
+
+static void sample_callback(GB_gameboy_t *gb, GB_sample_t *sample)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    append_samples(&instance->samples, &instance->n_samples, sample, 1);
+}
+
+static void sample_buffer_callback(GB_gameboy_t *gb, GB_sample_t *samples, size_t count)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    append_samples(&instance->buffered_samples, &instance->n_buffered_samples, samples, count);
+}
+
+static void unexpected_sample_callback(GB_gameboy_t *gb, GB_sample_t *sample)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    instance->unexpected_samples = true;
+}
+
+static bool init_instance(instance_t *instance, GB_model_t model, const char *boot_rom_path)
+{
+    free(instance->samples);
+    free(instance->buffered_samples);
+    memset(instance, 0, sizeof(*instance));
+
+    GB_init(&instance->gb, model);
+    GB_set_user_data(&instance->gb, instance);
+    if (boot_rom_path && GB_load_boot_rom(&instance->gb, boot_rom_path)) {
+        fprintf(stderr, "Failed to load boot ROM from '%s'\n", boot_rom_path);
+        GB_free(&instance->gb);
+        return false;
+    }
+
+    GB_set_vblank_callback(&instance->gb, (GB_vblank_callback_t) vblank);
+    GB_set_frame_callback(&instance->gb, frame_callback);
+    GB_set_pixels_output(&instance->gb, instance->buffers[0]);
+    GB_set_rgb_encode_callback(&instance->gb, rgb_encode);
+    GB_set_log_callback(&instance->gb, log_callback);
+    GB_set_async_input_callback(&instance->gb, async_input_callback);
+    GB_set_color_correction_mode(&instance->gb, GB_COLOR_CORRECTION_EMULATE_HARDWARE);
+    GB_set_border_mode(&instance->gb, GB_BORDER_ALWAYS);
+    GB_set_turbo_mode(&instance->gb, true, true);
+
+    if (GB_load_rom(&instance->gb, test_rom_path)) {
+        perror("Failed to load ROM");
+        GB_free(&instance->gb);
+        return false;
+    }
+    return true;
+}
+
+static void free_instance(instance_t *instance)
+{
+    GB_free(&instance->gb);
+    free(instance->samples);
+    free(instance->buffered_samples);
+    instance->samples = instance->buffered_samples = NULL;
+}
+
+static void run_frame(instance_t *instance)
+{
+    instance->vblank = false;
+    while (!instance->vblank) {
+        GB_run(&instance->gb);
+    }
+}
+
+/* Returns false if saving the loaded state again gave different bytes */
+static bool run_frame_reloading_state(instance_t *instance, uint8_t *state, uint8_t *resaved_state, unsigned *runs)
+{
+    size_t state_size = GB_get_save_state_size(&instance->gb);
+    bool identical = true;
+    instance->vblank = false;
+    while (!instance->vblank) {
+        GB_run(&instance->gb);
+        if (++*runs == STATE_RELOAD_INTERVAL) {
+            *runs = 0;
+            GB_save_state_to_buffer(&instance->gb, state);
+            GB_load_state_from_buffer(&instance->gb, state, state_size);
+            GB_save_state_to_buffer(&instance->gb, resaved_state);
+            identical &= !memcmp(state, resaved_state, state_size);
+        }
+    }
+    return identical;
+}
+
+static bool fail(const char *test, const char *unit, unsigned position, const char *reason)
+{
+    fprintf(stderr, "%s: %s failed at %s %u: %s\n", test_rom_path, test, unit, position, reason);
+    return false;
+}
+
+enum {
+    OUTPUT_REFERENCE,
+    OUTPUT_RGB565,
+    OUTPUT_INDEXED,
+    OUTPUT_BUFFERS,
+    OUTPUT_STATE_RELOADS,
+    OUTPUT_AUDIO_DISABLED,
+    OUTPUT_INSTANCES,
+};
+
+/* Every instance runs the same ROM with a different output configuration, or with its state saved and reloaded
+   mid-frame, which syncs batched lines. They must all render the same frames, including the cached border. The
+   reference also checks the changed line bitmap against the actual frames, and that the per-sample and buffered
+   audio outputs agree. */
+static bool test_frame_output(instance_t *instances, GB_model_t model, const char *boot_rom_path, unsigned frames)
+{
+    for (unsigned i = 0; i < OUTPUT_INSTANCES; i++) {
+        if (!init_instance(&instances[i], model, boot_rom_path)) {
+            while (i--) {
+                free_instance(&instances[i]);
+            }
+            return false;
+        }
+    }
+
+    instance_t *reference = &instances[OUTPUT_REFERENCE];
+    reference->track_changed_lines = true;
+    GB_set_changed_lines_tracking(&reference->gb, true);
+    GB_set_sample_rate(&reference->gb, SAMPLE_RATE);
+    GB_apu_set_sample_callback(&reference->gb, sample_callback);
+    GB_apu_set_sample_buffer(&reference->gb, reference->sample_buffer,
+                             sizeof(reference->sample_buffer) / sizeof(reference->sample_buffer[0]),
+                             sample_buffer_callback);
+
+    GB_set_pixel_format(&instances[OUTPUT_RGB565].gb, GB_PIXEL_FORMAT_RGB565);
+    GB_set_pixel_format(&instances[OUTPUT_INDEXED].gb, GB_PIXEL_FORMAT_INDEXED);
+
+    instance_t *buffers = &instances[OUTPUT_BUFFERS];
+    GB_set_pixels_output_buffers(&buffers->gb, (void *const []){buffers->buffers[0], buffers->buffers[1], buffers->buffers[2]},
+                                 GB_MAX_OUTPUT_BUFFERS);
+
+    GB_set_sample_rate(&instances[OUTPUT_AUDIO_DISABLED].gb, SAMPLE_RATE);
+    GB_set_audio_rendering_disabled(&instances[OUTPUT_AUDIO_DISABLED].gb, true);
+    GB_apu_set_sample_callback(&instances[OUTPUT_AUDIO_DISABLED].gb, unexpected_sample_callback);
+
+    uint8_t *state = malloc(GB_get_save_state_size(&instances[OUTPUT_STATE_RELOADS].gb));
+    uint8_t *resaved_state = malloc(GB_get_save_state_size(&instances[OUTPUT_STATE_RELOADS].gb));
+    unsigned state_runs = 0;
+    static uint32_t previous_frame[MAX_SCREEN_SIZE];
+    size_t checked_samples = 0;
+    unsigned width = GB_get_screen_width(&reference->gb);
+    unsigned height = GB_get_screen_height(&reference->gb);
+    bool passed = true;
+
+    for (unsigned frame = 0; frame < frames && passed; frame++) {
+        for (unsigned i = 0; i < OUTPUT_INSTANCES; i++) {
+            if (i == OUTPUT_STATE_RELOADS) {
+                if (!run_frame_reloading_state(&instances[i], state, resaved_state, &state_runs)) {
+                    passed = fail("Save state reloading", "frame", frame, "saving a loaded state gave different bytes");
+                }
+            }
+            else {
+                run_frame(&instances[i]);
+            }
+        }
+
+        const uint32_t *expected = reference->frame;
+        const uint16_t *rgb565 = instances[OUTPUT_RGB565].frame;
+        const uint8_t *indexed = instances[OUTPUT_INDEXED].frame;
+        const uint32_t *palette = instances[OUTPUT_INDEXED].frame_palette;
+        for (unsigned i = 0; i < width * height; i++) {
+            uint32_t color = expected[i];
+            if (rgb565[i] != (((color >> 8) & 0xF800) | ((color >> 5) & 0x7E0) | ((color >> 3) & 0x1F))) {
+                passed = fail("RGB565 output", "frame", frame, "pixels differ from the 32-bit output");
+                break;
+            }
+            if (indexed[i] >= instances[OUTPUT_INDEXED].frame_palette_size || palette[indexed[i]] != color) {
+                passed = fail("Indexed output", "frame", frame, "pixels differ from the 32-bit output");
+                break;
+            }
+        }
+
+        if (buffers->frame != buffers->buffers[frame % GB_MAX_OUTPUT_BUFFERS]) {
+            passed = fail("Multi-buffer output", "frame", frame, "buffers were not used in order");
+        }
+        else if (memcmp(buffers->frame, expected, width * height * sizeof(*expected))) {
+            passed = fail("Multi-buffer output", "frame", frame, "frame differs from the single buffer output");
+        }
+
+        if (memcmp(instances[OUTPUT_STATE_RELOADS].frame, expected, width * height * sizeof(*expected))) {
+            passed = fail("Save state reloading", "frame", frame, "frame differs from an uninterrupted run");
+        }
+
+        if (memcmp(instances[OUTPUT_AUDIO_DISABLED].frame, expected, width * height * sizeof(*expected))) {
+            passed = fail("Disabled audio rendering", "frame", frame, "frame differs from a run with audio");
+        }
+        else if (instances[OUTPUT_AUDIO_DISABLED].unexpected_samples) {
+            passed = fail("Disabled audio rendering", "frame", frame, "samples were delivered");
+        }
+
+        if (frame) {
+            for (unsigned y = 0; y < height; y++) {
+                bool changed = memcmp(expected + y * width, previous_frame + y * width, width * sizeof(*expected));
+                if (changed != !!(reference->changed_lines[y / 32] & (1U << (y % 32)))) {
+                    passed = fail("Changed line tracking", "frame", frame,
+                                  changed? "a changed line was not reported" : "an unchanged line was reported");
+                    break;
+                }
+            }
+        }
+        memcpy(previous_frame, expected, width * height * sizeof(*expected));
+
+        size_t available_samples = reference->n_samples < reference->n_buffered_samples?
+                                   reference->n_samples : reference->n_buffered_samples;
+        if (memcmp(reference->samples + checked_samples, reference->buffered_samples + checked_samples,
+                   (available_samples - checked_samples) * sizeof(GB_sample_t))) {
+            passed = fail("Buffered audio", "frame", frame, "samples differ from the per-sample callback's");
+        }
+        checked_samples = available_samples;
+    }
+
+    /* Samples produced after the last vblank are still in the buffer */
+    GB_apu_set_sample_buffer(&reference->gb, NULL, 0, NULL);
+    if (passed && reference->n_samples != reference->n_buffered_samples) {
+        passed = fail("Buffered audio", "frame", frames, "sample count differs from the per-sample callback's");
+    }
+    else if (passed && memcmp(reference->samples + checked_samples, reference->buffered_samples + checked_samples,
+                              (reference->n_samples - checked_samples) * sizeof(GB_sample_t))) {
+        passed = fail("Buffered audio", "frame", frames, "samples differ from the per-sample callback's");
+    }
+    if (passed && !reference->n_samples) {
+        passed = fail("Buffered audio", "frame", frames, "no samples were delivered");
+    }
+
+    free(state);
+    free(resaved_state);
+    for (unsigned i = 0; i < OUTPUT_INSTANCES; i++) {
+        free_instance(&instances[i]);
+    }
+    return passed;
+}
+
+/* Saves coverage, and loads it into a fresh instance of the same ROM and model, and into one of another model
+   revision */
+static bool test_coverage(instance_t *instance, GB_model_t model, const char *boot_rom_path, unsigned frames,
+                          const char *scratch_path)
+{
+    if (!init_instance(instance, model, boot_rom_path)) return false;
+    GB_set_coverage_enabled(&instance->gb, true);
+    for (unsigned frame = 0; frame < frames; frame++) {
+        run_frame(instance);
+    }
+
+    bool passed = true;
+    size_t size;
+    uint8_t *coverage = GB_get_coverage(&instance->gb, &size);
+    uint8_t *saved = malloc(size);
+    memcpy(saved, coverage, size);
+
+    if (GB_save_coverage(&instance->gb, scratch_path)) {
+        passed = fail("Coverage saving", "frame", frames, strerror(errno));
+    }
+    free_instance(instance);
+
+    /* Loading twice must not change it, since loading merges into the current coverage */
+    if (passed && init_instance(instance, model, boot_rom_path)) {
+        for (unsigned i = 0; i < 2 && passed; i++) {
+            int error = GB_load_coverage(&instance->gb, scratch_path);
+            size_t loaded_size;
+            coverage = GB_get_coverage(&instance->gb, &loaded_size);
+            if (error) {
+                passed = fail("Coverage loading", "frame", frames, strerror(error));
+            }
+            else if (!coverage || loaded_size != size || memcmp(coverage, saved, size)) {
+                passed = fail("Coverage loading", "frame", frames, "loaded coverage differs from the saved one");
+            }
+        }
+        free_instance(instance);
+    }
+    else {
+        passed = false;
+    }
+
+    /* A model with the same memory sizes, so only the header tells them apart */
+    if (passed && init_instance(instance, model == GB_MODEL_DMG_B? GB_MODEL_SGB_NO_SFC : GB_MODEL_CGB_C, NULL)) {
+        if (GB_load_coverage(&instance->gb, scratch_path) != EINVAL) {
+            passed = fail("Coverage loading", "frame", frames, "a file of another model was not rejected");
+        }
+        else if (GB_is_coverage_enabled(&instance->gb)) {
+            passed = fail("Coverage loading", "frame", frames, "a rejected file enabled coverage");
+        }
+        free_instance(instance);
+    }
+
+    free(saved);
+    remove(scratch_path);
+    return passed;
+}
+
+static unsigned next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void execute_command(GB_gameboy_t *gb, const char *command)
+{
+    char *input = strdup(command);
+    GB_debugger_execute_command(gb, input);
+    free(input);
+}
+
+/* Sets random, mostly overlapping, watchpoint ranges in WRAM, some of them re-watched with another range or removed,
+   and checks every address around them against a linear scan of what was set */
+static bool test_watchpoints(instance_t *instance, GB_model_t model)
+{
+    if (!init_instance(instance, model, NULL)) return false;
+    GB_gameboy_t *gb = &instance->gb;
+
+    static const char *const modifiers[] = {NULL, "r", "w", "rw"}; /* Indexed by 1 for reads, 2 for writes */
+    struct {
+        bool set;
+        uint8_t end;
+        uint8_t flags;
+    } expected[0x100];
+    uint32_t seed = 1;
+    bool passed = true;
+
+    for (unsigned round = 0; round < 256 && passed; round++) {
+        execute_command(gb, "unwatch");
+        memset(expected, 0, sizeof(expected));
+
+        unsigned count = 1 + next_random(&seed) % 16;
+        unsigned max_length = (round & 1)? 0x100 : 0x10;
+        for (unsigned i = 0; i < count; i++) {
+            uint8_t start = next_random(&seed);
+            unsigned end = start + next_random(&seed) % max_length;
+            if (end > 0xFF) {
+                end = 0xFF;
+            }
+            uint8_t flags = 1 + next_random(&seed) % 3;
+            char command[64];
+            sprintf(command, "watch/%s $%04x to $%04x", modifiers[flags], 0xC000 + start, 0xC000 + end);
+            execute_command(gb, command);
+            expected[start].set = true;
+            expected[start].end = end;
+            expected[start].flags = flags;
+        }
+
+        if (round & 2) {
+            uint8_t start = next_random(&seed);
+            while (!expected[start].set) {
+                start++;
+            }
+            char command[64];
+            sprintf(command, "unwatch $%04x", 0xC000 + start);
+            execute_command(gb, command);
+            expected[start].set = false;
+        }
+
+        for (unsigned addr = 0xBFF0; addr < 0xC110 && passed; addr++) {
+            uint8_t flags = 0;
+            for (unsigned start = 0; start < 0x100; start++) {
+                if (expected[start].set && addr >= 0xC000 + start && addr <= 0xC000 + expected[start].end) {
+                    flags |= expected[start].flags;
+                }
+            }
+
+            gb->debug_stopped = false;
+            GB_debugger_test_read_watchpoint(gb, addr);
+            if (gb->debug_stopped != !!(flags & 1)) {
+                passed = fail("Read watchpoints", "round", round, gb->debug_stopped? "hit outside of any range" : "missed");
+            }
+            gb->debug_stopped = false;
+            GB_debugger_test_write_watchpoint(gb, addr, 0);
+            if (gb->debug_stopped != !!(flags & 2)) {
+                passed = fail("Write watchpoints", "round", round, gb->debug_stopped? "hit outside of any range" : "missed");
+            }
+            gb->debug_stopped = false;
+        }
+    }
+
+    free_instance(instance);
+    return passed;
+}
+
+static uint64_t state_hash(GB_gameboy_t *gb)
+{
+    /* The RTC follows the host's clock, so it moves on while stepping back and forth */
+    typeof(gb->rtc_real) rtc_real = gb->rtc_real;
+    typeof(gb->last_rtc_second) last_rtc_second = gb->last_rtc_second;
+    memset(&gb->rtc_real, 0, sizeof(gb->rtc_real));
+    gb->last_rtc_second = 0;
+    size_t size = GB_get_save_state_size(gb);
+    uint8_t *state = malloc(size);
+    GB_save_state_to_buffer(gb, state);
+    gb->rtc_real = rtc_real;
+    gb->last_rtc_second = last_rtc_second;
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ state[i]) * 0x100000001b3;
+    }
+    /* Keys are not part of save states, but are restored by reverse execution */
+    for (size_t i = 0; i < sizeof(gb->keys); i++) {
+        hash = (hash ^ ((uint8_t *)gb->keys)[i]) * 0x100000001b3;
+    }
+    free(state);
+    return hash;
+}
+
+/* Each stop steps one instruction and back, and the state must match the one before the step */
+static char *reverse_input_callback(GB_gameboy_t *gb)
+{
+    instance_t *instance = GB_get_user_data(gb);
+    switch (instance->reverse_phase++) {
+        case 0:
+            GB_set_reverse_recording(gb, true);
+            return strdup("continue");
+        case 1:
+            instance->reverse_state_hash = state_hash(gb);
+            return strdup("step");
+        case 2:
+            return strdup("reverse-step");
+        default:
+            if (state_hash(gb) != instance->reverse_state_hash) {
+                instance->reverse_failures++;
+            }
+            instance->reverse_phase = 1;
+            return NULL;
+    }
+}
+
+/* Stops shortly after the frontend changed a key, so that stepping back has to replay the key change */
+static bool test_reverse_step(instance_t *instance, GB_model_t model, const char *boot_rom_path, unsigned frames)
+{
+    if (!init_instance(instance, model, boot_rom_path)) return false;
+    GB_gameboy_t *gb = &instance->gb;
+    GB_set_input_callback(gb, reverse_input_callback);
+
+    GB_debugger_break(gb);
+    run_frame(instance);
+
+    unsigned tests = 0;
+    for (unsigned frame = 1; frame < frames && tests < REVERSE_STEP_TESTS; frame++) {
+        run_frame(instance);
+        if (frame % 7 == 0) {
+            GB_set_key_state(gb, (frame / 7) % GB_KEY_MAX, (frame / 7) & 8);
+        }
+        if (frame % 50 == 3) {
+            for (unsigned i = (frame * 37) % 2000; i--;) {
+                GB_run(gb);
+            }
+            GB_set_key_state(gb, frame % GB_KEY_MAX, frame & 1);
+            for (unsigned i = 0; i < 50; i++) {
+                GB_run(gb);
+            }
+            GB_debugger_break(gb);
+            GB_run(gb);
+            tests++;
+        }
+    }
+
+    bool passed = true;
+    if (!tests) {
+        passed = fail("Reverse stepping", "frame", frames, "the ROM is too short to step through a key change");
+    }
+    else if (instance->reverse_failures) {
+        char reason[64];
+        sprintf(reason, "%u of %u steps did not return to the same state", instance->reverse_failures, tests);
+        passed = fail("Reverse stepping", "frame", frames, reason);
+    }
+    free_instance(instance);
+    return passed;
+}
+
+bool run_self_tests(const char *rom_path, const char *boot_rom_path, GB_model_t model, unsigned frames,
+                    const char *scratch_path)
+{
+    test_rom_path = rom_path;
+    instance_t *instances = calloc(OUTPUT_INSTANCES, sizeof(*instances));
+
+    bool passed = test_frame_output(instances, model, boot_rom_path, frames);
+    passed &= test_coverage(instances, model, boot_rom_path, frames, scratch_path);
+    passed &= test_watchpoints(instances, model);
+    passed &= test_reverse_step(instances, model, boot_rom_path, frames);
+
+    free(instances);
+    return passed;
+}
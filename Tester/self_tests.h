@@ -0,0 +1,13 @@
+#ifndef self_tests_h
+#define self_tests_h
+#include <stdbool.h>
+#include <Core/gb.h>
+
+/* Runs a ROM for the given number of frames through several emulator instances that must agree with each other,
+   and through the debugger features that can be checked against a reference. Unlike the screenshot tests, these
+   don't depend on the boot ROM's exact output. scratch_path is used for a temporary coverage file. Returns true if
+   all tests passed. */
+bool run_self_tests(const char *rom_path, const char *boot_rom_path, GB_model_t model, unsigned frames,
+                    const char *scratch_path);
+
+#endif
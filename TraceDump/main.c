@@ -0,0 +1,116 @@
+// The trace dump tool requires low-level access to the GB struct to switch ROM banks
+#define GB_INTERNAL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <Core/gb.h>
+
+/* Converts binary trace files written by the debugger's trace command into text, disassembling
+   each instruction from the ROM and annotating it with symbols from the given symbol files. */
+
+static GB_gameboy_t gb;
+static char log_buffer[0x400];
+static size_t log_length;
+
+static void log_callback(GB_gameboy_t *gb, const char *string, GB_log_attributes attributes)
+{
+    size_t length = strlen(string);
+    if (log_length + length >= sizeof(log_buffer)) {
+        length = sizeof(log_buffer) - log_length - 1;
+    }
+    memcpy(log_buffer + log_length, string, length);
+    log_length += length;
+    log_buffer[log_length] = 0;
+}
+
+static void print_record(const GB_trace_record_t *record, char *last_label)
+{
+    char opcode_only[sizeof("(not in ROM) opcode $xx")];
+    char *instruction = opcode_only;
+
+    gb.mbc_rom0_bank = record->bank;
+    gb.mbc_rom_bank = record->bank;
+    if (record->pc >= 0x8000 || GB_read_memory(&gb, record->pc) != record->opcode) {
+        /* Code running from RAM or the boot ROM, only the opcode is known */
+        sprintf(opcode_only, "(not in ROM) opcode $%02x", record->opcode);
+    }
+    else {
+        log_length = 0;
+        log_buffer[0] = 0;
+        GB_cpu_disassemble(&gb, record->pc, 1);
+
+        char *label = NULL;
+        instruction = "";
+        for (char *line = strtok(log_buffer, "\n"); line; line = strtok(NULL, "\n")) {
+            if (line[0] != ' ' && line[strlen(line) - 1] == ':') {
+                label = line;
+            }
+            else if (line[0]) {
+                instruction = line;
+            }
+        }
+        while (*instruction == ' ' || *instruction == '-' || *instruction == '>') {
+            instruction++;
+        }
+
+        if (label && strcmp(label, last_label) != 0) {
+            strncpy(last_label, label, 255);
+            printf("%s\n", label);
+        }
+    }
+
+    printf("%12llu %03x:%04x AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x  %s\n",
+           (unsigned long long)record->cycle, record->bank, record->pc,
+           record->af, record->bc, record->de, record->hl, record->sp, instruction);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s trace rom [symbol file ...]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *trace = fopen(argv[1], "rb");
+    if (!trace) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    GB_trace_file_header_t header;
+    if (fread(&header, sizeof(header), 1, trace) != 1 || memcmp(header.magic, "SBTR", 4) != 0) {
+        fprintf(stderr, "%s is not a SameBoy trace file\n", argv[1]);
+        return 1;
+    }
+    if (header.version != GB_TRACE_FILE_VERSION || header.record_size != sizeof(GB_trace_record_t)) {
+        fprintf(stderr, "%s was written by an incompatible version of SameBoy\n", argv[1]);
+        return 1;
+    }
+
+    GB_init(&gb, GB_MODEL_CGB_E);
+    GB_set_log_callback(&gb, log_callback);
+    if (GB_load_rom(&gb, argv[2])) {
+        perror(argv[2]);
+        return 1;
+    }
+    gb.boot_rom_finished = true;
+    for (unsigned i = 3; i < argc; i++) {
+        GB_debugger_load_symbol_file(&gb, argv[i]);
+    }
+
+    static GB_trace_record_t records[0x1000];
+    char last_label[256] = "";
+    size_t count;
+    while ((count = fread(records, sizeof(records[0]), sizeof(records) / sizeof(records[0]), trace))) {
+        for (size_t i = 0; i < count; i++) {
+            print_record(&records[i], last_label);
+        }
+    }
+
+    fclose(trace);
+    GB_free(&gb);
+    return 0;
+}
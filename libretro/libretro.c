@@ -82,6 +82,7 @@ static retro_log_printf_t log_cb;
 
 static retro_video_refresh_t video_cb;
 static retro_audio_sample_t audio_sample_cb;
+static retro_audio_sample_batch_t audio_batch_cb;
 static retro_input_poll_t input_poll_cb;
 static retro_input_state_t input_state_cb;
 
@@ -107,6 +108,7 @@ GB_gameboy_t gameboy[2];
 extern const unsigned char dmg_boot[], cgb_boot[], agb_boot[], sgb_boot[], sgb2_boot[];
 extern const unsigned dmg_boot_length, cgb_boot_length, agb_boot_length, sgb_boot_length, sgb2_boot_length;
 bool vblank1_occurred = false, vblank2_occurred = false;
+static bool can_dupe = false;
 
 static void fallback_log(enum retro_log_level level, const char *fmt, ...)
 {
@@ -169,11 +171,11 @@ static void rumble_callback(GB_gameboy_t *gb, double amplitude)
     }
 }
 
-static void audio_callback(GB_gameboy_t *gb, GB_sample_t *sample)
+static void audio_callback(GB_gameboy_t *gb, GB_sample_t *samples, size_t count)
 {
     if ((audio_out == GB_1 && gb == &gameboy[0]) ||
         (audio_out == GB_2 && gb == &gameboy[1])) {
-            audio_sample_cb(sample->left, sample->right);
+            audio_batch_cb((const int16_t *)samples, count);
     }
 }
 
@@ -187,6 +189,14 @@ static void vblank2(GB_gameboy_t *gb)
     vblank2_occurred = true;
 }
 
+static bool frame_changed(GB_gameboy_t *gb)
+{
+    for (unsigned i = 0; i < GB_get_screen_height(gb); i++) {
+        if (GB_is_line_changed(gb, i)) return true;
+    }
+    return false;
+}
+
 static bool bit_to_send1 = true, bit_to_send2 = true;
 
 static void serial_start1(GB_gameboy_t *gb, bool bit_received)
@@ -512,8 +522,10 @@ static void init_for_current_model(unsigned id)
     GB_set_pixels_output(&gameboy[i],
                          (uint32_t *)(frame_buf + GB_get_screen_width(&gameboy[0]) * GB_get_screen_height(&gameboy[0]) * i));
     GB_set_rgb_encode_callback(&gameboy[i], rgb_encode);
+    GB_set_changed_lines_tracking(&gameboy[i], true);
     GB_set_sample_rate(&gameboy[i], AUDIO_FREQUENCY);
-    GB_apu_set_sample_callback(&gameboy[i], audio_callback);
+    static GB_sample_t audio_buffers[2][1024];
+    GB_apu_set_sample_buffer(&gameboy[i], audio_buffers[i], sizeof(audio_buffers[i]) / sizeof(audio_buffers[i][0]), audio_callback);
     GB_set_rumble_callback(&gameboy[i], rumble_callback);
 
     /* todo: attempt to make these more generic */
@@ -955,6 +967,7 @@ void retro_set_audio_sample(retro_audio_sample_t cb)
 
 void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb)
 {
+    audio_batch_cb = cb;
 }
 
 void retro_set_input_poll(retro_input_poll_t cb)
@@ -1021,6 +1034,14 @@ void retro_run(void)
         GB_update_keys_status(&gameboy[0], 0);
     }
 
+    int av_enable = 3;
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable)) {
+        av_enable = 3;
+    }
+    for (unsigned i = 0; i < emulated_devices; i++) {
+        GB_set_audio_rendering_disabled(&gameboy[i], !(av_enable & 2) || audio_out != (i == 0? GB_1 : GB_2));
+    }
+
     vblank1_occurred = vblank2_occurred = false;
     signed delta = 0;
     if (emulated_devices == 2) { 
@@ -1058,6 +1079,13 @@ void retro_run(void)
             video_cb(frame_buf_copy, GB_get_screen_width(&gameboy[0]) * emulated_devices, GB_get_screen_height(&gameboy[0]), GB_get_screen_width(&gameboy[0]) * emulated_devices * sizeof(uint32_t));
         }
     }
+    else if (can_dupe && !frame_changed(&gameboy[0])) {
+        /* Nothing changed, let the frontend reuse the previous frame */
+        video_cb(NULL,
+                 GB_get_screen_width(&gameboy[0]),
+                 GB_get_screen_height(&gameboy[0]),
+                 GB_get_screen_width(&gameboy[0]) * sizeof(uint32_t));
+    }
     else {
         video_cb(frame_buf,
                  GB_get_screen_width(&gameboy[0]),
@@ -1082,6 +1110,10 @@ bool retro_load_game(const struct retro_game_info *info)
         log_cb(RETRO_LOG_INFO, "XRGB8888 is not supported\n");
         return false;
     }
+    
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe)) {
+        can_dupe = false;
+    }
 
     auto_model = (info->path[strlen(info->path) - 1] & ~0x20) == 'C' ? MODEL_CGB : MODEL_DMG;
     snprintf(retro_game_path, sizeof(retro_game_path), "%s", info->path);
@@ -1147,6 +1179,10 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info *info,
         log_cb(RETRO_LOG_INFO, "XRGB8888 is not supported\n");
         return false;
     }
+    
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe)) {
+        can_dupe = false;
+    }
 
     auto_model = (info->path[strlen(info->path) - 1] & ~0x20) == 'C' ? MODEL_CGB : MODEL_DMG;
     snprintf(retro_game_path, sizeof(retro_game_path), "%s", info->path);